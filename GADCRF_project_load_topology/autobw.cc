@@ -0,0 +1,248 @@
+/*
+ * autobw.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Auto-bandwidth. Rate samples of the tunnels ("rate <tunnel>
+ * 				<rate>", same unit as the capacity) are read from a file or
+ * 				a local socket; every AUTOBW_INTERVAL seconds the tunnels whose
+ * 				highest sample differs from their bandwidth by more than
+ * 				AUTOBW_THRESHOLD percent are resized together. Tunnels that
+ * 				shrink or still fit on their path only change the capacity
+ * 				reserved on it; the others get a new path, computed with
+ * 				their old capacity given back (make-before-break). The whole
+ * 				batch is applied under one lock of the table and topology.
+ */
+
+#include "header_project.h"
+
+//Tunnel to resize in this interval
+struct autobwResize{
+	int id;
+	int capacity;
+};
+
+/* Add c to the links of the path, also in the copy with the bookings (the
+ * matrix the fit is checked on) */
+static void reservePath(Topology *net, struct topologyLink **booked, int *path, int len, int c){
+
+	int i;
+
+	net->UpdateTopology(path,len,c);
+	for(i=0;booked!=NULL && i<len-1;i++)
+		booked[path[i]][path[i+1]].used+=c;
+}
+
+/******************* BEGIN AUTOBANDWIDTH CLASS METHODS *************************/
+
+//Constructor
+AutoBandwidth::AutoBandwidth(Topology *t, LspTable *lt, Calendar *cal, ProvisionPipeline *p,
+		ProvisionQueue *q, SegmentRouting *sr, int nodes, enum pathMode m, const char *src){
+
+	net = t;
+	table = lt;
+	calendar = cal;
+	pipeline = p;
+	queue = q;
+	segments = sr;
+	n = nodes;
+	mode = m;
+	stop = false;
+	size = 0;
+	peak = NULL;
+	memset(&stats,0,sizeof(stats));
+	pthread_mutex_init(&mutex,NULL);
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	input = new FeedSource(src,"rate samples",Line,this);
+	if(input->Ok())
+		pthread_create(&tid,NULL,Worker,this);
+	else
+		stop = true;
+}
+
+//Destructor
+AutoBandwidth::~AutoBandwidth(){
+
+	bool running;
+
+	pthread_mutex_lock(&mutex);
+	running = !stop;
+	stop = true;
+	pthread_mutex_unlock(&mutex);
+	if(running)
+		pthread_join(tid,NULL);
+	delete input;
+	free(peak);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * AutoBandwidth::Worker(void *arg){
+
+	((AutoBandwidth*) arg)->Run();
+	return NULL;
+}
+
+void AutoBandwidth::Line(char *line, void *arg){
+	((AutoBandwidth*) arg)->Parse(line);
+}
+
+void AutoBandwidth::Run(){
+
+	int wait;
+	bool end = false;
+
+	while(!end){
+		wait = AUTOBW_INTERVAL*1000-elapsed(&start);
+		if(wait>LINKSTATE_POLL)
+			wait = LINKSTATE_POLL;
+		if(wait<0)
+			wait = 0;
+		input->Poll(wait);
+
+		if(elapsed(&start)>=AUTOBW_INTERVAL*1000){
+			Adjust();
+			clock_gettime(CLOCK_MONOTONIC,&start);
+		}
+		pthread_mutex_lock(&mutex);
+		end = stop;
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+//Only the highest sample of the interval is kept for each tunnel
+void AutoBandwidth::Parse(char *line){
+
+	int id,rate,old;
+
+	pthread_mutex_lock(&mutex);
+	if(sscanf(line,"rate %d %d",&id,&rate)!=2 || id<0 || rate<0){
+		stats.rejected++;
+		pthread_mutex_unlock(&mutex);
+		printf("Auto-bandwidth: sample not valid: %s\n",line);
+		return;
+	}
+	stats.samples++;
+	pthread_mutex_unlock(&mutex);
+
+	if(id>=size){
+		old = size;
+		size = (size>0)?size:64;
+		while(id>=size)
+			size*=2;
+		peak = (int*) realloc(peak,size*sizeof(int));
+		while(old<size)
+			peak[old++] = -1;
+	}
+	if(rate>peak[id])
+		peak[id] = rate;
+}
+
+/* Resize the tunnels of the interval in one pass: shrinking ones first, so
+ * that the capacity they give back is there for the others, then those that
+ * fit on their path, then make-before-break for the rest */
+void AutoBandwidth::Adjust(){
+
+	struct autobwResize *r;
+	struct topologyLink **booked,**m;
+	struct lspEntry *e;
+	struct provOp *ops = NULL,**last = &ops,*op;
+	int nr = 0,i,k,pass,len,nhops,gen,resized = 0,rerouted = 0,failed = 0;
+	bool sr;
+	int *path;
+	int64_t span = TraceBegin();
+
+	r = (struct autobwResize*) malloc((size>0?size:1)*sizeof(struct autobwResize));
+	table->Lock();
+	net->Lock();
+	for(i=0;i<size && i<table->Size();i++){
+		e = table->Find(i);
+		if(peak[i]<0 || e==NULL || e->state!=LSP_UP || e->tree!=-1){
+			peak[i] = -1;
+			continue;
+		}
+		//Hysteresis: small changes do not move the tunnel
+		if((peak[i]>e->capacity?peak[i]-e->capacity:e->capacity-peak[i])*100>AUTOBW_THRESHOLD*e->capacity){
+			r[nr].id = i;
+			r[nr++].capacity = peak[i];
+		}
+		peak[i] = -1;
+	}
+
+	//Capacity booked for later windows is not free for the tunnels
+	booked = calendar->Residual(net->Matrix(),time(NULL),CALENDAR_FOREVER);
+	m = (booked!=NULL)?booked:net->Matrix();
+	for(pass=0;pass<3;pass++)
+		for(k=0;k<nr;k++){
+			e = table->Find(r[k].id);
+			if(r[k].capacity<0 || (pass==0)!=(r[k].capacity<e->capacity))
+				continue;
+			if(pass<2 && (pass==0 || fits(m,e->path,e->size,r[k].capacity-e->capacity))){
+				reservePath(net,booked,e->path,e->size,r[k].capacity-e->capacity);
+				gen = table->Resize(r[k].id,r[k].capacity,e->path,e->size);
+			}
+			else if(pass==2){
+				reservePath(net,booked,e->path,e->size,-e->capacity);
+				path = find_path_mode(m,n,e->src,e->dst,r[k].capacity,mode,&len);
+				if(path==NULL){
+					reservePath(net,booked,e->path,e->size,e->capacity);
+					failed++;
+					continue;
+				}
+				reservePath(net,booked,path,len,r[k].capacity);
+				gen = table->Resize(r[k].id,r[k].capacity,path,len);
+				delete[] path;
+				rerouted++;
+			}
+			else
+				continue;
+
+			//The head-end gets the new bandwidth and, if it changed, the new path
+			e = table->Find(r[k].id);
+			char *hops[e->size];
+			nhops = TunnelHops(net,segments,e->path,e->size,hops,&sr);
+			op = NewProvOp(OP_TUNNEL,e->src,r[k].id,net->LoopArray()[e->dst].loopAddr,e->capacity,
+					hops,nhops,true);
+			op->segments = sr;
+			op->priority = e->priority;
+			op->gen = gen;
+			*last = op;
+			last = &op->next;
+			r[k].capacity = -1;
+			resized++;
+		}
+	calendar->FreeResidual(booked);
+	net->Unlock();
+	table->Unlock();
+	free(r);
+	TraceEnd("autobw","adjust",span,nr);
+
+	while(ops!=NULL){
+		op = ops;
+		ops = op->next;
+		op->next = NULL;
+		if(pipeline!=NULL)
+			pipeline->Submit(op);
+		else
+			queue->Push(op);
+	}
+	if(pipeline==NULL && resized>0)
+		queue->Flush(NULL);
+
+	pthread_mutex_lock(&mutex);
+	stats.intervals++;
+	stats.resized+=resized;
+	stats.rerouted+=rerouted;
+	stats.failed+=failed;
+	pthread_mutex_unlock(&mutex);
+	if(DEBUG && nr>0)
+		printf("Auto-bandwidth: %d tunnels resized, %d on a new path, %d without capacity\n",resized,
+				rerouted,failed);
+}
+
+void AutoBandwidth::Stats(struct autobwStats *st){
+
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	pthread_mutex_unlock(&mutex);
+}
+
+/******************* END AUTOBANDWIDTH CLASS METHODS ***************************/
@@ -0,0 +1,336 @@
+/*
+ * brpc.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Paths across many domains (IGP areas or ASes), each one with
+ * 				its own topology file, joined by links between border routers.
+ * 				The path follows the shortest sequence of domains and is found
+ * 				with the backward recursion of BRPC: the virtual shortest path
+ * 				tree from the entry routers of a domain to the destination is
+ * 				built on the one of the next domain. The segments inside the
+ * 				domains do not depend on each other and are computed first,
+ * 				one thread per domain.
+ */
+
+#include "header_project.h"
+
+//Descriptor for 'struct borderLink'
+static const struct structs_field borderLink_fields[] = {
+		STRUCTS_STRUCT_FIELD(borderLink, srcDomain, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, src, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, dstDomain, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, dst, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, capacity, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, used, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(borderLink, srcAddr, &structs_type_string),
+		STRUCTS_STRUCT_FIELD(borderLink, dstAddr, &structs_type_string),
+		STRUCTS_STRUCT_FIELD_END
+};
+
+static const struct structs_type borderLink_type =
+		STRUCTS_STRUCT_TYPE(borderLink, &borderLink_fields);
+
+static const struct structs_type border_array_type =
+		STRUCTS_ARRAY_TYPE(&borderLink_type, "link", "link");
+
+static const struct structs_type file_array_type =
+		STRUCTS_ARRAY_TYPE(&structs_type_string, "file", "file");
+
+//Descriptor for 'struct domainsRoot'
+static const struct structs_field domainsRoot_fields[] = {
+		STRUCTS_STRUCT_FIELD(domainsRoot, files, &file_array_type),
+		STRUCTS_STRUCT_FIELD(domainsRoot, links, &border_array_type),
+		STRUCTS_STRUCT_FIELD_END
+};
+
+static const struct structs_type domainsRoot_type =
+		STRUCTS_STRUCT_TYPE(domainsRoot, &domainsRoot_fields);
+
+/* Segments of a domain of the sequence: from every entry router (the source,
+ * or the end of a border link from the previous domain) to every exit router
+ * (the destination, or the start of a border link to the next domain) */
+struct brpcDomain{
+	int domain;
+	int nin;
+	int *in;
+	int nout;
+	int *out;
+	int *link;									//Border link of each exit, -1 for the destination
+	int **seg;									//seg[i*nout+j], NULL if not reachable
+	int *segSize;
+	int *cost;									//VSPT: hops from each entry to the destination
+	int *next;									//Exit taken from each entry
+};
+
+struct brpcCtx{
+	Topology **nets;
+	int *nodes;
+	struct brpcDomain *d;
+	int c;
+};
+
+//All the segments of a domain, one thread for each domain of the sequence
+static bool brpcSegments(int p, void *arg){
+
+	struct brpcCtx *ctx = (struct brpcCtx*) arg;
+	struct brpcDomain *d = &ctx->d[p];
+	Topology *net = ctx->nets[d->domain];
+	int i,j,k;
+	bool found = false;
+
+	d->seg = (int**) calloc(d->nin*d->nout,sizeof(int*));
+	d->segSize = (int*) calloc(d->nin*d->nout,sizeof(int));
+	net->Lock();
+	for(i=0;i<d->nin;i++)
+		for(j=0;j<d->nout;j++){
+			k = i*d->nout+j;
+			if(d->in[i]==d->out[j]){
+				d->seg[k] = new int[1];
+				d->seg[k][0] = d->in[i];
+				d->segSize[k] = 1;
+			}
+			else
+				d->seg[k] = find_path(net->Matrix(),ctx->nodes[d->domain],d->in[i],d->out[j],ctx->c,
+						&d->segSize[k]);
+			found = found || d->seg[k]!=NULL;
+		}
+	net->Unlock();
+	return found;
+}
+
+/******************* BEGIN DOMAINSET CLASS METHODS *****************************/
+
+//Constructor: the topology of the PCE is domain 0
+DomainSet::DomainSet(Topology *net, int n){
+
+	count = 1;
+	nets = (Topology**) malloc(sizeof(Topology*));
+	nodes = (int*) malloc(sizeof(int));
+	nets[0] = net;
+	nodes[0] = n;
+	memset(&root,0,sizeof(root));
+	loaded = false;
+	pthread_mutex_init(&mutex,NULL);
+}
+
+//Destructor: domain 0 belongs to the caller
+DomainSet::~DomainSet(){
+
+	int i;
+	for(i=1;i<count;i++)
+		delete nets[i];
+	free(nets);
+	free(nodes);
+	if(loaded)
+		structs_free(&domainsRoot_type, NULL, &root);
+	pthread_mutex_destroy(&mutex);
+}
+
+/* Topology files of the other domains (domain 1, 2, ...) and the links
+ * between their border routers */
+bool DomainSet::Load(const char *file){
+
+	struct xmlRoot2 *xmlTopology;
+	struct borderLink *b;
+	char **files;
+	FILE *Ptr;
+	int i;
+
+	if((Ptr=fopen(file,"r"))==NULL){
+		printf("Error opening %s\n",file);
+		return false;
+	}
+	if(structs_xml_input(&domainsRoot_type, "Domains", NULL, NULL, Ptr, &root, STRUCTS_XML_UNINIT, NULL)==-1){
+		printf("Error reading %s\n",file);
+		fclose(Ptr);
+		return false;
+	}
+	fclose(Ptr);
+	loaded = true;
+
+	files = (char**) root.files.elems;
+	nets = (Topology**) realloc(nets,(root.files.length+1)*sizeof(Topology*));
+	nodes = (int*) realloc(nodes,(root.files.length+1)*sizeof(int));
+	for(i=0;i<(int)root.files.length;i++){
+		//The xml structs stay with the topology of the domain
+		xmlTopology = (struct xmlRoot2*) calloc(1,sizeof(struct xmlRoot2));
+		ImportTopologyFile(xmlTopology,files[i]);
+		if(xmlTopology->xmlVector==NULL){
+			free(xmlTopology);
+			break;
+		}
+		nodes[count] = xmlTopology->nodes;
+		nets[count] = new Topology(xmlTopology->nodes);
+		nets[count]->LoadTopology(xmlTopology);
+		count++;
+	}
+
+	//Border links between routers that do not exist are dropped
+	b = (struct borderLink*) root.links.elems;
+	for(i=0;i<(int)root.links.length;i++)
+		if(b[i].srcDomain<0 || b[i].srcDomain>=count || b[i].dstDomain<0 || b[i].dstDomain>=count
+				|| b[i].src<0 || b[i].src>=nodes[b[i].srcDomain] || b[i].dst<0
+				|| b[i].dst>=nodes[b[i].dstDomain] || b[i].srcDomain==b[i].dstDomain){
+			printf("Border link %d not valid\n",i);
+			b[i].capacity = -1;
+		}
+	printf("%d domains, %d border links\n",count,root.links.length);
+	return count==(int)root.files.length+1;
+}
+
+int DomainSet::Count(){
+	return count;
+}
+
+int DomainSet::Nodes(int domain){
+	return nodes[domain];
+}
+
+bool DomainSet::Usable(struct borderLink *b, int c){
+	return b->capacity!=-1 && b->capacity-b->used>=c;
+}
+
+//Shortest sequence of domains from one to the other (breadth first)
+int * DomainSet::Sequence(int from, int to, int c, int *len){
+
+	struct borderLink *b = (struct borderLink*) root.links.elems;
+	int prev[count],queue[count];
+	int head = 0,tail = 0,i,d,*seq;
+
+	for(i=0;i<count;i++)
+		prev[i] = -2;
+	prev[from] = -1;
+	queue[tail++] = from;
+	while(head<tail && prev[to]==-2){
+		d = queue[head++];
+		for(i=0;i<(int)root.links.length;i++)
+			if(b[i].srcDomain==d && prev[b[i].dstDomain]==-2 && Usable(&b[i],c)){
+				prev[b[i].dstDomain] = d;
+				queue[tail++] = b[i].dstDomain;
+			}
+	}
+	if(prev[to]==-2)
+		return NULL;
+	*len = 0;
+	for(d=to;d!=-1;d=prev[d])
+		(*len)++;
+	seq = (int*) malloc(*len*sizeof(int));
+	for(i=*len-1,d=to;i>=0;i--,d=prev[d])
+		seq[i] = d;
+	return seq;
+}
+
+/* BRPC on the shortest sequence of domains: the segments are computed in
+ * parallel, then the VSPT goes back from the destination domain to the
+ * source one. Hops of the result are (domain, router) pairs. */
+struct domainHop * DomainSet::FindPath(int srcDomain, int src, int dstDomain, int dst, int c, int *s){
+
+	struct borderLink *b;
+	struct brpcDomain *d;
+	struct brpcCtx ctx;
+	struct domainHop *path = NULL;
+	int *seq,len,p,i,j,k,w,size;
+	int64_t span = TraceBegin(),start = StatClock();
+
+	pthread_mutex_lock(&mutex);
+	b = (struct borderLink*) root.links.elems;
+	if((seq=Sequence(srcDomain,dstDomain,c,&len))==NULL){
+		pthread_mutex_unlock(&mutex);
+		TraceEnd("path","brpc",span,src);
+		StatPath(start,false);
+		return NULL;
+	}
+
+	//Entry routers of a domain are the ends of the exits of the previous one
+	d = (struct brpcDomain*) calloc(len,sizeof(struct brpcDomain));
+	for(p=0;p<len;p++){
+		d[p].domain = seq[p];
+		d[p].out = (int*) malloc((root.links.length+1)*sizeof(int));
+		d[p].link = (int*) malloc((root.links.length+1)*sizeof(int));
+		if(p==len-1){
+			d[p].out[0] = dst;
+			d[p].link[0] = -1;
+			d[p].nout = 1;
+		}
+		else
+			for(i=0;i<(int)root.links.length;i++)
+				if(b[i].srcDomain==seq[p] && b[i].dstDomain==seq[p+1] && Usable(&b[i],c)){
+					d[p].out[d[p].nout] = b[i].src;
+					d[p].link[d[p].nout++] = i;
+				}
+		d[p].in = (int*) malloc(((p==0)?1:d[p-1].nout)*sizeof(int));
+		if(p==0){
+			d[p].in[0] = src;
+			d[p].nin = 1;
+		}
+		else
+			for(d[p].nin=0;d[p].nin<d[p-1].nout;d[p].nin++)
+				d[p].in[d[p].nin] = b[d[p-1].link[d[p].nin]].dst;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	ctx.nets = nets;
+	ctx.nodes = nodes;
+	ctx.d = d;
+	ctx.c = c;
+	FanOut(len,len,brpcSegments,&ctx,NULL,NULL);
+
+	//VSPT: exit j of domain p is entry j of domain p+1, one hop further
+	for(p=len-1;p>=0;p--){
+		d[p].cost = (int*) malloc(d[p].nin*sizeof(int));
+		d[p].next = (int*) malloc(d[p].nin*sizeof(int));
+		for(i=0;i<d[p].nin;i++){
+			d[p].cost[i] = -1;
+			for(j=0;j<d[p].nout;j++){
+				k = i*d[p].nout+j;
+				if(d[p].seg[k]==NULL || (p<len-1 && d[p+1].cost[j]==-1))
+					continue;
+				w = d[p].segSize[k]-1+((p<len-1)?1+d[p+1].cost[j]:0);
+				if(d[p].cost[i]==-1 || w<d[p].cost[i]){
+					d[p].cost[i] = w;
+					d[p].next[i] = j;
+				}
+			}
+		}
+	}
+
+	if(d[0].cost[0]!=-1){
+		path = (struct domainHop*) malloc((d[0].cost[0]+1)*sizeof(struct domainHop));
+		size = 0;
+		for(p=0,i=0;p<len;p++){
+			j = d[p].next[i];
+			k = i*d[p].nout+j;
+			for(w=0;w<d[p].segSize[k];w++){
+				path[size].domain = d[p].domain;
+				path[size++].node = d[p].seg[k][w];
+			}
+			i = j;
+		}
+		*s = size;
+		if(DEBUG){
+			printf("\nInter-domain path over %d domains, %d hops: ",len,size-1);
+			for(w=0;w<size;w++)
+				printf("%d:%d ",path[w].domain,path[w].node);
+			printf("\n\n");
+		}
+	}
+
+	for(p=0;p<len;p++){
+		for(k=0;k<d[p].nin*d[p].nout;k++)
+			delete[] d[p].seg[k];
+		free(d[p].seg);
+		free(d[p].segSize);
+		free(d[p].in);
+		free(d[p].out);
+		free(d[p].link);
+		free(d[p].cost);
+		free(d[p].next);
+	}
+	free(d);
+	free(seq);
+	TraceEnd("path","brpc",span,src);
+	StatPath(start,path!=NULL);
+	return path;
+}
+
+/******************* END DOMAINSET CLASS METHODS *******************************/
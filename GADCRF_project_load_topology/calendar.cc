@@ -0,0 +1,170 @@
+/*
+ * calendar.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Bandwidth booked on the links for a time window. Every link
+ * 				has a segment tree on the seconds from the start of the PCE,
+ * 				whose nodes are created only along the bounds of the bookings:
+ * 				a booking adds its capacity to the nodes covering the window,
+ * 				and a node keeps the peak of the bookings below it, so both
+ * 				a booking and the peak over a window visit a path of the tree.
+ */
+
+#include "header_project.h"
+
+#define CALENDAR_SPAN ((int64_t)1<<31)			//Seconds covered by the trees
+
+/******************* BEGIN CALENDAR CLASS METHODS ******************************/
+
+//Constructor
+Calendar::Calendar(int nodes){
+
+	n = nodes;
+	base = time(NULL);
+	bookings = 0;
+	pool = (struct calendarNode**) calloc(n*n,sizeof(struct calendarNode*));
+	count = (int*) calloc(n*n,sizeof(int));
+}
+
+//Destructor
+Calendar::~Calendar(){
+
+	int k;
+	for(k=0;k<n*n;k++)
+		free(pool[k]);
+	free(pool);
+	free(count);
+}
+
+//Node 0 of every tree stands for the missing children, node 1 is the root
+int Calendar::NewNode(int link){
+
+	if(count[link]==0){
+		pool[link] = (struct calendarNode*) calloc(2,sizeof(struct calendarNode));
+		count[link] = 1;
+	}
+	else if((count[link]&(count[link]-1))==0)
+		pool[link] = (struct calendarNode*) realloc(pool[link],2*count[link]*sizeof(struct calendarNode));
+	memset(&pool[link][count[link]],0,sizeof(struct calendarNode));
+	return count[link]++;
+}
+
+//Seconds from the start of the PCE, within the span of the trees
+int64_t Calendar::Offset(time_t t){
+
+	int64_t s = (int64_t)t-base;
+	if(s<0)
+		return 0;
+	return (s>CALENDAR_SPAN)?CALENDAR_SPAN:s;
+}
+
+//Add c to [s,e) below node v, which covers [lo,hi)
+void Calendar::Add(int link, int v, int64_t lo, int64_t hi, int64_t s, int64_t e, int c){
+
+	int64_t mid = lo+(hi-lo)/2;
+	int child,l,r;
+
+	if(e<=lo || hi<=s)
+		return;
+	if(s<=lo && hi<=e){
+		pool[link][v].add+=c;
+		pool[link][v].peak+=c;
+		return;
+	}
+	//The pool may move when a node is created
+	if(s<mid){
+		if(pool[link][v].left==0){
+			child = NewNode(link);
+			pool[link][v].left = child;
+		}
+		Add(link,pool[link][v].left,lo,mid,s,e,c);
+	}
+	if(e>mid){
+		if(pool[link][v].right==0){
+			child = NewNode(link);
+			pool[link][v].right = child;
+		}
+		Add(link,pool[link][v].right,mid,hi,s,e,c);
+	}
+	l = pool[link][pool[link][v].left].peak;
+	r = pool[link][pool[link][v].right].peak;
+	pool[link][v].peak = pool[link][v].add+((l>r)?l:r);
+}
+
+//Peak of the bookings in [s,e) below node v, which covers [lo,hi)
+int Calendar::Query(int link, int v, int64_t lo, int64_t hi, int64_t s, int64_t e){
+
+	int64_t mid = lo+(hi-lo)/2;
+	int l,r;
+
+	if(v==0 || e<=lo || hi<=s)
+		return 0;
+	if(s<=lo && hi<=e)
+		return pool[link][v].peak;
+	l = Query(link,pool[link][v].left,lo,mid,s,e);
+	r = Query(link,pool[link][v].right,mid,hi,s,e);
+	return pool[link][v].add+((l>r)?l:r);
+}
+
+//Highest capacity booked on the link i->j at any time in [start,end)
+int Calendar::Peak(int i, int j, time_t start, time_t end){
+
+	if(count[i*n+j]==0)
+		return 0;
+	return Query(i*n+j,1,0,CALENDAR_SPAN,Offset(start),Offset(end));
+}
+
+//Book c on the links of the path for [start,end)
+void Calendar::Book(int *path, int len, int c, time_t start, time_t end){
+
+	int i,k;
+
+	for(i=0;i<len-1;i++){
+		k = path[i]*n+path[i+1];
+		if(count[k]==0)
+			NewNode(k);
+		Add(k,1,0,CALENDAR_SPAN,Offset(start),Offset(end),c);
+	}
+	bookings++;
+}
+
+int Calendar::Bookings(){
+	return bookings;
+}
+
+/* Copy of the matrix where "used" also counts the peak booked in [start,end),
+ * for the path computations; NULL if nothing is booked */
+struct topologyLink ** Calendar::Residual(struct topologyLink **net, time_t start, time_t end){
+
+	if(bookings==0)
+		return NULL;
+	return Copy(net,start,end);
+}
+
+//Same as Residual, also without bookings: the copy can be changed by the caller
+struct topologyLink ** Calendar::Copy(struct topologyLink **net, time_t start, time_t end){
+
+	struct topologyLink **m;
+	int i,j;
+
+	m = (struct topologyLink**) malloc(n*sizeof(struct topologyLink*));
+	m[0] = (struct topologyLink*) malloc(n*n*sizeof(struct topologyLink));
+	for(i=0;i<n;i++){
+		m[i] = m[0]+i*n;
+		memcpy(m[i],net[i],n*sizeof(struct topologyLink));
+		for(j=0;j<n;j++)
+			if(m[i][j].capacity!=-1 && bookings>0)
+				m[i][j].used+=Peak(i,j,start,end);
+	}
+	return m;
+}
+
+void Calendar::FreeResidual(struct topologyLink **m){
+
+	if(m==NULL)
+		return;
+	free(m[0]);
+	free(m);
+}
+
+/******************* END CALENDAR CLASS METHODS ********************************/
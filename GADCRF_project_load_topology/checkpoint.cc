@@ -0,0 +1,263 @@
+/*
+ * checkpoint.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Incremental checkpoints of the topology. A thread takes the
+ * 				links changed since its last pass (a short critical section,
+ * 				proportional to the changes) and writes all the links changed
+ * 				since the last full snapshot to a small delta file. When the
+ * 				delta grows too big the whole topology is written instead.
+ * 				Files are written aside and renamed over the old ones.
+ */
+
+#include "header_project.h"
+extern int simul;
+
+static const char * deltaFile(){
+	return (simul==0)?"topology_delta":"topology_delta_simul";
+}
+
+// Addresses and interfaces of the links are kept in fixed buffers
+static const struct structs_type address_type = STRUCTS_FIXEDSTRING_TYPE(CHAR_ADDRESS);
+static const struct structs_type interface_type = STRUCTS_FIXEDSTRING_TYPE(CHAR_INTERFACE);
+
+// Descriptor for 'struct linkDelta'
+static const struct structs_field linkDelta_fields[] = {
+		STRUCTS_STRUCT_FIELD(linkDelta, link, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(linkDelta, capacity, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(linkDelta, used, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(linkDelta, metric, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(linkDelta, igpMetric, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(linkDelta, srcAddr, &address_type),
+		STRUCTS_STRUCT_FIELD(linkDelta, dstAddr, &address_type),
+		STRUCTS_STRUCT_FIELD(linkDelta, srcInterface, &interface_type),
+		STRUCTS_STRUCT_FIELD(linkDelta, dstInterface, &interface_type),
+		STRUCTS_STRUCT_FIELD_END
+};
+
+static const struct structs_type linkDelta_type =
+		STRUCTS_STRUCT_TYPE(linkDelta, &linkDelta_fields);
+
+// Descriptor for field 'links' in 'struct deltaRoot'
+static const struct structs_type delta_array_type =
+		STRUCTS_ARRAY_TYPE(&linkDelta_type, "link", "link");
+
+// Descriptor for 'struct loopDelta'
+static const struct structs_field loopDelta_fields[] = {
+		STRUCTS_STRUCT_FIELD(loopDelta, node, &structs_type_int),
+		STRUCTS_STRUCT_FIELD(loopDelta, loopAddr, &address_type),
+		STRUCTS_STRUCT_FIELD_END
+};
+
+static const struct structs_type loopDelta_type =
+		STRUCTS_STRUCT_TYPE(loopDelta, &loopDelta_fields);
+
+// Descriptor for field 'loopbacks' in 'struct deltaRoot'
+static const struct structs_type loop_array_type =
+		STRUCTS_ARRAY_TYPE(&loopDelta_type, "loopback", "loopback");
+
+// Descriptor for 'struct deltaRoot'
+static const struct structs_field deltaRoot_fields[] = {
+		STRUCTS_STRUCT_FIELD(deltaRoot, journalSeq, &structs_type_uint64),
+		STRUCTS_STRUCT_FIELD(deltaRoot, generation, &structs_type_uint64),
+		STRUCTS_STRUCT_FIELD(deltaRoot, links, &delta_array_type),
+		STRUCTS_STRUCT_FIELD(deltaRoot, loopbacks, &loop_array_type),
+		STRUCTS_STRUCT_FIELD_END
+};
+
+static const struct structs_type deltaRoot_type =
+		STRUCTS_STRUCT_TYPE(deltaRoot, &deltaRoot_fields);
+
+/******************* BEGIN CHECKPOINTER CLASS METHODS **************************/
+
+//Constructor
+Checkpointer::Checkpointer(Topology *t, Journal *j, int nodes, u_int64_t checkpoint){
+
+	int i;
+	net = t;
+	journal = j;
+	n = nodes;
+	saved = checkpoint;
+	pos = (int*) malloc(n*n*sizeof(int));
+	for(i=0;i<n*n;i++)
+		pos[i] = -1;
+	delta = NULL;
+	count = 0;
+	lpos = (int*) malloc(n*sizeof(int));
+	for(i=0;i<n;i++)
+		lpos[i] = -1;
+	loops = NULL;
+	nloops = 0;
+	stop = false;
+	request = false;
+	pthread_mutex_init(&mutex,NULL);
+	pthread_cond_init(&wake,NULL);
+	pthread_create(&tid,NULL,Worker,this);
+}
+
+//Destructor
+Checkpointer::~Checkpointer(){
+
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(tid,NULL);
+	free(pos);
+	free(delta);
+	free(lpos);
+	free(loops);
+	pthread_cond_destroy(&wake);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * Checkpointer::Worker(void *arg){
+
+	((Checkpointer*) arg)->Run();
+	return NULL;
+}
+
+void Checkpointer::Run(){
+
+	struct timespec ts;
+
+	pthread_mutex_lock(&mutex);
+	while(!stop){
+		if(!request){
+			clock_gettime(CLOCK_REALTIME,&ts);
+			ts.tv_sec+=CHECKPOINT_INTERVAL;
+			pthread_cond_timedwait(&wake,&mutex,&ts);
+		}
+		request = false;
+		pthread_mutex_unlock(&mutex);
+		Take();
+		pthread_mutex_lock(&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+	Take();
+}
+
+void Checkpointer::Request(){
+
+	pthread_mutex_lock(&mutex);
+	request = true;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&mutex);
+}
+
+/* The topology is locked only to copy the changed links and the journal
+ * position they correspond to; files are written without the lock */
+void Checkpointer::Take(){
+
+	struct linkDelta *d;
+	struct loopDelta *lb;
+	u_int64_t seq;
+	int k,c,nlb;
+	bool ok;
+	int64_t span = TraceBegin();
+
+	net->Lock();
+	c = net->Changes(&d,&lb,&nlb);
+	seq = journal->Seq();
+	net->Unlock();
+	if(c==0 && nlb==0 && seq==saved){
+		free(d);
+		free(lb);
+		return;
+	}
+
+	for(k=0;k<c;k++){
+		if(pos[d[k].link]<0){
+			if((count&(count-1))==0)
+				delta = (struct linkDelta*) realloc(delta,(count>0?2*count:1)*sizeof(struct linkDelta));
+			pos[d[k].link] = count++;
+		}
+		delta[pos[d[k].link]] = d[k];
+	}
+	for(k=0;k<nlb;k++){
+		if(lpos[lb[k].node]<0){
+			if((nloops&(nloops-1))==0)
+				loops = (struct loopDelta*) realloc(loops,(nloops>0?2*nloops:1)*sizeof(struct loopDelta));
+			lpos[lb[k].node] = nloops++;
+		}
+		loops[lpos[lb[k].node]] = lb[k];
+	}
+	net->Stage(d,c,lb,nlb);
+	free(d);
+	free(lb);
+
+	if(count*CHECKPOINT_FULL>n*n){
+		if((ok=net->SaveTopology(seq))){
+			for(k=0;k<count;k++)
+				pos[delta[k].link] = -1;
+			count = 0;
+			for(k=0;k<nloops;k++)
+				lpos[loops[k].node] = -1;
+			nloops = 0;
+			unlink(deltaFile());
+		}
+	}
+	else
+		ok = WriteDelta(seq);
+
+	if(!ok){
+		printf("Checkpoint failed, retried in %d seconds\n",CHECKPOINT_INTERVAL);
+		return;
+	}
+	saved = seq;
+	if(journal->Full())
+		journal->Compact(seq);
+	TraceEnd("checkpoint","take",span,c);
+}
+
+bool Checkpointer::WriteDelta(u_int64_t seq){
+
+	struct deltaRoot root;
+	char tmp[CHAR_COMMAND];
+	FILE *Ptr;
+	bool ok;
+
+	root.journalSeq = seq;
+	root.generation = net->Generation();
+	root.links.length = count;
+	root.links.elems = delta;
+	root.loopbacks.length = nloops;
+	root.loopbacks.elems = loops;
+	snprintf(tmp,CHAR_COMMAND,"%s.tmp",deltaFile());
+	if((Ptr=fopen(tmp,"w"))==NULL){
+
+		printf("Error opening %s\n",tmp);
+		return false;
+	}
+	ok = structs_xml_output(&deltaRoot_type, "Delta", NULL, &root, Ptr, NULL, 0)==0;
+	return ReplaceFile(Ptr,deltaFile()) && ok;
+}
+
+/******************* END CHECKPOINTER CLASS METHODS ****************************/
+
+/* A delta of another generation was written before a full snapshot that
+ * replaced it (the crash came before it was removed), and it is ignored.
+ * Link-state updates do not write the journal, so a delta of the same
+ * generation with the same record number is still newer */
+u_int64_t LoadDelta(Topology *net, u_int64_t seq){
+
+	struct deltaRoot root;
+	FILE *Ptr;
+
+	if((Ptr=fopen(deltaFile(),"r"))==NULL)
+		return seq;
+	if(structs_xml_input(&deltaRoot_type, "Delta", NULL, NULL, Ptr, &root, STRUCTS_XML_UNINIT, NULL)==-1){
+		printf("Error reading %s\n",deltaFile());
+		fclose(Ptr);
+		return seq;
+	}
+	fclose(Ptr);
+	if(root.generation==net->Generation() && root.journalSeq>=seq){
+		net->ApplyDelta((struct linkDelta*) root.links.elems,root.links.length,
+				(struct loopDelta*) root.loopbacks.elems,root.loopbacks.length);
+		printf("Checkpoint delta: %d links, %d loopbacks\n",root.links.length,root.loopbacks.length);
+		seq = root.journalSeq;
+	}
+	structs_free(&deltaRoot_type, NULL, &root);
+	return seq;
+}
@@ -8,6 +8,7 @@
 
 
 #include "header_project.h"
+#include <fcntl.h>
 extern int simul;
 
 /******************* BEGIN TOPOLOGY CLASS METHODS ******************************/
@@ -17,6 +18,8 @@ Topology::Topology(int nodes){
 
 	int i,j;
 	n = nodes;
+	igpVersion = 0;
+	version = 0;
 	adjMatrix = (struct topologyLink**) calloc(n,sizeof(struct topologyLink));
 	for (i=0;i<n;i++){
 		adjMatrix[i] = (struct topologyLink*) calloc(n,sizeof(struct topologyLink));
@@ -36,9 +39,11 @@ Topology::Topology(int nodes){
 		loopbackArray[i].loopAddr = (char*) calloc(CHAR_ADDRESS,sizeof(char));
 	}
 
-	xmlStruct = (struct xmlRoot2*) malloc(sizeof (struct xmlRoot2*));
+	xmlStruct = (struct xmlRoot2*) malloc(sizeof (struct xmlRoot2));
 
 	xmlStruct->nodes = nodes;
+	xmlStruct->journalSeq = 0;
+	xmlStruct->generation = 0;
 
 	xmlStruct->loopbackInterfaces = (struct loopbackAddr*) malloc(sizeof (struct loopbackAddr));
 	xmlStruct->loopbackInterfaces->list.length = n;
@@ -54,6 +59,17 @@ Topology::Topology(int nodes){
 		l[i].dstInterface = (char*) calloc (CHAR_INTERFACE,sizeof(char));
 	}
 
+	dirty = (bool*) calloc(n*n,sizeof(bool));
+	changed = (int*) calloc(n*n,sizeof(int));
+	nchanged = 0;
+	loopDirty = (bool*) calloc(n,sizeof(bool));
+	loopChanged = (int*) calloc(n,sizeof(int));
+	nloopChanged = 0;
+	byLoopback = new HashIndex(n);
+	byLocal = new HashIndex(4*n);
+	byRemote = new HashIndex(4*n);
+	byInterface = new HashIndex(4*n);
+	pthread_mutex_init(&mutex,NULL);
 }
 
 //Destructor
@@ -84,8 +100,19 @@ Topology::~Topology(){
 
 	for(i=0;i<n;i++){
 		free(adjMatrix[i]);
+		free(loopbackArray[i].loopAddr);
 	}
 	free(adjMatrix);
+	free(loopbackArray);
+	free(dirty);
+	free(changed);
+	free(loopDirty);
+	free(loopChanged);
+	delete byLoopback;
+	delete byLocal;
+	delete byRemote;
+	delete byInterface;
+	pthread_mutex_destroy(&mutex);
 }
 
 void Topology::PrintAdjMatrix(){
@@ -154,6 +181,7 @@ void Topology::InitAdjMatrix(){
 
 	int i,j;
 
+	version++;
 	//A very bad initialization because of malfunction of iostream....
 	for(i=0;i<n;i++){
 		for(j=0;j<n;j++){
@@ -755,6 +783,9 @@ void Topology::InitXmlStruct(){
 			strcpy(l[k].dstAddr,adjMatrix[i][j].dstAddr);
 			strcpy(l[k].srcInterface,adjMatrix[i][j].srcInterface);
 			strcpy(l[k].dstInterface,adjMatrix[i][j].dstInterface);
+			l[k].metric = adjMatrix[i][j].metric;
+			l[k].delay = adjMatrix[i][j].delay;
+			l[k].igpMetric = adjMatrix[i][j].igpMetric;
 		}
 		t=k-c;
 		c++;
@@ -763,7 +794,7 @@ void Topology::InitXmlStruct(){
 	xmlStruct->loopbackInterfaces->list.elems = loopbackArray;
 }
 
-void Topology::SaveTopology(){
+bool Topology::SaveTopology(u_int64_t seq){
 
 	// Descriptor for 'struct topologyLink'
 	static const struct structs_field topologyLink_fields[] = {
@@ -773,6 +804,9 @@ void Topology::SaveTopology(){
 			STRUCTS_STRUCT_FIELD(topologyLink, dstAddr, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, srcInterface, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, dstInterface, &structs_type_string),
+			STRUCTS_STRUCT_FIELD(topologyLink, metric, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, delay, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, igpMetric, &structs_type_int),
 			STRUCTS_STRUCT_FIELD_END
 	};
 
@@ -819,6 +853,8 @@ void Topology::SaveTopology(){
 		    STRUCTS_STRUCT_FIELD(xmlRoot2, nodes, &structs_type_int),
 		    STRUCTS_STRUCT_FIELD(xmlRoot2, xmlVector, &topLink_prt_type),
 			STRUCTS_STRUCT_FIELD(xmlRoot2, loopbackInterfaces, &loop_prt_type),
+			STRUCTS_STRUCT_FIELD(xmlRoot2, journalSeq, &structs_type_uint64),
+			STRUCTS_STRUCT_FIELD(xmlRoot2, generation, &structs_type_uint64),
 		    STRUCTS_STRUCT_FIELD_END
 	};
 
@@ -826,27 +862,31 @@ void Topology::SaveTopology(){
 			STRUCTS_STRUCT_TYPE(xmlRoot2, &xmlRoot_fields);
 
 	FILE *Ptr;
-
-	if(simul==0){
-		if((Ptr=fopen("topology_xml","w"))==NULL){
-
-			printf("Error opening topology_xml\n");
-		}
-		else{
-			structs_xml_output(&xmlRoot_type, "Topology", NULL, xmlStruct, Ptr, NULL, 0);
-			fclose(Ptr);
-		}
+	const char *file = (simul==0)?"topology_xml":"topology_xml_simul";
+	char tmp[CHAR_COMMAND];
+	bool ok;
+
+	/* Written aside and renamed, a crash leaves the old checkpoint or the new
+	 * one. The new generation makes the delta of the old one stale. */
+	xmlStruct->journalSeq = seq;
+	snprintf(tmp,CHAR_COMMAND,"%s.tmp",file);
+	if((Ptr=fopen(tmp,"w"))==NULL){
+
+		printf("Error opening %s\n",tmp);
+		return false;
 	}
-	else{
-		if((Ptr=fopen("topology_xml_simul","w"))==NULL){
-
-			printf("Error opening topology_xml_simul\n");
-		}
-		else{
-			structs_xml_output(&xmlRoot_type, "Topology", NULL, xmlStruct, Ptr, NULL, 0);
-			fclose(Ptr);
-		}
+	xmlStruct->generation++;
+	ok = structs_xml_output(&xmlRoot_type, "Topology", NULL, xmlStruct, Ptr, NULL, 0)==0;
+	if(!ReplaceFile(Ptr,file) || !ok){
+		printf("Error writing %s\n",file);
+		xmlStruct->generation--;
+		return false;
 	}
+	return true;
+}
+
+u_int64_t Topology::Generation(){
+	return xmlStruct->generation;
 }
 
 void Topology::LoadTopology(struct xmlRoot2* xmlTopology){
@@ -858,6 +898,7 @@ void Topology::LoadTopology(struct xmlRoot2* xmlTopology){
 
 	l = (struct topologyLink*) xmlTopology->xmlVector->list.elems;
 	xmlStruct = xmlTopology;
+	version++;
 
 	for(i=0;i<n;i++){
 
@@ -871,12 +912,24 @@ void Topology::LoadTopology(struct xmlRoot2* xmlTopology){
 			strcpy(adjMatrix[i][j].dstAddr,l[k].dstAddr);
 			strcpy(adjMatrix[i][j].srcInterface,l[k].srcInterface);
 			strcpy(adjMatrix[i][j].dstInterface,l[k].dstInterface);
+			adjMatrix[i][j].metric = l[k].metric;
+			adjMatrix[i][j].delay = l[k].delay;
+			adjMatrix[i][j].igpMetric = l[k].igpMetric;
 		}
 		t=k-c;
 		c++;
 	}
 
-	loopbackArray = (struct loopback *) xmlStruct->loopbackInterfaces->list.elems;
+	//Own copy of the loopbacks: the xml structs are written by the checkpoint thread
+	struct loopback *loops = (struct loopback *) xmlStruct->loopbackInterfaces->list.elems;
+	u_int64_t key;
+	for(i=0;i<n;i++){
+		snprintf(loopbackArray[i].loopAddr,CHAR_ADDRESS,"%s",loops[i].loopAddr);
+		if(PackAddress(loopbackArray[i].loopAddr,&key))
+			byLoopback->Insert(key,i);
+		for(j=0;j<n;j++)
+			IndexLink(i,j,true);
+	}
 }
 
 struct topologyLink ** Topology::Matrix()
@@ -890,17 +943,267 @@ struct loopback * Topology::LoopArray(){
 
 bool Topology::UpdateTopology(int *path,int len,int c){
 	int i;
+	int64_t span = TraceBegin();
 	for(i=0;i<(len-1);i++){
 		adjMatrix[path[i]][path[i+1]].used+=c;
+		Touch(path[i],path[i+1]);
 	}
+	TraceEnd("topology","update",span,len-1);
 	return true;
 }
 
+void Topology::SetLink(int i,int j,int capacity,const char *srcAddr,const char *dstAddr,
+		const char *srcIf,const char *dstIf){
+
+	bool names = srcAddr!=NULL || dstAddr!=NULL || srcIf!=NULL;
+
+	if((capacity==-1)!=(adjMatrix[i][j].capacity==-1))
+		igpVersion++;
+	if(names)
+		IndexLink(i,j,false);
+	adjMatrix[i][j].capacity = capacity;
+	if(srcAddr!=NULL)
+		snprintf(adjMatrix[i][j].srcAddr,CHAR_ADDRESS,"%s",srcAddr);
+	if(dstAddr!=NULL)
+		snprintf(adjMatrix[i][j].dstAddr,CHAR_ADDRESS,"%s",dstAddr);
+	if(srcIf!=NULL)
+		snprintf(adjMatrix[i][j].srcInterface,CHAR_INTERFACE,"%s",srcIf);
+	if(dstIf!=NULL)
+		snprintf(adjMatrix[i][j].dstInterface,CHAR_INTERFACE,"%s",dstIf);
+	if(names)
+		IndexLink(i,j,true);
+	Touch(i,j);
+}
+
+/* Addresses and interface of the link in the indexes (add) or out of them.
+ * Links down keep their names: the caller checks the capacity. */
+void Topology::IndexLink(int i,int j,bool add){
+
+	u_int64_t key;
+	int k = i*n+j;
+
+	if(PackAddress(adjMatrix[i][j].srcAddr,&key)){
+		if(add)
+			byLocal->Insert(key,k);
+		else
+			byLocal->Remove(key,k);
+	}
+	if(PackAddress(adjMatrix[i][j].dstAddr,&key)){
+		if(add)
+			byRemote->Insert(key,k);
+		else
+			byRemote->Remove(key,k);
+	}
+	if(adjMatrix[i][j].srcInterface[0]!='\0' && strcmp(adjMatrix[i][j].srcInterface,"NULL")!=0){
+		key = InterfaceKey(i,adjMatrix[i][j].srcInterface);
+		if(add)
+			byInterface->Insert(key,k);
+		else
+			byInterface->Remove(key,k);
+	}
+}
+
+void Topology::SetLoopback(int i,const char *addr){
+
+	u_int64_t key;
+
+	if(PackAddress(loopbackArray[i].loopAddr,&key))
+		byLoopback->Remove(key,i);
+	snprintf(loopbackArray[i].loopAddr,CHAR_ADDRESS,"%s",addr);
+	if(PackAddress(loopbackArray[i].loopAddr,&key))
+		byLoopback->Insert(key,i);
+	TouchLoopback(i);
+}
+
+int Topology::NodeByLoopback(const char *addr){
+
+	u_int64_t key;
+	return PackAddress(addr,&key)?byLoopback->Find(key):-1;
+}
+
+int Topology::LinkByAddress(const char *addr,bool remote){
+
+	u_int64_t key;
+
+	if(!PackAddress(addr,&key))
+		return -1;
+	return remote?byRemote->Find(key):byLocal->Find(key);
+}
+
+//The key is a hash of the name, the link found must have the same one
+int Topology::LinkByInterface(int node,const char *name){
+
+	int k;
+
+	if(node<0 || node>=n)
+		return -1;
+	k = byInterface->Find(InterfaceKey(node,name));
+	if(k==-1 || k/n!=node || strcmp(adjMatrix[node][k%n].srcInterface,name)!=0)
+		return -1;
+	return k;
+}
+
+void Topology::SetIgpMetric(int i,int j,int metric){
+
+	adjMatrix[i][j].igpMetric = metric;
+	igpVersion++;
+	Touch(i,j);
+}
+
+unsigned Topology::IgpVersion(){
+	return igpVersion;
+}
+
+unsigned Topology::Version(){
+	return version;
+}
+
+void Topology::Touch(int i,int j){
+	version++;
+	if(!dirty[i*n+j]){
+		dirty[i*n+j] = true;
+		changed[nchanged++] = i*n+j;
+	}
+}
+
+void Topology::TouchLoopback(int i){
+	if(!loopDirty[i]){
+		loopDirty[i] = true;
+		loopChanged[nloopChanged++] = i;
+	}
+}
+
+//Cost proportional to the links changed, not to the size of the matrix
+int Topology::Changes(struct linkDelta **d,struct loopDelta **lb,int *nlb){
+
+	struct topologyLink *t;
+	int k,c = nchanged;
+
+	*d = (struct linkDelta*) malloc((c>0?c:1)*sizeof(struct linkDelta));
+	for(k=0;k<c;k++){
+		t = &adjMatrix[changed[k]/n][changed[k]%n];
+		(*d)[k].link = changed[k];
+		(*d)[k].capacity = t->capacity;
+		(*d)[k].used = t->used;
+		(*d)[k].metric = t->metric;
+		(*d)[k].igpMetric = t->igpMetric;
+		snprintf((*d)[k].srcAddr,CHAR_ADDRESS,"%s",t->srcAddr);
+		snprintf((*d)[k].dstAddr,CHAR_ADDRESS,"%s",t->dstAddr);
+		snprintf((*d)[k].srcInterface,CHAR_INTERFACE,"%s",t->srcInterface);
+		snprintf((*d)[k].dstInterface,CHAR_INTERFACE,"%s",t->dstInterface);
+		dirty[changed[k]] = false;
+	}
+	nchanged = 0;
+	*nlb = nloopChanged;
+	*lb = (struct loopDelta*) malloc((*nlb>0?*nlb:1)*sizeof(struct loopDelta));
+	for(k=0;k<*nlb;k++){
+		(*lb)[k].node = loopChanged[k];
+		snprintf((*lb)[k].loopAddr,CHAR_ADDRESS,"%s",loopbackArray[loopChanged[k]].loopAddr);
+		loopDirty[loopChanged[k]] = false;
+	}
+	nloopChanged = 0;
+	return c;
+}
+
+//Values and names of the links and loopbacks, indexed again
+void Topology::ApplyDelta(struct linkDelta *d,int count,struct loopDelta *lb,int nlb){
+
+	int k,i,j;
+
+	for(k=0;k<count;k++){
+		if(d[k].link<0 || d[k].link>=n*n)
+			continue;
+		i = d[k].link/n;
+		j = d[k].link%n;
+		IndexLink(i,j,false);
+		adjMatrix[i][j].capacity = d[k].capacity;
+		adjMatrix[i][j].used = d[k].used;
+		adjMatrix[i][j].metric = d[k].metric;
+		adjMatrix[i][j].igpMetric = d[k].igpMetric;
+		snprintf(adjMatrix[i][j].srcAddr,CHAR_ADDRESS,"%s",d[k].srcAddr);
+		snprintf(adjMatrix[i][j].dstAddr,CHAR_ADDRESS,"%s",d[k].dstAddr);
+		snprintf(adjMatrix[i][j].srcInterface,CHAR_INTERFACE,"%s",d[k].srcInterface);
+		snprintf(adjMatrix[i][j].dstInterface,CHAR_INTERFACE,"%s",d[k].dstInterface);
+		IndexLink(i,j,true);
+		Touch(i,j);
+	}
+	for(k=0;k<nlb;k++)
+		if(lb[k].node>=0 && lb[k].node<n)
+			SetLoopback(lb[k].node,lb[k].loopAddr);
+	igpVersion++;
+}
+
+//The xml structs are only written by the checkpoint thread, no lock needed
+void Topology::Stage(struct linkDelta *d,int count,struct loopDelta *lb,int nlb){
+
+	struct loopback *loops = (struct loopback *) xmlStruct->loopbackInterfaces->list.elems;
+	struct topologyLink *t;
+	int k;
+
+	for(k=0;k<count;k++){
+		t = &l[d[k].link];
+		t->capacity = d[k].capacity;
+		t->used = d[k].used;
+		t->metric = d[k].metric;
+		t->igpMetric = d[k].igpMetric;
+		structs_set_string(&structs_type_string,NULL,d[k].srcAddr,&t->srcAddr,NULL,0);
+		structs_set_string(&structs_type_string,NULL,d[k].dstAddr,&t->dstAddr,NULL,0);
+		structs_set_string(&structs_type_string,NULL,d[k].srcInterface,&t->srcInterface,NULL,0);
+		structs_set_string(&structs_type_string,NULL,d[k].dstInterface,&t->dstInterface,NULL,0);
+	}
+	for(k=0;k<nlb;k++)
+		structs_set_string(&structs_type_string,NULL,lb[k].loopAddr,&loops[lb[k].node].loopAddr,NULL,0);
+}
+
+void Topology::Lock(){
+	pthread_mutex_lock(&mutex);
+}
+
+void Topology::Unlock(){
+	pthread_mutex_unlock(&mutex);
+}
+
 /******************* END TOPOLOGY CLASS METHODS ******************************/
 
 /******************* BEGIN AUSILIARITY FUNCTIONS *****************************/
 
-void ImportTopology(struct xmlRoot2* xmlTopology){
+//Router given by index or by loopback address, -1 if unknown (topology locked)
+int ParseNode(Topology *net,int nodes,const char *s){
+
+	char *end;
+	long i;
+
+	if(strchr(s,'.')!=NULL)
+		return net->NodeByLoopback(s);
+	i = strtol(s,&end,10);
+	if(end==s || *end!='\0' || i<0 || i>=nodes)
+		return -1;
+	return (int) i;
+}
+
+bool ReplaceFile(FILE *tmp, const char *file){
+
+	char name[CHAR_COMMAND];
+	bool ok;
+	int dir;
+
+	ok = fflush(tmp)==0 && fsync(fileno(tmp))==0;
+	ok = fclose(tmp)==0 && ok;
+	snprintf(name,CHAR_COMMAND,"%s.tmp",file);
+	if(!ok || rename(name,file)==-1){
+		unlink(name);
+		return false;
+	}
+	//The rename itself is on disk only when the directory is
+	if((dir=open(".",O_RDONLY))!=-1){
+		fsync(dir);
+		close(dir);
+	}
+	return true;
+}
+
+//Topology of a domain from its XML file
+void ImportTopologyFile(struct xmlRoot2* xmlTopology, const char *file){
 
 	// Descriptor for 'struct topologyLink'
 	static const struct structs_field topologyLink_fields[] = {
@@ -910,6 +1213,9 @@ void ImportTopology(struct xmlRoot2* xmlTopology){
 			STRUCTS_STRUCT_FIELD(topologyLink, dstAddr, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, srcInterface, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, dstInterface, &structs_type_string),
+			STRUCTS_STRUCT_FIELD(topologyLink, metric, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, delay, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, igpMetric, &structs_type_int),
 			STRUCTS_STRUCT_FIELD_END
 	};
 
@@ -956,6 +1262,8 @@ void ImportTopology(struct xmlRoot2* xmlTopology){
 			STRUCTS_STRUCT_FIELD(xmlRoot2, nodes, &structs_type_int),
 			STRUCTS_STRUCT_FIELD(xmlRoot2, xmlVector, &topLink_prt_type),
 			STRUCTS_STRUCT_FIELD(xmlRoot2, loopbackInterfaces, &loop_prt_type),
+			STRUCTS_STRUCT_FIELD(xmlRoot2, journalSeq, &structs_type_uint64),
+			STRUCTS_STRUCT_FIELD(xmlRoot2, generation, &structs_type_uint64),
 			STRUCTS_STRUCT_FIELD_END
 	};
 
@@ -964,26 +1272,18 @@ void ImportTopology(struct xmlRoot2* xmlTopology){
 
 	FILE *Ptr;
 
-	if(simul==0){
-		if((Ptr=fopen("topology_xml","r"))==NULL){
+	if((Ptr=fopen(file,"r"))==NULL){
 
-			printf("errore apertura topology_xml\n");
-		}
-		else{
-			structs_xml_input(&xmlRoot_type, "Topology", NULL,NULL, Ptr, xmlTopology, STRUCTS_XML_UNINIT, NULL);
-			fclose(Ptr);
-		}
+		printf("errore apertura %s\n",file);
 	}
 	else{
-		if((Ptr=fopen("topology_xml_simul","r"))==NULL){
-
-			printf("errore apertura topology_xml_simul\n");
-		}
-		else{
-			structs_xml_input(&xmlRoot_type, "Topology", NULL,NULL, Ptr, xmlTopology, STRUCTS_XML_UNINIT, NULL);
-			fclose(Ptr);
-		}
+		structs_xml_input(&xmlRoot_type, "Topology", NULL,NULL, Ptr, xmlTopology, STRUCTS_XML_UNINIT, NULL);
+		fclose(Ptr);
 	}
 }
 
+void ImportTopology(struct xmlRoot2* xmlTopology){
+	ImportTopologyFile(xmlTopology,(simul==0)?"topology_xml":"topology_xml_simul");
+}
+
 /******************* END AUSILIARITY FUNCTIONS *****************************/
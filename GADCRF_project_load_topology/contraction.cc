@@ -0,0 +1,401 @@
+/*
+ * contraction.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Contraction hierarchy for the paths without constraints.
+ * 				Routers are contracted by increasing degree, an independent
+ * 				set at a time on FanOut threads, linking all the neighbours
+ * 				of each router (so the order does not depend on the metric).
+ * 				Customize gives a weight to every arc in rank order; a query
+ * 				only visits the ancestors of source and destination in the
+ * 				elimination tree, without a priority queue.
+ */
+
+#include "header_project.h"
+
+#define CH_INF 0x3fffffff
+
+//Graph while it is contracted
+struct chBuild{
+	int **adj;									//Neighbours not contracted, sorted
+	int *deg;
+	pthread_mutex_t *lock;
+	int *set;									//Routers contracted in this round
+	int **upper;								//Neighbours when contracted
+	int *nupper;
+};
+
+static void addNeighbour(struct chBuild *b, int v, int u){
+
+	if((b->deg[v]&(b->deg[v]-1))==0)
+		b->adj[v] = (int*) realloc(b->adj[v],(b->deg[v]>0?2*b->deg[v]:1)*sizeof(int));
+	b->adj[v][b->deg[v]++] = u;
+}
+
+static int compareInt(const void *a, const void *b){
+	return *(const int*) a - *(const int*) b;
+}
+
+/* Neighbours of u after contracting v: v is removed and the other
+ * neighbours of v are added (both lists are sorted) */
+static void mergeNeighbours(struct chBuild *b, int u, int v){
+
+	int *a = b->adj[u],*c = b->adj[v],*r;
+	int na = b->deg[u],nc = b->deg[v],i = 0,j = 0,k = 0;
+
+	r = (int*) malloc((na+nc)*sizeof(int));
+	while(i<na || j<nc){
+		if(j>=nc || (i<na && a[i]<c[j]))
+			r[k++] = a[i++];
+		else if(i>=na || c[j]<a[i])
+			r[k++] = c[j++];
+		else{
+			r[k++] = a[i++];
+			j++;
+		}
+		if(r[k-1]==u || r[k-1]==v)
+			k--;
+	}
+	free(a);
+	b->adj[u] = r;
+	b->deg[u] = k;
+}
+
+/* No two routers of the set are neighbours: the list of v does not change
+ * during the round, the lists of its neighbours are changed under their lock */
+static bool contractRouter(int k, void *arg){
+
+	struct chBuild *b = (struct chBuild*) arg;
+	int v = b->set[k],i,u;
+
+	b->nupper[v] = b->deg[v];
+	b->upper[v] = (int*) malloc(b->deg[v]*sizeof(int));
+	memcpy(b->upper[v],b->adj[v],b->deg[v]*sizeof(int));
+	for(i=0;i<b->deg[v];i++){
+		u = b->adj[v][i];
+		pthread_mutex_lock(&b->lock[u]);
+		mergeNeighbours(b,u,v);
+		pthread_mutex_unlock(&b->lock[u]);
+	}
+	return true;
+}
+
+//A router is contracted before the neighbours with more links
+static bool lessLinks(struct chBuild *b, int v, int u){
+	return b->deg[v]<b->deg[u] || (b->deg[v]==b->deg[u] && v<u);
+}
+
+/******************* BEGIN CONTRACTIONHIERARCHY CLASS METHODS ******************/
+
+//Constructor
+ContractionHierarchy::ContractionHierarchy(int nodes){
+
+	n = nodes;
+	rank = NULL;
+	order = NULL;
+	parent = NULL;
+	depth = NULL;
+	first = NULL;
+	head = NULL;
+	up = NULL;
+	down = NULL;
+	midUp = NULL;
+	midDown = NULL;
+}
+
+//Destructor
+ContractionHierarchy::~ContractionHierarchy(){
+	Free();
+}
+
+void ContractionHierarchy::Free(){
+
+	free(rank);
+	free(order);
+	free(parent);
+	free(depth);
+	free(first);
+	free(head);
+	free(up);
+	free(down);
+	free(midUp);
+	free(midDown);
+	first = NULL;
+}
+
+void ContractionHierarchy::Build(struct topologyLink **net){
+
+	struct chBuild b;
+	bool *done;
+	int i,j,k,v,u,count,next = 0,m = 0;
+
+	Free();
+	b.adj = (int**) calloc(n,sizeof(int*));
+	b.deg = (int*) calloc(n,sizeof(int));
+	b.lock = (pthread_mutex_t*) malloc(n*sizeof(pthread_mutex_t));
+	b.set = (int*) malloc(n*sizeof(int));
+	b.upper = (int**) calloc(n,sizeof(int*));
+	b.nupper = (int*) calloc(n,sizeof(int));
+	done = (bool*) calloc(n,sizeof(bool));
+	rank = (int*) malloc(n*sizeof(int));
+	order = (int*) malloc(n*sizeof(int));
+
+	//The order only needs to know which routers are linked, in any direction
+	for(i=0;i<n;i++){
+		pthread_mutex_init(&b.lock[i],NULL);
+		for(j=i+1;j<n;j++)
+			if(net[i][j].capacity!=-1 || net[j][i].capacity!=-1){
+				addNeighbour(&b,i,j);
+				addNeighbour(&b,j,i);
+			}
+	}
+	for(i=0;i<n;i++)
+		qsort(b.adj[i],b.deg[i],sizeof(int),compareInt);
+
+	while(next<n){
+		count = 0;
+		for(v=0;v<n;v++){
+			if(done[v])
+				continue;
+			for(k=0;k<b.deg[v] && lessLinks(&b,v,b.adj[v][k]);k++);
+			if(k==b.deg[v])
+				b.set[count++] = v;
+		}
+		FanOut(count,(count/16<CH_PARALLEL)?count/16+1:CH_PARALLEL,contractRouter,&b,NULL,NULL);
+		for(k=0;k<count;k++){
+			v = b.set[k];
+			done[v] = true;
+			rank[v] = next;
+			order[next++] = v;
+			free(b.adj[v]);
+			b.adj[v] = NULL;
+			b.deg[v] = 0;
+		}
+	}
+
+	//Arcs to the upper neighbours, sorted by router for Arc()
+	first = (int*) malloc((n+1)*sizeof(int));
+	for(v=0;v<n;v++){
+		first[v] = m;
+		m+=b.nupper[v];
+	}
+	first[n] = m;
+	head = (int*) malloc((m>0?m:1)*sizeof(int));
+	up = (int*) malloc((m>0?m:1)*sizeof(int));
+	down = (int*) malloc((m>0?m:1)*sizeof(int));
+	midUp = (int*) malloc((m>0?m:1)*sizeof(int));
+	midDown = (int*) malloc((m>0?m:1)*sizeof(int));
+	parent = (int*) malloc(n*sizeof(int));
+	depth = (int*) malloc(n*sizeof(int));
+	for(v=0;v<n;v++){
+		parent[v] = -1;
+		for(k=0;k<b.nupper[v];k++){
+			u = b.upper[v][k];
+			head[first[v]+k] = u;
+			if(parent[v]==-1 || rank[u]<rank[parent[v]])
+				parent[v] = u;
+		}
+		free(b.upper[v]);
+		pthread_mutex_destroy(&b.lock[v]);
+	}
+	for(k=n-1;k>=0;k--){
+		v = order[k];
+		depth[v] = (parent[v]==-1)?0:depth[parent[v]]+1;
+	}
+
+	free(b.adj);
+	free(b.deg);
+	free(b.lock);
+	free(b.set);
+	free(b.upper);
+	free(b.nupper);
+	free(done);
+
+	Customize(net);
+	if(DEBUG)
+		printf("Contraction hierarchy: %d routers, %d arcs\n",n,m);
+}
+
+//Arc from v to its upper neighbour u
+int ContractionHierarchy::Arc(int v, int u){
+
+	int lo = first[v],hi = first[v+1]-1,mid;
+
+	while(lo<=hi){
+		mid = (lo+hi)/2;
+		if(head[mid]==u)
+			return mid;
+		if(head[mid]<u)
+			lo = mid+1;
+		else
+			hi = mid-1;
+	}
+	return -1;
+}
+
+/* The weights of a link (one hop) are given to its arc, then every
+ * triangle x-v-y with v lower than x and y is tried as a shortcut for x-y,
+ * going up the ranks so that the arcs x-v and v-y are already final */
+bool ContractionHierarchy::Customize(struct topologyLink **net){
+
+	int i,j,k,v,x,y,a,b,xy,links = 0,total = 0;
+
+	if(first==NULL)
+		return false;
+	for(v=0;v<n;v++)
+		for(a=first[v];a<first[v+1];a++){
+			up[a] = (net[v][head[a]].capacity==-1)?CH_INF:1;
+			down[a] = (net[head[a]][v].capacity==-1)?CH_INF:1;
+			midUp[a] = -1;
+			midDown[a] = -1;
+			links+=(up[a]!=CH_INF)+(down[a]!=CH_INF);
+		}
+	for(i=0;i<n;i++)
+		for(j=0;j<n;j++)
+			if(net[i][j].capacity!=-1)
+				total++;
+	if(links!=total)
+		return false;
+
+	for(k=0;k<n;k++){
+		v = order[k];
+		for(a=first[v];a<first[v+1];a++)
+			for(b=first[v];b<first[v+1];b++){
+				if(rank[head[a]]>=rank[head[b]])
+					continue;
+				x = head[a];
+				y = head[b];
+				xy = Arc(x,y);
+				if(down[a]+up[b]<up[xy]){
+					up[xy] = down[a]+up[b];
+					midUp[xy] = v;
+				}
+				if(down[b]+up[a]<down[xy]){
+					down[xy] = down[b]+up[a];
+					midDown[xy] = v;
+				}
+			}
+	}
+	return true;
+}
+
+//Links of the arc a->b, shortcuts replaced by the routers they skip
+void ContractionHierarchy::Unpack(int a, int b, int **path, int *size){
+
+	int arc,mid;
+
+	if(rank[a]<rank[b]){
+		arc = Arc(a,b);
+		mid = midUp[arc];
+	}
+	else{
+		arc = Arc(b,a);
+		mid = midDown[arc];
+	}
+	if(mid==-1){
+		if((*size&(*size-1))==0)
+			*path = (int*) realloc(*path,2*(*size)*sizeof(int));
+		(*path)[(*size)++] = b;
+		return;
+	}
+	Unpack(a,mid,path,size);
+	Unpack(mid,b,path,size);
+}
+
+/* Forward search up the ancestors of src, backward search up the ancestors
+ * of dest; the best common ancestor is the highest router of the path */
+int* ContractionHierarchy::Query(int src, int dest, int *s){
+
+	int ls,lt,i,a,p,u,v,best = CH_INF,top = -1,size = 1,nUp = 0;
+	int *chainF,*distF,*predF,*chainT,*distT,*predT,*upChain;
+	int *scratch,*path,*buf;
+
+	if(first==NULL)
+		return NULL;
+	//The chains may be as long as the network, they are not on the stack
+	ls = depth[src]+1;
+	lt = depth[dest]+1;
+	scratch = (int*) malloc((4*ls+3*lt)*sizeof(int));
+	chainF = scratch;
+	distF = chainF+ls;
+	predF = distF+ls;
+	upChain = predF+ls;
+	chainT = upChain+ls;
+	distT = chainT+lt;
+	predT = distT+lt;
+
+	for(i=0,v=src;i<ls;i++,v=parent[v]){
+		chainF[i] = v;
+		distF[i] = CH_INF;
+	}
+	for(i=0,v=dest;i<lt;i++,v=parent[v]){
+		chainT[i] = v;
+		distT[i] = CH_INF;
+	}
+	if(chainF[ls-1]!=chainT[lt-1]){
+		free(scratch);
+		return NULL;
+	}
+
+	distF[0] = 0;
+	predF[0] = -1;
+	for(i=0;i<ls;i++){
+		v = chainF[i];
+		if(distF[i]==CH_INF)
+			continue;
+		for(a=first[v];a<first[v+1];a++){
+			p = depth[src]-depth[head[a]];
+			if(distF[i]+up[a]<distF[p]){
+				distF[p] = distF[i]+up[a];
+				predF[p] = i;
+			}
+		}
+	}
+	distT[0] = 0;
+	predT[0] = -1;
+	for(i=0;i<lt;i++){
+		v = chainT[i];
+		if(distT[i]==CH_INF)
+			continue;
+		for(a=first[v];a<first[v+1];a++){
+			p = depth[dest]-depth[head[a]];
+			if(distT[i]+down[a]<distT[p]){
+				distT[p] = distT[i]+down[a];
+				predT[p] = i;
+			}
+		}
+	}
+
+	for(i=0;i<lt;i++){
+		u = chainT[i];
+		p = depth[src]-depth[u];
+		if(p>=0 && chainF[p]==u && distF[p]+distT[i]<best){
+			best = distF[p]+distT[i];
+			top = i;
+		}
+	}
+	if(top==-1){
+		free(scratch);
+		return NULL;
+	}
+
+	//Up from src to the top, then down to dest
+	path = (int*) malloc(sizeof(int));
+	path[0] = src;
+	p = depth[src]-depth[chainT[top]];
+	for(i=p;i!=-1;i=predF[i])
+		upChain[nUp++] = chainF[i];
+	for(i=nUp-1;i>0;i--)
+		Unpack(upChain[i],upChain[i-1],&path,&size);
+	for(i=top;predT[i]!=-1;i=predT[i])
+		Unpack(chainT[i],chainT[predT[i]],&path,&size);
+
+	buf = new int[size];
+	memcpy(buf,path,size*sizeof(int));
+	free(path);
+	free(scratch);
+	*s = size;
+	return buf;
+}
+
+/******************* END CONTRACTIONHIERARCHY CLASS METHODS ********************/
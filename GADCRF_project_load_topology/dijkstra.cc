@@ -1,5 +1,16 @@
 #include "header_project.h"
 
+//Residual capacity of every link of the path at least c
+bool fits(struct topologyLink **m, int *path, int len, int c){
+
+	int i;
+
+	for(i=0;i<len-1;i++)
+		if(m[path[i]][path[i+1]].capacity-m[path[i]][path[i+1]].used<c)
+			return false;
+	return true;
+}
+
 // Node with minimum distance (from the ones selected)
 int minDistance(int n, int dist[], bool sptSet[])
 {
@@ -94,11 +105,12 @@ int* find_path(struct topologyLink ** net, int nodes, int src, int dest, int c,
 	}
 	path[0]=src;
 
-	printf("\nPath from node %d to node %d: ",src,dest);
-	for(int i=0;i<count+1;i++)
-		printf("%d ",path[i]);
-
-	printf("\n\n");
+	if(DEBUG){
+		printf("\nPath from node %d to node %d: ",src,dest);
+		for(int i=0;i<count+1;i++)
+			printf("%d ",path[i]);
+		printf("\n\n");
+	}
 
 	return path;
 }
@@ -175,11 +187,204 @@ int* find_path_unconstrained(struct topologyLink ** net, int nodes, int src, int
 	}
 	path[0]=src;
 
-	printf("\nPath from node %d to node %d with no capacity constrain: ",src,dest);
-	for(int i=0;i<count+1;i++)
-		printf("%d ",path[i]);
+	if(DEBUG){
+		printf("\nPath from node %d to node %d with no capacity constrain: ",src,dest);
+		for(int i=0;i<count+1;i++)
+			printf("%d ",path[i]);
+		printf("\n\n");
+	}
+
+	return path;
+}
+
+/* Labels of the objectives other than the hop count.
+ * width: bottleneck residual capacity of the path
+ * util: highest utilization of a link of the path once c is reserved
+ * load: sum of those utilizations, to prefer the less loaded of two
+ * paths with the same number of hops */
+struct pathLabel{
+	int hops;
+	int width;
+	double util;
+	double load;
+};
+
+enum labelOrder{
+	ORDER_WIDTH,			// widest first
+	ORDER_UTIL,				// least max utilization first
+	ORDER_HOPS				// fewest hops, then least loaded
+};
+
+#define UTIL_EPSILON 1e-9
+#define UTIL_ANY 1e18
+
+static double linkUtil(struct topologyLink *l, int c)
+{
+	if(l->capacity<=0)
+		return (l->used+c>0)?1e9:0;
+	return (double)(l->used+c)/l->capacity;
+}
+
+// Hash of the demand and the router, as a router would hash a flow on ECMP
+static unsigned int ecmpHash(int src, int dest, int u)
+{
+	unsigned int h = 2166136261u;
+	h = (h^src)*16777619u;
+	h = (h^dest)*16777619u;
+	h = (h^u)*16777619u;
+	return h;
+}
+
+// Compare two labels: <0 if a is better than b
+static int compareLabel(struct pathLabel *a, struct pathLabel *b, enum labelOrder order)
+{
+	switch(order){
+	case ORDER_WIDTH:
+		if(a->width!=b->width)
+			return (a->width>b->width)?-1:1;
+		return a->hops-b->hops;
+	case ORDER_UTIL:
+		if(a->util<b->util-UTIL_EPSILON)
+			return -1;
+		if(a->util>b->util+UTIL_EPSILON)
+			return 1;
+		return a->hops-b->hops;
+	default:
+		if(a->hops!=b->hops)
+			return a->hops-b->hops;
+		if(a->load<b->load-UTIL_EPSILON)
+			return -1;
+		if(a->load>b->load+UTIL_EPSILON)
+			return 1;
+		return 0;
+	}
+}
 
-	printf("\n\n");
+/* One Dijkstra pass ordered by "order" on the links with at least
+ * max(c,width) residual capacity and at most maxUtil utilization.
+ * Equal labels are broken by the ECMP hash of the demand, so that the
+ * equal cost paths of different demands are spread on different links. */
+static int* labelPath(struct topologyLink ** net, int n, int src, int dest, int c,
+		enum labelOrder order, int width, double maxUtil, struct pathLabel *best, int *s)
+{
+	struct pathLabel label[n],cand;
+	int prev[n];
+	bool reached[n],sptSet[n];
+	int u,v,rim,cmp;
 
+	for (int i = 0; i < n; i++){
+		reached[i] = false;
+		sptSet[i] = false;
+		prev[i] = -1;
+	}
+	label[src].hops = 0;
+	label[src].width = 0x7fffffff;
+	label[src].util = 0;
+	label[src].load = 0;
+	reached[src] = true;
+
+	for (int count = 0; count < n; count++)
+	{
+		u = -1;
+		for (v = 0; v < n; v++)
+			if(reached[v] && !sptSet[v] && (u==-1 || compareLabel(&label[v],&label[u],order)<0))
+				u = v;
+		if(u==-1 || u==dest)
+			break;
+		sptSet[u] = true;
+
+		for (v = 0; v < n; v++)
+		{
+			if(sptSet[v] || net[u][v].capacity==-1)
+				continue;
+			rim = net[u][v].capacity - net[u][v].used;
+			if(rim<c || rim<width || linkUtil(&net[u][v],c)>maxUtil+UTIL_EPSILON)
+				continue;
+			cand.hops = label[u].hops+1;
+			cand.width = (rim<label[u].width)?rim:label[u].width;
+			cand.util = linkUtil(&net[u][v],c);
+			cand.load = label[u].load+cand.util;
+			if(label[u].util>cand.util)
+				cand.util = label[u].util;
+			cmp = (reached[v])?compareLabel(&cand,&label[v],order):-1;
+			if(cmp<0 || (cmp==0 && ecmpHash(src,dest,u)<ecmpHash(src,dest,prev[v]))){
+				label[v] = cand;
+				prev[v] = u;
+				reached[v] = true;
+			}
+		}
+	}
+	if(!reached[dest])
+		return NULL;
+	if(best!=NULL)
+		*best = label[dest];
+
+	*s = label[dest].hops+1;
+	int* path=new int[*s];
+	for(int i=*s-1,prec=dest;i>=0;i--,prec=prev[prec])
+		path[i]=prec;
 	return path;
 }
+
+/* Path with enough residual capacity chosen by objective:
+ * PATH_SHORTEST			fewest hops (find_path)
+ * PATH_WIDEST				largest bottleneck residual capacity
+ * PATH_SHORTEST_WIDEST		fewest hops among the widest paths
+ * PATH_MIN_UTIL			least max utilization, then fewest hops and least
+ * 							loaded, then ECMP hash among the equal paths
+ * A bottleneck does not keep the order of the hop counts when a path is
+ * extended, so the hops among the best paths are found by a second pass
+ * on the links that do not lower the bottleneck. */
+int* find_path_mode(struct topologyLink ** net, int nodes, int src, int dest, int c, enum pathMode mode, int *s)
+{
+	struct pathLabel best;
+	int* path;
+	int64_t span = TraceBegin(),start = StatClock();
+
+	switch(mode){
+	case PATH_WIDEST:
+		path = labelPath(net,nodes,src,dest,c,ORDER_WIDTH,0,UTIL_ANY,NULL,s);
+		break;
+	case PATH_SHORTEST_WIDEST:
+		if((path = labelPath(net,nodes,src,dest,c,ORDER_WIDTH,0,UTIL_ANY,&best,s))==NULL)
+			break;
+		delete[] path;
+		path = labelPath(net,nodes,src,dest,c,ORDER_HOPS,(src==dest)?0:best.width,UTIL_ANY,NULL,s);
+		break;
+	case PATH_MIN_UTIL:
+		if((path = labelPath(net,nodes,src,dest,c,ORDER_UTIL,0,UTIL_ANY,&best,s))==NULL)
+			break;
+		delete[] path;
+		path = labelPath(net,nodes,src,dest,c,ORDER_HOPS,0,best.util,NULL,s);
+		break;
+	default:
+		path = find_path(net,nodes,src,dest,c,s);
+		TraceEnd("path",pathModeName(mode),span,src);
+		StatPath(start,path!=NULL);
+		return path;
+	}
+	TraceEnd("path",pathModeName(mode),span,src);
+	StatPath(start,path!=NULL);
+	if(DEBUG && path!=NULL){
+		printf("\nPath from node %d to node %d (%s): ",src,dest,pathModeName(mode));
+		for(int i=0;i<*s;i++)
+			printf("%d ",path[i]);
+		printf("\n\n");
+	}
+	return path;
+}
+
+const char * pathModeName(enum pathMode mode)
+{
+	static const char *names[] = {"shortest","widest","shortest-widest","min-util"};
+	return names[mode];
+}
+
+// Mode from its name, PATH_SHORTEST if not known
+enum pathMode pathModeByName(const char *name)
+{
+	for(int m = PATH_SHORTEST; m <= PATH_MIN_UTIL; m++)
+		if(name!=NULL && strcmp(name,pathModeName((enum pathMode) m))==0)
+			return (enum pathMode) m;
+	return PATH_SHORTEST;
+}
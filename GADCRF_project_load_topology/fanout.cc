@@ -0,0 +1,84 @@
+/*
+ * fanout.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Execution of the same operation on all the routers of the
+ * 				network with a bounded number of concurrent threads.
+ */
+
+#include "header_project.h"
+
+struct fanoutCtx{
+	int nodes;
+	int next;
+	int failed;
+	fanout_fn *fn;
+	void *arg;
+	const char *what;
+	bool *result;
+	pthread_mutex_t mutex;
+};
+
+//Worker: take the next router not yet served until all are done
+static void *fanoutWorker(void *p){
+
+	struct fanoutCtx *ctx = (struct fanoutCtx*) p;
+	int node;
+	bool ok;
+
+	while(1){
+		pthread_mutex_lock(&ctx->mutex);
+		node = ctx->next++;
+		pthread_mutex_unlock(&ctx->mutex);
+		if(node>=ctx->nodes)
+			return NULL;
+
+		ok = ctx->fn(node,ctx->arg);
+
+		pthread_mutex_lock(&ctx->mutex);
+		if(ctx->result!=NULL)
+			ctx->result[node] = ok;
+		if(!ok)
+			ctx->failed++;
+		if(ctx->what!=NULL)
+			printf("%s router %d: %s\n",ctx->what,node,ok?"done":"failed");
+		pthread_mutex_unlock(&ctx->mutex);
+	}
+}
+
+/* Call fn for every router, at most "parallel" at the same time.
+ * The outcome of each router is printed (if "what" is not NULL) and stored
+ * in result (if not NULL), the return value is the number of routers that failed. */
+int FanOut(int nodes, int parallel, fanout_fn *fn, void *arg, const char *what, bool *result){
+
+	struct fanoutCtx ctx;
+	int i,threads;
+
+	ctx.nodes = nodes;
+	ctx.next = 0;
+	ctx.failed = 0;
+	ctx.fn = fn;
+	ctx.arg = arg;
+	ctx.what = what;
+	ctx.result = result;
+	pthread_mutex_init(&ctx.mutex,NULL);
+
+	threads = (parallel<nodes)?parallel:nodes;
+	if(threads<1)
+		threads = 1;
+	pthread_t tid[threads];
+
+	for(i=0;i<threads;i++){
+		if(pthread_create(&tid[i],NULL,fanoutWorker,&ctx)!=0)
+			break;
+	}
+	//If no thread could be created the caller does all the work
+	if(i==0)
+		fanoutWorker(&ctx);
+	threads = i;
+	for(i=0;i<threads;i++)
+		pthread_join(tid[i],NULL);
+
+	pthread_mutex_destroy(&ctx.mutex);
+	return ctx.failed;
+}
@@ -0,0 +1,197 @@
+/*
+ * feed_source.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Lines of text coming from a file that is followed as it grows
+ * 				or from the clients of a local socket (source "unix:<path>"),
+ * 				used by the feeds of the routing and monitoring daemons.
+ */
+
+#include "header_project.h"
+#include <fcntl.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+struct feedClient{
+	int fd;
+	char buf[CHAR_COMMAND];
+	int len;
+};
+
+/******************* BEGIN FEEDSOURCE CLASS METHODS ****************************/
+
+//Constructor
+FeedSource::FeedSource(const char *src, const char *what, feed_line_fn *f, void *a){
+
+	int i;
+	source = strdup(src);
+	name = what;
+	fn = f;
+	arg = a;
+	listenFd = -1;
+	fileFd = -1;
+	offset = 0;
+	clients = (struct feedClient*) calloc(FEED_CLIENTS,sizeof(struct feedClient));
+	for(i=0;i<FEED_CLIENTS;i++)
+		clients[i].fd = -1;
+	ok = Open();
+}
+
+//Destructor
+FeedSource::~FeedSource(){
+
+	int i;
+	for(i=0;i<FEED_CLIENTS;i++)
+		if(clients[i].fd!=-1)
+			close(clients[i].fd);
+	if(listenFd!=-1){
+		close(listenFd);
+		unlink(source+5);
+	}
+	if(fileFd!=-1)
+		close(fileFd);
+	free(clients);
+	free(source);
+}
+
+/* A file is read from its current end, like tail -f; a socket accepts
+ * the connections of the daemons */
+bool FeedSource::Open(){
+
+	struct sockaddr_un addr;
+
+	if(strncmp(source,"unix:",5)!=0){
+		if((fileFd=open(source,O_RDONLY|O_CREAT,0644))==-1){
+			printf("Error opening %s %s: %s\n",name,source,strerror(errno));
+			return false;
+		}
+		offset = lseek(fileFd,0,SEEK_END);
+		return true;
+	}
+
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path,sizeof(addr.sun_path),"%s",source+5);
+	unlink(addr.sun_path);
+	if((listenFd=socket(AF_UNIX,SOCK_STREAM,0))==-1
+			|| bind(listenFd,(struct sockaddr*) &addr,sizeof(addr))==-1
+			|| listen(listenFd,FEED_CLIENTS)==-1){
+		printf("Error opening %s socket %s: %s\n",name,source+5,strerror(errno));
+		if(listenFd!=-1)
+			close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	return true;
+}
+
+bool FeedSource::Ok(){
+	return ok;
+}
+
+/* Wait at most wait milliseconds for new lines (a file is read once the
+ * time is over) and pass the complete ones to fn */
+void FeedSource::Poll(int wait){
+
+	struct pollfd fds[FEED_CLIENTS+1];
+	int i,k,nfds,fd;
+
+	nfds = 0;
+	if(listenFd!=-1){
+		fds[nfds].fd = listenFd;
+		fds[nfds++].events = POLLIN;
+		for(i=0;i<FEED_CLIENTS;i++)
+			if(clients[i].fd!=-1){
+				fds[nfds].fd = clients[i].fd;
+				fds[nfds++].events = POLLIN;
+			}
+	}
+	poll(fds,nfds,wait);
+
+	if(listenFd==-1){
+		ReadFile();
+		return;
+	}
+	if(fds[0].revents & POLLIN){
+		fd = accept(listenFd,NULL,NULL);
+		for(i=0;i<FEED_CLIENTS && fd!=-1;i++)
+			if(clients[i].fd==-1){
+				clients[i].fd = fd;
+				clients[i].len = 0;
+				fd = -1;
+			}
+		if(fd!=-1)
+			close(fd);
+	}
+	for(k=1;k<nfds;k++){
+		if(fds[k].revents==0)
+			continue;
+		for(i=0;i<FEED_CLIENTS;i++)
+			if(clients[i].fd==fds[k].fd)
+				ReadClient(i);
+	}
+}
+
+/* Data appended to the file since the last read, the partial line is kept
+ * in the buffer of the first client; a truncated file is read again */
+void FeedSource::ReadFile(){
+
+	struct feedClient *c = &clients[0];
+	struct stat sb;
+	int r;
+
+	if(fstat(fileFd,&sb)==0 && sb.st_size<offset){
+		offset = 0;
+		c->len = 0;
+	}
+	while((r=pread(fileFd,c->buf+c->len,sizeof(c->buf)-1-c->len,offset))>0){
+		offset+=r;
+		c->len+=r;
+		Lines(c->buf,&c->len);
+	}
+}
+
+void FeedSource::ReadClient(int k){
+
+	struct feedClient *c = &clients[k];
+	int r;
+
+	r = read(c->fd,c->buf+c->len,sizeof(c->buf)-1-c->len);
+	if(r<=0){
+		close(c->fd);
+		c->fd = -1;
+		return;
+	}
+	c->len+=r;
+	Lines(c->buf,&c->len);
+}
+
+//Parse the complete lines of the buffer and keep the last partial one
+void FeedSource::Lines(char *buf, int *len){
+
+	char *line,*nl;
+	int done = 0;
+
+	buf[*len] = '\0';
+	line = buf;
+	while((nl=strchr(line,'\n'))!=NULL){
+		*nl = '\0';
+		while(*line==' ' || *line=='\t')
+			line++;
+		if(*line!='\0' && *line!='#'){
+			int64_t span = TraceBegin();
+			fn(line,arg);
+			TraceEnd("feed",name,span,-1);
+			StatAdd(STAT_FEED_LINES,1);
+		}
+		line = nl+1;
+	}
+	done = line-buf;
+	//A line longer than the buffer is dropped
+	if(done==0 && *len>=CHAR_COMMAND-1)
+		done = *len;
+	memmove(buf,buf+done,*len-done);
+	*len-=done;
+}
+
+/******************* END FEEDSOURCE CLASS METHODS ******************************/
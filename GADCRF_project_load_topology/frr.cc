@@ -0,0 +1,251 @@
+/*
+ * frr.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Reroute after a failure. When links or a router go down, the
+ * 				tunnels crossing them are found from the list of LSPs of each
+ * 				link, their capacity is given back and their new paths are
+ * 				computed in parallel by the path scheduler, on the topology
+ * 				after the failure, without holding the table. The paths are
+ * 				then reserved in priority order under one lock of the table
+ * 				and topology, on the tunnels still waiting for them: a path
+ * 				that no longer fits, because a tunnel before it took the
+ * 				capacity, is computed again on the spot. The head-ends get the
+ * 				new explicit paths; tunnels left without a path are removed.
+ * 				P2MP branches on the links fail, with the branches hanging
+ * 				from them.
+ */
+
+#include "header_project.h"
+
+//Tunnel to reroute, copied from the table
+struct frrLsp{
+	int id;
+	int src;
+	int dst;
+	int priority;
+	int capacity;
+	int gen;									//Generation of the entry after the release
+	struct pathRequest *request;
+	int *path;
+	int size;
+};
+
+//Highest priority (lowest value) first, then the largest tunnels
+static int compareLsp(const void *a, const void *b){
+
+	const struct frrLsp *x = (const struct frrLsp*) a,*y = (const struct frrLsp*) b;
+
+	if(x->priority!=y->priority)
+		return x->priority-y->priority;
+	if(x->capacity!=y->capacity)
+		return y->capacity-x->capacity;
+	return x->id-y->id;
+}
+
+/* Branches of the P2MP tree on the links down (down[id]) give back their
+ * capacity and fail, with the branches hanging from them: the branches are
+ * walked in the order they were added, so each one starts from a router
+ * that is still in the tree or is cut off. Table and topology locked. */
+static int failBranches(LspTable *table, Topology *net, int tree, char *down, int n){
+
+	struct lspEntry *e;
+	bool inTree[n];
+	int i,k,failed = 0;
+
+	memset(inTree,0,sizeof(inTree));
+	for(k=0;k<table->Size();k++){
+		e = table->Find(k);
+		if(e==NULL || e->tree!=tree || (e->state!=LSP_PENDING && e->state!=LSP_UP))
+			continue;
+		inTree[e->src] = true;
+		if(!down[k] && inTree[e->path[0]]){
+			for(i=0;i<e->size;i++)
+				inTree[e->path[i]] = true;
+			continue;
+		}
+		net->UpdateTopology(e->path,e->size,-e->capacity);
+		table->Drop(k,LSP_FAILED);
+		failed++;
+	}
+	return failed;
+}
+
+/******************* BEGIN FASTREROUTE CLASS METHODS ***************************/
+
+//Constructor
+FastReroute::FastReroute(Topology *t, LspTable *lt, Calendar *cal, PathScheduler *ps, ProvisionPipeline *p,
+		ProvisionQueue *q, SegmentRouting *sr, int nodes, enum pathMode m){
+
+	net = t;
+	table = lt;
+	calendar = cal;
+	scheduler = ps;
+	pipeline = p;
+	queue = q;
+	segments = sr;
+	n = nodes;
+	mode = m;
+	memset(&stats,0,sizeof(stats));
+	pthread_mutex_init(&mutex,NULL);
+}
+
+//Destructor
+FastReroute::~FastReroute(){
+	pthread_mutex_destroy(&mutex);
+}
+
+/* Reroute the tunnels on the links (i*n+j), already down on the topology.
+ * Called without locks. */
+int FastReroute::LinksDown(int *links, int count){
+
+	struct frrLsp *r = NULL;
+	struct linkUse *u;
+	struct lspEntry *e;
+	struct topologyLink **m;
+	struct provOp *ops = NULL,**last = &ops,*op;
+	struct timespec start;
+	enum schedStatus status;
+	int nr = 0,k,h,c,t,len,nhops,gen,branches = 0,rerouted = 0,failed = 0,ms;
+	int *path,*trees = NULL,ntrees = 0;
+	char *seen;
+	bool sr;
+	int64_t span;
+
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	span = TraceBegin();
+	table->Lock();
+	net->Lock();
+	seen = (char*) calloc(table->Size()>0?table->Size():1,sizeof(char));
+	for(k=0;k<count;k++){
+		u = table->OnLink(links[k]/n,links[k]%n,&c);
+		for(h=0;h<c;h++){
+			if(seen[u[h].id])
+				continue;
+			seen[u[h].id] = 1;
+			e = table->Find(u[h].id);
+			//Already released by a reroute still computing its path
+			if(e->state==LSP_REROUTING)
+				continue;
+			if(e->tree!=-1){
+				for(t=0;t<ntrees && trees[t]!=e->tree;t++);
+				if(t==ntrees){
+					trees = (int*) realloc(trees,(ntrees+1)*sizeof(int));
+					trees[ntrees++] = e->tree;
+				}
+				continue;
+			}
+			if((nr&(nr-1))==0)
+				r = (struct frrLsp*) realloc(r,(nr>0?2*nr:1)*sizeof(struct frrLsp));
+			r[nr].id = u[h].id;
+			r[nr].src = e->src;
+			r[nr].dst = e->dst;
+			r[nr].priority = e->priority;
+			r[nr++].capacity = e->capacity;
+		}
+	}
+	//The capacity of the tunnels is free for their own new paths
+	for(k=0;k<nr;k++){
+		table->Unreserve(r[k].id,net);
+		r[k].gen = table->Find(r[k].id)->gen;
+	}
+	for(k=0;k<ntrees;k++)
+		branches+=failBranches(table,net,trees[k],seen,n);
+	free(seen);
+	free(trees);
+	net->Unlock();
+	table->Unlock();
+
+	//Paths computed on the copies, the table is free for the other requests meanwhile
+	qsort(r,nr,sizeof(struct frrLsp),compareLsp);
+	for(k=0;k<nr;k++)
+		r[k].request = scheduler->Submit(r[k].src,r[k].dst,r[k].capacity,LSP_PRIORITIES-1-r[k].priority,0);
+	for(k=0;k<nr;k++)
+		r[k].path = scheduler->Wait(r[k].request,&r[k].size,&status);
+
+	table->Lock();
+	net->Lock();
+	m = calendar->Copy(net->Matrix(),time(NULL),CALENDAR_FOREVER);
+	for(k=0;k<nr;k++){
+		e = table->Find(r[k].id);
+		path = r[k].path;
+		len = r[k].size;
+		//Released or changed while the path was computed
+		if(e==NULL || e->state!=LSP_REROUTING || e->gen!=r[k].gen){
+			delete[] path;
+			continue;
+		}
+		//Capacity taken by a tunnel before this one, or a link down since it was computed
+		if(path!=NULL && !fits(m,path,len,e->capacity)){
+			delete[] path;
+			path = find_path_mode(m,n,e->src,e->dst,e->capacity,mode,&len);
+		}
+		if(path==NULL){
+			table->Drop(r[k].id,LSP_FAILED);
+			op = NewProvOp(OP_REMOVE,e->src,r[k].id,NULL,0,NULL,0,false);
+			failed++;
+		}
+		else{
+			net->UpdateTopology(path,len,e->capacity);
+			for(h=0;h<len-1;h++)
+				m[path[h]][path[h+1]].used+=e->capacity;
+			gen = table->Resize(r[k].id,e->capacity,path,len);
+			delete[] path;
+			char *hops[e->size];
+			nhops = TunnelHops(net,segments,e->path,e->size,hops,&sr);
+			op = NewProvOp(OP_TUNNEL,e->src,r[k].id,net->LoopArray()[e->dst].loopAddr,e->capacity,
+					hops,nhops,true);
+			op->segments = sr;
+			op->priority = e->priority;
+			op->gen = gen;
+			rerouted++;
+		}
+		*last = op;
+		last = &op->next;
+	}
+	calendar->FreeResidual(m);
+	net->Unlock();
+	table->Unlock();
+	free(r);
+	ms = elapsed(&start);
+	TraceEnd("frr","reroute",span,nr);
+
+	//Without pipeline and queue the tunnels are only placed, the operations are dropped
+	if(pipeline==NULL && queue==NULL){
+		FreeProvOps(ops);
+		ops = NULL;
+	}
+	while(ops!=NULL){
+		op = ops;
+		ops = op->next;
+		op->next = NULL;
+		if(pipeline!=NULL)
+			pipeline->Submit(op);
+		else
+			queue->Push(op);
+	}
+	if(pipeline==NULL && queue!=NULL && nr>0)
+		queue->Flush(NULL);
+
+	pthread_mutex_lock(&mutex);
+	stats.events++;
+	stats.affected+=nr;
+	stats.rerouted+=rerouted;
+	stats.failed+=failed;
+	stats.branches+=branches;
+	stats.lastMs = ms;
+	pthread_mutex_unlock(&mutex);
+	if(DEBUG && nr+branches>0)
+		printf("Reroute: %d tunnels on %d links down, %d on a new path, %d without path (%d ms)%s\n",nr,
+				count,rerouted,failed,ms,(branches>0)?", P2MP branches failed":"");
+	return rerouted;
+}
+
+void FastReroute::Stats(struct frrStats *st){
+
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	pthread_mutex_unlock(&mutex);
+}
+
+/******************* END FASTREROUTE CLASS METHODS *****************************/
@@ -0,0 +1,153 @@
+/*
+ * hash_index.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Hash table from 64 bit keys to indexes (routers, links), with
+ * 				open addressing and linear probing. Used by the topology to
+ * 				find a router by loopback and a link by address or interface
+ * 				name, without scanning the matrix.
+ */
+
+#include "header_project.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_FULL 1
+#define SLOT_DELETED 2
+
+//Finalizer of splitmix64: keys close to each other end far apart
+static u_int64_t mix(u_int64_t k){
+
+	k^=k>>30;
+	k*=0xbf58476d1ce4e5b9ULL;
+	k^=k>>27;
+	k*=0x94d049bb133111ebULL;
+	k^=k>>31;
+	return k;
+}
+
+/******************* BEGIN HASHINDEX CLASS METHODS *****************************/
+
+//Constructor, room for entries without growing
+HashIndex::HashIndex(int entries){
+
+	size = 16;
+	while(size<2*entries)
+		size*=2;
+	count = 0;
+	deleted = 0;
+	keys = (u_int64_t*) malloc(size*sizeof(u_int64_t));
+	values = (int*) malloc(size*sizeof(int));
+	state = (char*) calloc(size,sizeof(char));
+}
+
+//Destructor
+HashIndex::~HashIndex(){
+
+	free(keys);
+	free(values);
+	free(state);
+}
+
+//Slot of key, or the first free one found on its probe sequence
+int HashIndex::Slot(u_int64_t key){
+
+	int s = mix(key)&(size-1),free = -1;
+
+	while(state[s]!=SLOT_EMPTY){
+		if(state[s]==SLOT_FULL && keys[s]==key)
+			return s;
+		if(state[s]==SLOT_DELETED && free==-1)
+			free = s;
+		s = (s+1)&(size-1);
+	}
+	return (free!=-1)?free:s;
+}
+
+//Table at most half full, deleted slots included
+void HashIndex::Grow(){
+
+	u_int64_t *oldKeys = keys;
+	int *oldValues = values;
+	char *oldState = state;
+	int oldSize = size,s,k;
+
+	if(2*(count+deleted+1)<=size)
+		return;
+	if(4*(count+1)>size)
+		size*=2;
+	keys = (u_int64_t*) malloc(size*sizeof(u_int64_t));
+	values = (int*) malloc(size*sizeof(int));
+	state = (char*) calloc(size,sizeof(char));
+	deleted = 0;
+	for(k=0;k<oldSize;k++)
+		if(oldState[k]==SLOT_FULL){
+			s = Slot(oldKeys[k]);
+			keys[s] = oldKeys[k];
+			values[s] = oldValues[k];
+			state[s] = SLOT_FULL;
+		}
+	free(oldKeys);
+	free(oldValues);
+	free(oldState);
+}
+
+//The key gets value, also if it had another one
+void HashIndex::Insert(u_int64_t key, int value){
+
+	int s;
+
+	Grow();
+	s = Slot(key);
+	if(state[s]!=SLOT_FULL){
+		if(state[s]==SLOT_DELETED)
+			deleted--;
+		count++;
+		keys[s] = key;
+		state[s] = SLOT_FULL;
+	}
+	values[s] = value;
+}
+
+//Removed only if the key still has value (it may have moved to another one)
+void HashIndex::Remove(u_int64_t key, int value){
+
+	int s = Slot(key);
+
+	if(state[s]!=SLOT_FULL || values[s]!=value)
+		return;
+	state[s] = SLOT_DELETED;
+	count--;
+	deleted++;
+}
+
+//-1 if the key is not there
+int HashIndex::Find(u_int64_t key){
+
+	int s = Slot(key);
+	return (state[s]==SLOT_FULL)?values[s]:-1;
+}
+
+/******************* END HASHINDEX CLASS METHODS *******************************/
+
+//IPv4 address in the low 32 bits, false if the string is not one
+bool PackAddress(const char *addr, u_int64_t *key){
+
+	struct in_addr a;
+
+	if(addr==NULL || inet_pton(AF_INET,addr,&a)!=1)
+		return false;
+	*key = ntohl(a.s_addr);
+	return true;
+}
+
+//Router and interface name in one key (FNV-1a of the name), verified on lookup
+u_int64_t InterfaceKey(int node, const char *name){
+
+	u_int64_t h = 0xcbf29ce484222325ULL;
+
+	for(;*name!='\0';name++){
+		h^=(unsigned char)*name;
+		h*=0x100000001b3ULL;
+	}
+	return h^mix((u_int64_t)node+1);
+}
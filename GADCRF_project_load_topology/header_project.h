@@ -18,11 +18,15 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <time.h>
 #include <pdel/structs/xml.h>
 #include <pdel/structs/structs.h>
 #include <pdel/structs/types.h>
 #include <pdel/structs/xmlrpc.h>
+#include <pdel/util/mesg_port.h>
+#include <pdel/sys/logfile.h>
 #include <expat.h>
 #include <pthread.h>
 
@@ -32,8 +36,47 @@
 #define CHAR_ADDRESS 50
 #define CHAR_INTERFACE 30
 #define CHAR_COMMAND 500
+#define CHAR_HOSTNAME 64
+#ifndef DEBUG
 #define DEBUG true
+#endif
 #define INT_DIGITS 19
+#define TELNET_PORT 23
+#define CLI_USERNAME "admin"
+#define CLI_PASSWORD "admin"
+#define CLI_TIMEOUT 10000				//Milliseconds waiting for a prompt
+#define CHAR_CLI_BUFFER 4096
+#define FANOUT_PARALLEL 64				//Routers configured/probed at the same time
+#define PIPELINE_QUEUE_MAX 4096			//Queued operations before Submit blocks
+#define PIPELINE_RETRIES 5				//Attempts on a head-end before giving up
+#define PIPELINE_BACKOFF 200			//Milliseconds before the first retry, then doubled
+#define JOURNAL_ENTRIES (1<<20)			//Records kept in the journal ring
+#define JOURNAL_DATA (1<<24)			//Bytes of the journal ring
+#define JOURNAL_COMMIT 2				//Milliseconds a commit waits for other records
+#define CHECKPOINT_INTERVAL 5			//Seconds between two checkpoints
+#define CHECKPOINT_FULL 4				//Full snapshot when 1/CHECKPOINT_FULL of the links are in the delta
+#define LINKSTATE_BATCH 100				//Milliseconds link-state updates are gathered before being applied
+#define LINKSTATE_POLL 200				//Milliseconds between two reads of the feed file
+#define FEED_CLIENTS 8					//Connections accepted on a feed socket
+#define CH_PARALLEL 8					//Threads contracting the routers of the hierarchy
+#define DELAY_KPATHS 32					//Paths tried when LARAC does not prove its path optimal
+#define AUTOBW_INTERVAL 30				//Seconds of rate samples before the tunnels are resized
+#define AUTOBW_THRESHOLD 10				//Percent of change that resizes a tunnel
+#define CALENDAR_FOREVER ((time_t)INT64_MAX)	//End of the window of an LSP installed now
+#define REQUEST_WORKERS 4					//Threads computing the requested paths
+#define REQUEST_BATCH 16					//Requests computed on one copy of the matrix
+#define TRACE_SPANS 8192				//Spans kept for each thread
+#define TRACE_FILE "pce_trace.json"		//Chrome trace written when tracing is switched off
+#define STAT_BUCKETS 24					//Latency buckets of the paths, up to 2^23 microseconds
+#define METRICS_TICK 100				//Milliseconds of the timer measuring the event loop lag
+#define LSP_PRIORITY 2					//Setup priority of the tunnels not given one
+#define LSP_PRIORITIES 8				//Setup priorities 0..7
+#define METRIC_MAX 64					//Highest IGP metric tried by the optimizer
+#define METRIC_CANDIDATES 64			//Metric changes evaluated in a step of the optimizer
+#define METRIC_PARALLEL 8				//Threads evaluating the candidates
+#define METRIC_STEPS 1000				//Steps of the optimizer at most
+#define METRIC_PATIENCE 20				//Steps without improvement that end the optimizer
+#define METRIC_EPSILON 1e-9				//Smaller differences of utilization are ties
 
 struct topologyLink{
 	int capacity;
@@ -42,6 +85,9 @@ struct topologyLink{
 	char *dstAddr;
 	char *srcInterface;
 	char *dstInterface;
+	int metric;									//TE metric, 0 in old files: one hop
+	int delay;									//Microseconds
+	int igpMetric;								//IGP metric, 0 in old files: the TE metric
 };
 
 struct topLink{
@@ -56,12 +102,66 @@ struct xmlRoot2{
 	int nodes;
 	struct loopbackAddr *loopbackInterfaces;
 	struct topLink *xmlVector;
+	u_int64_t journalSeq;						//Last journal record contained in the file
+	u_int64_t generation;						//Full checkpoints written so far
 };
 
 struct loopback{
 	char *loopAddr;
 };
 
+//Values of a link changed since the last full checkpoint
+struct linkDelta{
+	int link;									//i*n+j
+	int capacity;
+	int used;
+	int metric;
+	int igpMetric;
+	char srcAddr[CHAR_ADDRESS];
+	char dstAddr[CHAR_ADDRESS];
+	char srcInterface[CHAR_INTERFACE];
+	char dstInterface[CHAR_INTERFACE];
+};
+
+//Loopback of a router changed since the last full checkpoint
+struct loopDelta{
+	int node;
+	char loopAddr[CHAR_ADDRESS];
+};
+
+struct deltaRoot{
+	u_int64_t journalSeq;						//Last journal record contained in the delta
+	u_int64_t generation;						//Full checkpoint the delta applies to
+	struct structs_array links;
+	struct structs_array loopbacks;
+};
+
+//Indexes of routers or links by 64 bit keys (open addressing)
+class HashIndex{
+
+private:
+
+	int size;									//Power of 2
+	int count;
+	int deleted;
+	u_int64_t *keys;
+	int *values;
+	char *state;
+
+	int Slot(u_int64_t key);
+	void Grow();
+
+public:
+	HashIndex(int entries);							//Constructor
+	~HashIndex();									//Destructor
+	void Insert(u_int64_t key, int value);
+	void Remove(u_int64_t key, int value);
+	int Find(u_int64_t key);						//-1 if not there
+};
+
+bool PackAddress(const char *addr, u_int64_t *key);
+u_int64_t InterfaceKey(int node, const char *name);
+
 class Topology{
 
 private:
@@ -75,6 +175,34 @@ private:
 	struct xmlRoot2 *xmlStruct;
 	struct topologyLink *l;
 
+	//Serialize updates coming from provisioning threads
+	pthread_mutex_t mutex;
+
+	//Links changed since the last checkpoint
+	bool *dirty;
+	int *changed;
+	int nchanged;
+	bool *loopDirty;
+	int *loopChanged;
+	int nloopChanged;
+
+	void Touch(int i,int j);
+	void TouchLoopback(int i);
+
+	//Changes of the IGP graph: links added or removed, metrics
+	unsigned igpVersion;
+
+	//Changes of any value of the matrix, reservations included
+	unsigned version;
+
+	//Routers by loopback, links (i*n+j) by local and remote address and by interface of i
+	HashIndex *byLoopback;
+	HashIndex *byLocal;
+	HashIndex *byRemote;
+	HashIndex *byInterface;
+
+	void IndexLink(int i,int j,bool add);
+
 public:
 	Topology(int nodes);							//Constructor
 	~Topology();									//Destructor
@@ -83,18 +211,937 @@ public:
 	void PrintAdjMatrix();							//Print adj matrix
 	void PrintLoopbackArray();						//Print loopback array
 	void InitXmlStruct();							//Inizialization of xml structs
-	void SaveTopology();							//Export adj matrix in XML file
+	bool SaveTopology(u_int64_t seq);				//Export adj matrix in XML file, up to journal record seq
+	u_int64_t Generation();							//Full checkpoint loaded or last written
 	void LoadTopology(struct xmlRoot2* xmlTopology);//Load imported topology
 	struct topologyLink ** Matrix();				//Return pointer to adj matrix
 	struct loopback * LoopArray();					//Return pointer to loopback array
 	bool UpdateTopology(int *path,int len,int c);	//Update used capacity
+	void Lock();									//Lock the topology
+	void Unlock();									//Unlock the topology
+	void SetLink(int i,int j,int capacity,const char *srcAddr,const char *dstAddr,
+			const char *srcIf,const char *dstIf);	//Change a link, NULL keeps the address
+	void SetIgpMetric(int i,int j,int metric);		//Change the IGP metric of a link
+	unsigned IgpVersion();							//Changes of links and metrics so far
+	unsigned Version();								//Changes of the matrix so far (topology locked)
+	void SetLoopback(int i,const char *addr);		//Change the loopback of a router
+	int NodeByLoopback(const char *addr);			//Router with the loopback, -1 if none
+	int LinkByAddress(const char *addr,bool remote);	//Link i*n+j with the local/remote address
+	int LinkByInterface(int node,const char *name);	//Link i*n+j leaving node on the interface
+	int Changes(struct linkDelta **d,struct loopDelta **lb,int *nlb);	//Links and loopbacks changed since the last call (topology locked)
+	void ApplyDelta(struct linkDelta *d,int count,struct loopDelta *lb,int nlb);	//Load values of a delta checkpoint
+	void Stage(struct linkDelta *d,int count,struct loopDelta *lb,int nlb);	//Copy values in the xml structs for SaveTopology
+};
+
+//LSP installed by the PCE, indexed by tunnel id
+enum lspState{
+	LSP_FREE,									//Entry not used
+	LSP_PENDING,								//Capacity reserved, configuration in progress
+	LSP_UP,										//Configured on the head-end
+	LSP_FAILED,									//Configuration failed, capacity released
+	LSP_REROUTING								//Link down, capacity released, new path being computed
+};
+
+struct lspEntry{
+	enum lspState state;
+	int src;
+	int dst;
+	int capacity;
+	int *path;
+	int size;
+	int tree;									//P2MP tree of a branch, -1 for a tunnel
+	int priority;								//Setup priority, 0 is the highest
+	int *slot;									//Position in the list of each link of the path
+	int gen;									//Changed by every reservation and release
+};
+
+//LSP crossing a link, as hop of its path
+struct linkUse{
+	int id;
+	int hop;
+};
+
+class Journal;
+
+class LspTable{
+
+private:
+
+	int n;
+	int size;
+	struct lspEntry *lsps;
+	struct linkUse **users;						//LSPs on each link i*n+j, PENDING or UP
+	int *nusers;
+	pthread_mutex_t mutex;
+	Journal *journal;
+
+	void Index(int id, bool add);
+
+public:
+	LspTable(int nodes);							//Constructor
+	~LspTable();									//Destructor
+	void Lock();									//Lock the table for Find/Size (before Topology::Lock)
+	void Unlock();									//Unlock the table
+	int Size();										//Highest tunnel id + 1
+	struct lspEntry * Find(int id);					//Entry of the tunnel (NULL if free)
+	void Add(int id,int src,int dst,int capacity,int *path,int len,int priority);
+	int Place(int id,int src,int dst,int capacity,int *path,int len,int priority,int tree);	//Add (table locked)
+	void SetState(int id, enum lspState state);
+	void Confirm(int id, int gen);					//Pending LSP up, if still at the reservation gen
+	void SetTree(int id, int tree);					//The LSP is a branch of a P2MP tree
+	void Unreserve(int id, Topology *net);			//Capacity given back for a reroute (table and topology locked)
+	int Resize(int id, int capacity, int *path, int len);	//New reservation (table and topology locked)
+	bool Release(int id, Topology *net, enum lspState state, int gen=-1);	//Give back the capacity
+	void Drop(int id, enum lspState state);			//Capacity already given back (table and topology locked)
+	struct linkUse * OnLink(int i, int j, int *count);	//LSPs on the link (table locked)
+	int Count(enum lspState state);
+	void SetJournal(Journal *j);					//Log the releases from now on
+	void Sync();									//Wait until the reservations are on disk
+};
+
+//Records of the reservation journal
+enum journalType{
+	JRN_RESERVE,								//Capacity reserved for a new LSP
+	JRN_RELEASE,								//Capacity of an LSP given back
+	JRN_SNAPSHOT,								//Start of the LSPs alive at a checkpoint
+	JRN_LSP										//LSP alive at the checkpoint, capacity in the file
+};
+
+struct journalRecord;
+
+/* Write-ahead log of the reservations on a libpdel logfile (mmap ring).
+ * Records are appended under the topology lock and flushed by a thread
+ * that syncs many of them at once. */
+class Journal{
+
+private:
+
+	struct logfile *lf;
+	u_int64_t seq;								//Last record appended
+	u_int64_t synced;							//Last record on disk
+	u_int32_t bytes;							//Data in the ring since the last compaction
+	bool stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t dirty;
+	pthread_cond_t durable;
+	pthread_t tid;
+
+	static void * Syncer(void *arg);
+	void Run();
+	u_int64_t Append(struct journalRecord *r, int len);
+
+public:
+	Journal(const char *path);						//Constructor
+	~Journal();										//Destructor
+	int Replay(Topology *net, LspTable *table, u_int64_t checkpoint);	//Return the next tunnel id
+	u_int64_t Reserve(int id, int src, int dst, int capacity, int *path, int len, int tree, int priority);
+	u_int64_t Release(int id, enum lspState state);
+	void Commit(u_int64_t s);						//Wait until record s is on disk
+	u_int64_t Seq();
+	bool Full();									//Checkpoint needed
+	void Compact(u_int64_t checkpoint);				//Drop the records contained in the checkpoint
+};
+
+/* Background checkpoints: the links changed since the last full snapshot
+ * are written to a delta file, or the whole topology when they are many */
+class Checkpointer{
+
+private:
+
+	Topology *net;
+	Journal *journal;
+	int n;
+	u_int64_t saved;							//Journal record of the last checkpoint
+	int *pos;									//Position of each link in delta (-1 = not there)
+	struct linkDelta *delta;
+	int count;
+	int *lpos;									//Position of each loopback in loops
+	struct loopDelta *loops;
+	int nloops;
+	bool stop;
+	bool request;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	pthread_t tid;
+
+	static void * Worker(void *arg);
+	void Run();
+	void Take();
+	bool WriteDelta(u_int64_t seq);
+
+public:
+	Checkpointer(Topology *t, Journal *j, int nodes, u_int64_t checkpoint);	//Constructor
+	~Checkpointer();								//Destructor, after a last checkpoint
+	void Request();									//Checkpoint now
+};
+
+//Paths computed without constraints, kept until a link they use changes
+struct cachedPath{
+	int *path;
+	int size;
+	unsigned int gen;							//Valid if equal to the generation of the cache
+};
+
+class PathCache{
+
+private:
+
+	int n;
+	struct cachedPath *paths;					//n*n, by src*n+dst
+	int **users;								//Pairs whose path uses each link
+	int *nusers;
+	unsigned int gen;
+	pthread_mutex_t mutex;
+
+public:
+	PathCache(int nodes);							//Constructor
+	~PathCache();									//Destructor
+	int * Get(int src, int dst, int *s);			//Copy of the path, NULL if not cached
+	void Put(int src, int dst, int *path, int s);
+	int Invalidate(int u, int v);					//Link u->v removed, return the paths dropped
+	void Clear();									//Link added, every path may be shorter
+};
+
+struct feedClient;
+
+typedef void feed_line_fn(char *line, void *arg);
+
+/* Lines from a file followed as it grows, or from the clients of a local
+ * socket ("unix:<path>"); comments (#) and empty lines are skipped */
+class FeedSource{
+
+private:
+
+	char *source;
+	const char *name;							//Feed, for the messages
+	feed_line_fn *fn;
+	void *arg;
+	bool ok;
+	int listenFd;
+	int fileFd;
+	off_t offset;
+	struct feedClient *clients;
+
+	bool Open();
+	void ReadFile();
+	void ReadClient(int k);
+	void Lines(char *buf, int *len);
+
+public:
+	FeedSource(const char *src, const char *what, feed_line_fn *f, void *a);	//Constructor
+	~FeedSource();									//Destructor
+	bool Ok();										//Source opened
+	void Poll(int wait);							//Lines arrived within wait milliseconds
+};
+
+struct pendingLink;
+class ContractionHierarchy;
+class FastReroute;
+
+//Counters of the link-state feed
+struct feedStats{
+	int received;
+	int coalesced;								//Updates replaced by a later one in the same batch
+	int rejected;
+	int batches;
+	int invalidated;							//Cached paths dropped
+};
+
+/* Link-state updates read from a file (followed as it grows) or from a
+ * local socket, one per line:
+ *   link <i> <j> up <capacity> [<srcAddr> <dstAddr> <srcIf> <dstIf>]
+ *   link <i> <j> down
+ *   link <i> <j> bw <capacity>
+ *   node <i> <loopback>
+ *   node <i> down
+ * and applied to the topology in batches. Routers are given by index or
+ * loopback; "iface <i> <srcIf>" can take the place of "link <i> <j>". A
+ * router down takes down all its links, in both directions. */
+class LinkStateFeed{
+
+private:
+
+	Topology *net;
+	PathCache *cache;
+	ContractionHierarchy *hierarchy;
+	FastReroute *frr;							//Tunnels on the links that go down
+	int n;
+	FeedSource *input;
+	bool stop;
+	pthread_t tid;
+	struct pendingLink *pending;				//n*n, by i*n+j
+	int *touched;								//Links with a pending update
+	int ntouched;
+	char **pendingLoop;							//Pending loopback of each node
+	int nnodes;
+	struct timespec first;						//Arrival of the oldest pending update
+	struct feedStats stats;
+	pthread_mutex_t mutex;
+
+	static void * Worker(void *arg);
+	static void Line(char *line, void *arg);
+	void Run();
+	void Parse(char *line);
+	void Apply();
+
+public:
+	LinkStateFeed(Topology *t, PathCache *pc, ContractionHierarchy *ch, FastReroute *fr, int nodes,
+			const char *src);							//Constructor
+	~LinkStateFeed();								//Destructor
+	void Stats(struct feedStats *st);
+};
+
+//Apply the delta checkpoint newer than the topology file, return its journal record
+u_int64_t LoadDelta(Topology *net, u_int64_t seq);
+
+//Router given by index or loopback address, -1 if unknown (topology locked)
+int ParseNode(Topology *net,int nodes,const char *s);
+
+//Publish <file>.tmp as file, once it is on disk
+bool ReplaceFile(FILE *tmp, const char *file);
+
+//Prompt of the router CLI, used as state of a telnet session
+enum cliMode{
+	CLI_DISCONNECTED,
+	CLI_USERNAME_PROMPT,
+	CLI_PASSWORD_PROMPT,
+	CLI_EXEC,									//R#
+	CLI_CONFIG,									//R(config)#
+	CLI_CONFIG_IF,								//R(config-if)#
+	CLI_CONFIG_ROUTER,							//R(config-router)#
+	CLI_EXPL_PATH,								//R(cfg-ip-expl-path)#
+	CLI_DEST_LIST								//R(cfg-dest-list)#
+};
+
+//Pending configuration of a tunnel on its head-end router
+enum provOpType{
+	OP_TUNNEL,									//Create or update tunnel and explicit path
+	OP_REMOVE,									//Delete tunnel and explicit path
+	OP_P2MP_LEAF,								//Explicit path of a leaf in the destination list
+	OP_P2MP										//P2MP tunnel on the destination list
+};
+
+struct provOp{
+	enum provOpType type;
+	int id;										//Tunnel id
+	int src;									//Head-end router
+	int capacity;
+	bool replace;								//Explicit path may already exist
+	char *dest;
+	char **hops;								//next-address of the explicit path
+	int nhops;
+	int branch;									//LSP of the leaf (OP_P2MP_LEAF)
+	int priority;								//Setup and hold priority of the tunnel
+	bool segments;								//hops are the SIDs of a segment routing path
+	int gen;									//Reservation of the LSP configured, -1 if none
+	struct provOp *next;
+};
+
+struct cliSession{
+	int fd;
+	enum cliMode mode;
+	pthread_mutex_t mutex;
+	char *output;								//Output of the last command
+	int len;
+	int size;
+	unsigned char iac[3];						//Telnet command split between two reads
+	int niac;
+	bool sb;									//Inside a telnet subnegotiation
+	char host[CHAR_HOSTNAME];					//Hostname in the prompt, learned at login
+};
+
+class SessionPool{
+
+private:
+
+	int n;
+	int mockPort;
+	struct cliSession *sessions;
+	struct loopback *loopbackArray;
+
+	bool Open(int node);
+	void Close(int node);
+	bool ReadPrompt(int node);
+	bool Send(int node, const char *cmd, enum cliMode expect, bool strict=true);
+	bool RunTunnel(int src, struct provOp *op);
+	bool RunRemove(int src, struct provOp *op);
+	bool RunP2mpLeaf(int src, struct provOp *op);
+	bool RunP2mp(int src, struct provOp *op);
+	bool RunBatch(int src, struct provOp *ops);
+	bool RunNet(int node, struct topologyLink **net);
+
+public:
+	SessionPool(struct loopback *loopArray, int nodes);	//Constructor
+	~SessionPool();									//Destructor
+	bool ConfigureBatch(int src, struct provOp *ops);
+	bool ConfigureNet(int node, struct topologyLink **net);
+	bool ShowRunningConfig(int node, char **out, int *len);
 };
 
 //Import topology from XML file
 void ImportTopology(struct xmlRoot2* xmlTopology);
+void ImportTopologyFile(struct xmlRoot2* xmlTopology, const char *file);
 
 int* find_path(struct topologyLink **net, int nodes, int src, int dest, int c,int *s);
+bool fits(struct topologyLink **m, int *path, int len, int c);	//Residual capacity c on all the links
 int* find_path_unconstrained(struct topologyLink ** net, int nodes, int src, int dest, int *s);
 
+//Objective of the path with enough residual capacity
+enum pathMode{
+	PATH_SHORTEST,
+	PATH_WIDEST,
+	PATH_SHORTEST_WIDEST,
+	PATH_MIN_UTIL
+};
+
+int* find_path_mode(struct topologyLink ** net, int nodes, int src, int dest, int c, enum pathMode mode, int *s);
+const char * pathModeName(enum pathMode mode);
+enum pathMode pathModeByName(const char *name);
+
+//Least TE metric path with residual capacity c and delay at most maxDelay microseconds
+int* find_path_delay(struct topologyLink **net, int nodes, int src, int dest, int c, int maxDelay, int *s);
+
+/* Contraction hierarchy of the topology for the paths without constraints.
+ * The order of the routers and the shortcuts depend only on the links (Build,
+ * routers contracted in parallel); the weights are computed again from the
+ * matrix by Customize, so a link down, up again or with a new metric does not
+ * need a new order. Called with the topology locked. */
+class ContractionHierarchy{
+
+private:
+
+	int n;
+	int *rank;									//Order of contraction
+	int *order;									//Router of each rank
+	int *parent;								//Elimination tree: lowest upper neighbour
+	int *depth;
+	int *first;									//Upper neighbours of v: head[first[v]..first[v+1]-1]
+	int *head;
+	int *up;									//Weight of v->head
+	int *down;									//Weight of head->v
+	int *midUp;									//Router skipped by the shortcut, -1 for a link
+	int *midDown;
+
+	void Free();
+	int Arc(int v, int u);
+	void Unpack(int a, int b, int **path, int *size);
+
+public:
+	ContractionHierarchy(int nodes);				//Constructor
+	~ContractionHierarchy();						//Destructor
+	void Build(struct topologyLink **net);			//Order, shortcuts and weights
+	bool Customize(struct topologyLink **net);		//Weights only, false if a link is not in the order
+	int * Query(int src, int dest, int *s);			//Like find_path_unconstrained
+};
+
+/* P2MP tree from a root (shortest path heuristic): every leaf is joined to
+ * the nearest router of the tree on links with residual capacity c. Called
+ * with the topology locked. */
+class SteinerTree{
+
+private:
+
+	struct topologyLink **net;
+	int n;
+	int src;
+	int c;
+	int *parent;								//Router before v in the tree, -1 for the root
+	bool *inTree;
+	int *dist;									//Hops from the tree
+	int *prev;
+	bool *open;									//Distance lowered, neighbours to visit
+	bool stale;
+
+	void Relax();
+	void Join(int *path, int size);
+
+public:
+	SteinerTree(struct topologyLink **m, int nodes, int root, int capacity);	//Constructor
+	~SteinerTree();													//Destructor
+	bool AddBranch(int *path, int size);		//Branch already reserved, false if path[0] is not in the tree
+	int Nearest(int *leaves, int count);		//Index of the nearest leaf, -1 if none
+	int * Attach(int leaf, int *s);				//New branch from the tree to the leaf
+	int * PathTo(int leaf, int *s);				//Routers from the root to the leaf
+};
+
+//Node of the segment tree of a link: "add" covers all its seconds
+struct calendarNode{
+	int add;
+	int peak;									//Highest booking below the node
+	int left;
+	int right;
+};
+
+/* Capacity booked on the links for time windows, on top of the LSPs already
+ * installed (which hold their capacity for ever). Called with the topology
+ * locked. */
+class Calendar{
+
+private:
+
+	int n;
+	time_t base;								//Second 0 of the trees
+	int bookings;
+	struct calendarNode **pool;					//Nodes of the tree of each link i*n+j
+	int *count;
+
+	int NewNode(int link);
+	int64_t Offset(time_t t);
+	void Add(int link, int v, int64_t lo, int64_t hi, int64_t s, int64_t e, int c);
+	int Query(int link, int v, int64_t lo, int64_t hi, int64_t s, int64_t e);
+
+public:
+	Calendar(int nodes);							//Constructor
+	~Calendar();									//Destructor
+	int Peak(int i, int j, time_t start, time_t end);	//Highest booking on i->j in [start,end)
+	void Book(int *path, int len, int c, time_t start, time_t end);
+	int Bookings();
+	struct topologyLink ** Residual(struct topologyLink **net, time_t start, time_t end);	//NULL if no bookings
+	struct topologyLink ** Copy(struct topologyLink **net, time_t start, time_t end);		//Residual, always copied
+	void FreeResidual(struct topologyLink **m);
+};
+
+//Link between the border routers of two domains
+struct borderLink{
+	int srcDomain;
+	int src;
+	int dstDomain;
+	int dst;
+	int capacity;
+	int used;
+	char *srcAddr;
+	char *dstAddr;
+};
+
+//Domains file: topology files of the other domains and border links
+struct domainsRoot{
+	struct structs_array files;
+	struct structs_array links;
+};
+
+//Router of an inter-domain path
+struct domainHop{
+	int domain;
+	int node;
+};
+
+/* Topologies of many domains side by side, domain 0 is the one of the PCE.
+ * Paths across them are computed with BRPC, the segments inside the
+ * domains in parallel. */
+class DomainSet{
+
+private:
+
+	int count;
+	Topology **nets;
+	int *nodes;
+	struct domainsRoot root;
+	bool loaded;
+	pthread_mutex_t mutex;
+
+	bool Usable(struct borderLink *b, int c);
+	int * Sequence(int from, int to, int c, int *len);
+
+public:
+	DomainSet(Topology *net, int n);				//Constructor
+	~DomainSet();									//Destructor
+	bool Load(const char *file);					//Other domains and border links
+	int Count();
+	int Nodes(int domain);
+	struct domainHop * FindPath(int srcDomain, int src, int dstDomain, int dst, int c, int *s);
+};
+
+class ProvisionQueue{
+
+private:
+
+	int n;
+	struct provOp **pending;					//Operations of each head-end, in arrival order
+	int count;
+	pthread_mutex_t mutex;
+
+public:
+	ProvisionQueue(int nodes);						//Constructor
+	~ProvisionQueue();								//Destructor
+	void Push(struct provOp *op);					//Queue an operation
+	void AddTunnel(int src, char *dest, int cap, int id, char **hops, int nhops, bool replace);
+	void RemoveTunnel(int src, int id);
+	int Pending();									//Number of queued operations
+	struct provOp * Take(int src);					//Detach the operations of a head-end
+	int Flush(SessionPool *pool);					//Configure all head-ends, return failures
+};
+
+struct provOp * NewProvOp(enum provOpType type, int src, int id, char *dest, int cap,
+		char **hops, int nhops, bool replace);
+void FreeProvOps(struct provOp *ops);
+
+//Counters of the provisioning pipeline
+struct pipelineStats{
+	int depth;									//Operations queued or in progress
+	int maxLane;								//Longest lane queue
+	int submitted;
+	int completed;
+	int failed;
+	int retries;
+};
+
+struct pipelineLane;
+
+/* Provisioning decoupled from path computation: operations are queued on
+ * the lane of their head-end and sent by its worker thread, with retries */
+class ProvisionPipeline{
+
+private:
+
+	int n;
+	struct pipelineLane *lane;						//One per head-end
+	SessionPool *pool;
+	Topology *net;
+	LspTable *table;
+	struct pipelineStats stats;
+	pthread_mutex_t mutex;
+	pthread_cond_t space;
+
+	static void * Worker(void *arg);
+	void Run(struct pipelineLane *l);
+	void Complete(struct provOp *ops, bool ok, int attempts);
+
+public:
+	ProvisionPipeline(SessionPool *sp, Topology *t, LspTable *lt, int nodes);	//Constructor
+	~ProvisionPipeline();							//Destructor
+	void Submit(struct provOp *op);					//Queue, blocks while the pipeline is full
+	void Stats(struct pipelineStats *st);
+};
+
+//Counters of the segment routing paths
+struct srStats{
+	int encoded;
+	int sids;
+	int hops;									//Hops of the paths encoded
+	int tooDeep;								//More SIDs than the max SID depth, sent as RSVP
+};
+
+//Explicit paths encoded as SID lists for the IGP shortest paths with ECMP
+class SegmentRouting{
+
+private:
+
+	int n;
+	int msd;									//Max SID depth of the head-ends
+	bool built;
+	unsigned version;							//IgpVersion of the topology when built
+	int *dist;									//dist[s*n+v]: IGP distance from s to v
+	char *paths;								//Shortest paths from s to v: 1, or 2 for more
+	struct srStats stats;
+
+	void Build(struct topologyLink **net);
+
+public:
+	SegmentRouting(int nodes, int depth);			//Constructor
+	~SegmentRouting();								//Destructor
+	int Encode(Topology *net, int *path, int len, char **hops);	//SIDs of the path, -1 if too many
+	void Stats(struct srStats *st);					//Topology locked
+};
+
+int TunnelHops(Topology *net, SegmentRouting *sr, int *path, int len, char **hops, bool *segments);
+int linkIgpMetric(struct topologyLink *l);		//IGP metric of a link, the TE metric if not set
+
+//State of a path request
+enum schedStatus{
+	SCHED_QUEUED,
+	SCHED_RUNNING,
+	SCHED_DONE,
+	SCHED_NO_PATH,
+	SCHED_EXPIRED								//Deadline passed before it was computed
+};
+
+//Counters of the path requests
+struct schedStats{
+	int submitted;
+	int merged;									//Joined to an identical request
+	int shed;									//Dropped after their deadline
+	int computed;
+	int batches;
+	int queued;									//Waiting now
+};
+
+struct pathRequest;
+struct matrixCopy;
+
+/* Path computations asked by many clients at once: identical requests are
+ * computed once, the others are served by priority and nearest deadline */
+class PathScheduler{
+
+private:
+
+	Topology *net;
+	Calendar *calendar;
+	int n;
+	enum pathMode mode;
+	struct pathRequest **slots;					//Requests not yet collected by all their clients
+	int size;
+	int *freeSlots;
+	int nfree;
+	int *heap;									//Queued requests (slots), first to compute on top
+	int queued;
+	u_int64_t seq;
+	HashIndex *inFlight;						//Queued or running requests by (src,dst,capacity)
+	struct matrixCopy *current;					//Read-only copy of the last version of the matrix
+	struct schedStats stats;
+	bool stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t *tids;
+	int nworkers;
+
+	static void * Worker(void *arg);
+	void Run();
+	bool Before(struct pathRequest *a, struct pathRequest *b);
+	void Place(int pos, int slot);
+	void SiftUp(int pos);
+	struct pathRequest * Pop();
+	void Finish(struct pathRequest *r, enum schedStatus status);
+	struct matrixCopy * Acquire();
+	void Release(struct matrixCopy *c);
+
+public:
+	PathScheduler(Topology *t, Calendar *cal, int nodes, enum pathMode m, int workers);	//Constructor
+	~PathScheduler();								//Destructor
+	struct pathRequest * Submit(int src, int dst, int capacity, int priority, int deadline);
+	int * Wait(struct pathRequest *r, int *s, enum schedStatus *status);	//Once per Submit
+	void Stats(struct schedStats *st);
+};
+
+//Counters of the reroutes after a failure
+struct frrStats{
+	int events;									//Failures handled
+	int affected;								//Tunnels on the failed links
+	int rerouted;
+	int failed;									//No path left, given up
+	int branches;								//P2MP branches failed, on the links or hanging from them
+	int lastMs;									//Compute time of the last failure
+};
+
+/* Reroute of the tunnels crossing links that went down: their capacity is
+ * given back, the new paths are computed in parallel by the scheduler on
+ * the topology after the failure (highest priority and largest tunnels
+ * first) and reserved in the same order, each one checked against the
+ * capacity taken by those before it */
+class FastReroute{
+
+private:
+
+	Topology *net;
+	LspTable *table;
+	Calendar *calendar;
+	PathScheduler *scheduler;
+	ProvisionPipeline *pipeline;				//NULL in demo mode
+	ProvisionQueue *queue;						//Also NULL: nothing is provisioned (trace replay)
+	SegmentRouting *segments;					//NULL: RSVP explicit paths
+	int n;
+	enum pathMode mode;
+	struct frrStats stats;
+	pthread_mutex_t mutex;
+
+public:
+	FastReroute(Topology *t, LspTable *lt, Calendar *cal, PathScheduler *ps, ProvisionPipeline *p,
+			ProvisionQueue *q, SegmentRouting *sr, int nodes, enum pathMode m);	//Constructor
+	~FastReroute();									//Destructor
+	int LinksDown(int *links, int count);			//Links i*n+j already down, returns rerouted
+	void Stats(struct frrStats *st);
+};
+
+//Counters of auto-bandwidth
+struct autobwStats{
+	int samples;
+	int rejected;
+	int intervals;
+	int resized;
+	int rerouted;								//Resized on a new path
+	int failed;									//No path with the new bandwidth, left as it was
+};
+
+/* Resize of the tunnels from the rate samples read from a file or a local
+ * socket, one per line:
+ *   rate <tunnel> <rate>
+ * The highest sample of every interval is the new bandwidth. */
+class AutoBandwidth{
+
+private:
+
+	Topology *net;
+	LspTable *table;
+	Calendar *calendar;
+	ProvisionPipeline *pipeline;				//NULL in demo mode
+	ProvisionQueue *queue;
+	SegmentRouting *segments;					//NULL: RSVP explicit paths
+	int n;
+	enum pathMode mode;
+	FeedSource *input;
+	bool stop;
+	pthread_t tid;
+	int *peak;									//Highest sample of each tunnel, -1 if none
+	int size;
+	struct timespec start;						//Start of the interval
+	struct autobwStats stats;
+	pthread_mutex_t mutex;
+
+	static void * Worker(void *arg);
+	static void Line(char *line, void *arg);
+	void Run();
+	void Parse(char *line);
+	void Adjust();
+
+public:
+	AutoBandwidth(Topology *t, LspTable *lt, Calendar *cal, ProvisionPipeline *p, ProvisionQueue *q,
+			SegmentRouting *sr, int nodes, enum pathMode m, const char *src);	//Constructor
+	~AutoBandwidth();								//Destructor
+	void Stats(struct autobwStats *st);
+};
+
+//Demand of a traffic matrix
+struct tmDemand{
+	int src;
+	int dst;
+	double rate;								//Same unit as the capacity
+};
+
+struct tmDemand * ReadTrafficMatrix(const char *file, int nodes, int *count);
+
+struct metricCandidate;
+
+/* IGP metrics that lower the highest link utilization of a traffic matrix
+ * routed on the shortest paths with ECMP, found with a local search */
+class MetricOptimizer{
+
+private:
+
+	int n;
+	int m;										//Links
+	int *lsrc;
+	int *ldst;
+	double *cap;
+	int *w;										//Metric of every link
+	int *firstIn;								//Links entering router v: in[firstIn[v]..firstIn[v+1])
+	int *in;
+	int *firstOut;
+	int *out;
+	double *demand;								//n*n, src*n+dst
+	int *dist;									//Distance of every router from each destination
+	double *load;								//Load of every link from the demands of each destination
+	double *total;								//Load of every link
+	struct metricCandidate *cand;
+
+	void Route(int t, int c, int cw, int *d, double *ld);
+	bool Affected(int t, int k, int weight);
+	void Utilization(double *tot, double *maxUtil, double *sumUtil);
+	static bool Evaluate(int c, void *arg);
+	void Apply(int k, int weight);
+
+public:
+	MetricOptimizer(struct topologyLink **net, int nodes, struct tmDemand *d, int count);	//Constructor
+	~MetricOptimizer();								//Destructor
+	double Run(int steps);							//Search, returns the highest utilization
+	double MaxUtil();
+	void Metrics(int *metric);						//Metric of every link, i*n+j
+};
+
+//Compare the tunnels on the routers with the LSP table and queue the corrections
+void Reconcile(Topology *net, int nodes, LspTable *table, SessionPool *pool, ProvisionPipeline *pipeline,
+		SegmentRouting *sr);
+
+//Same operation on all the routers, executed concurrently
+typedef bool (fanout_fn)(int node, void *arg);
+int FanOut(int nodes, int parallel, fanout_fn *fn, void *arg, const char *what, bool *result);
+
+//First member of the structs of a ThreadSlots pool
+struct threadSlot{
+	int busy;									//Owned by a running thread
+	struct threadSlot *next;
+};
+
+//Structs owned by one thread each, reused after the thread ends (lock free)
+class ThreadSlots{
+
+private:
+
+	size_t size;
+	struct threadSlot *slots;
+	pthread_key_t owner;
+
+	static void Release(void *s);
+
+public:
+	ThreadSlots(size_t bytes);						//Constructor
+	struct threadSlot * Take();						//Struct for the calling thread
+	struct threadSlot * First();					//List of all the structs
+};
+
+//Counters of the PCE, one shard per thread summed by the metrics server
+enum statCounter{
+	STAT_LSP_REQUESTS,
+	STAT_LSP_ADMITTED,
+	STAT_PATHS,
+	STAT_PATHS_NONE,
+	STAT_PROV_OPS,
+	STAT_PROV_FAILED,
+	STAT_FEED_LINES,
+	STAT_COUNTERS
+};
+
+int64_t StatClock();								//Microseconds of CLOCK_MONOTONIC
+int elapsed(struct timespec *from);				//Milliseconds of CLOCK_MONOTONIC since from
+void StatAdd(enum statCounter c, int v);
+void StatPath(int64_t start, bool found);		//Path computed from start to now
+
+struct pevent_ctx;
+struct pevent;
+struct http_server;
+struct http_servlet;
+struct http_request;
+struct http_response;
+
+/* Prometheus metrics on /metrics, served by the libpdel HTTP server: the
+ * counters of the shards, path latency quantiles, LSPs, queues, link
+ * utilization, typed memory and lag of the event loop */
+class MetricsServer{
+
+private:
+
+	Topology *net;
+	LspTable *table;
+	PathScheduler *scheduler;
+	ProvisionPipeline *pipeline;				//NULL in demo mode
+	ProvisionQueue *queue;
+	int n;
+	struct pevent_ctx *ctx;
+	struct http_server *server;
+	struct http_servlet *servlet;
+	struct pevent *tick;
+	struct timespec last;						//Last run of the timer
+	int64_t lag;								//Microseconds
+	int64_t maxLag;								//Since the last scrape
+	pthread_mutex_t mutex;
+
+	static int Serve(struct http_servlet *s, struct http_request *req, struct http_response *resp);
+	static void Destroy(struct http_servlet *s);
+	static void Tick(void *arg);
+	void Write(FILE *fp);
+
+public:
+	MetricsServer(Topology *t, LspTable *lt, PathScheduler *ps, ProvisionPipeline *p, ProvisionQueue *q,
+			int nodes, int port);						//Constructor
+	~MetricsServer();								//Destructor
+	bool Ok();										//Listening
+};
+
+//Spans of the work of the PCE, written as a Chrome trace
+void TraceEnable(bool on);
+bool TraceOn();
+int64_t TraceBegin();							//0 while tracing is off
+void TraceEnd(const char *cat, const char *name, int64_t start, int arg);	//arg -1: none
+int TraceDump(const char *file);				//Spans written, -1 on error
+
 void showConfigureNet(struct loopback* loopArray, struct topologyLink** net, int i);
-void showConfigureLSP(int src, char* loopAddr1, char* loopAddr2, char*cap, char*id,int size,struct topologyLink **net);
+void showConfigureBatch(int src, struct provOp *ops);
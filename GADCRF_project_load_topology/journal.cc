@@ -0,0 +1,391 @@
+/*
+ * journal.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Write-ahead journal of the bandwidth reservations. Every
+ * 				reservation and release is appended as a binary record to a
+ * 				libpdel logfile (memory mapped ring); a thread syncs the ring
+ * 				to disk for all the records appended in the last milliseconds.
+ * 				At startup the records newer than the checkpoint (the topology
+ * 				XML file and its delta) are applied again to the topology and
+ * 				the LSP table.
+ */
+
+#include "header_project.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC 0x50434532
+#define LOGFILE_MAGIC 0x476ea198				//Header of a libpdel logfile
+
+struct journalRecord{
+	u_int32_t magic;
+	u_int16_t type;								//enum journalType
+	u_int16_t state;							//State of the LSP after a release, priority of a reservation
+	u_int64_t seq;
+	int32_t id;									//Tunnel id, records that follow a snapshot
+	int32_t src;
+	int32_t dst;
+	int32_t capacity;
+	int32_t size;								//Nodes of the path
+	int32_t tree;								//P2MP tree of a branch, -1 for a tunnel
+	int32_t path[];
+};
+
+#define RECORD_LEN(size) ((int)(sizeof(struct journalRecord)+(size)*sizeof(int32_t)))
+
+//Copy of a record read from the ring, the ring may be overwritten
+static struct journalRecord * readRecord(struct logfile *lf, int which){
+
+	const struct journalRecord *r;
+	struct journalRecord *c;
+	int len;
+
+	r = (const struct journalRecord*) logfile_get(lf,which,&len);
+	if(r==NULL || len<RECORD_LEN(0) || r->magic!=JOURNAL_MAGIC || r->size<0 || len!=RECORD_LEN(r->size))
+		return NULL;
+	c = (struct journalRecord*) malloc(len);
+	memcpy(c,r,len);
+	return c;
+}
+
+/* libpdel extends a new logfile with lseek(fd, SEEK_SET, len - 1), arguments
+ * swapped, so on Linux the file stays short and the mapping faults. A new
+ * journal is created here with its final size and an empty logfile header
+ * (magic, maxent, maxdata, num, next), then opened as an existing one. */
+static bool createJournal(const char *path){
+
+	u_int32_t head[5] = {LOGFILE_MAGIC,JOURNAL_ENTRIES,JOURNAL_DATA,0,0};
+	struct stat sb;
+	bool ok = true;
+	int fd;
+
+	if((fd=open(path,O_CREAT|O_RDWR,0644))==-1)
+		return false;
+	if(fstat(fd,&sb)==-1)
+		ok = false;
+	else if(sb.st_size==0){
+		ok = ftruncate(fd,sizeof(head)+JOURNAL_ENTRIES*2*sizeof(u_int32_t)+JOURNAL_DATA)==0
+				&& write(fd,head,sizeof(head))==sizeof(head) && fsync(fd)==0;
+	}
+	close(fd);
+	return ok;
+}
+
+/******************* BEGIN JOURNAL CLASS METHODS *******************************/
+
+//Constructor
+Journal::Journal(const char *path){
+
+	seq = 0;
+	synced = 0;
+	bytes = 0;
+	stop = false;
+	pthread_mutex_init(&mutex,NULL);
+	pthread_cond_init(&dirty,NULL);
+	pthread_cond_init(&durable,NULL);
+	lf = NULL;
+	if(!createJournal(path) || (lf=logfile_open(path,0,JOURNAL_ENTRIES,JOURNAL_DATA))==NULL)
+		printf("Error opening journal %s: %s\n",path,strerror(errno));
+	else
+		pthread_create(&tid,NULL,Syncer,this);
+}
+
+//Destructor: the records still in memory are synced before closing
+Journal::~Journal(){
+
+	if(lf!=NULL){
+		pthread_mutex_lock(&mutex);
+		stop = true;
+		pthread_cond_signal(&dirty);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(tid,NULL);
+		logfile_close(&lf);
+	}
+	pthread_cond_destroy(&durable);
+	pthread_cond_destroy(&dirty);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * Journal::Syncer(void *arg){
+
+	((Journal*) arg)->Run();
+	return NULL;
+}
+
+/* Group commit: after the first record the thread waits JOURNAL_COMMIT
+ * milliseconds, then a single msync covers everything appended meanwhile */
+void Journal::Run(){
+
+	u_int64_t target;
+	int64_t span;
+
+	pthread_mutex_lock(&mutex);
+	while(!stop || synced<seq){
+		if(synced==seq){
+			pthread_cond_wait(&dirty,&mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&mutex);
+		usleep(JOURNAL_COMMIT*1000);
+		pthread_mutex_lock(&mutex);
+		target = seq;
+		pthread_mutex_unlock(&mutex);
+		span = TraceBegin();
+		logfile_sync(lf);
+		TraceEnd("journal","sync",span,-1);
+		pthread_mutex_lock(&mutex);
+		synced = target;
+		pthread_cond_broadcast(&durable);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+//Called with the mutex held
+u_int64_t Journal::Append(struct journalRecord *r, int len){
+
+	r->magic = JOURNAL_MAGIC;
+	if(r->type==JRN_RESERVE || r->type==JRN_RELEASE)
+		r->seq = ++seq;
+	if(logfile_put(lf,r,len)==-1){
+		printf("Error writing journal: %s\n",strerror(errno));
+		return 0;
+	}
+	bytes+=len;
+	pthread_cond_signal(&dirty);
+	return r->seq;
+}
+
+//Called with the topology locked, so the record order is the order of the updates
+u_int64_t Journal::Reserve(int id, int src, int dst, int capacity, int *path, int len, int tree, int priority){
+
+	struct journalRecord *r;
+	u_int64_t s;
+	int i;
+
+	if(lf==NULL)
+		return 0;
+	r = (struct journalRecord*) calloc(1,RECORD_LEN(len));
+	r->type = JRN_RESERVE;
+	r->state = priority;
+	r->id = id;
+	r->src = src;
+	r->dst = dst;
+	r->capacity = capacity;
+	r->size = len;
+	r->tree = tree;
+	for(i=0;i<len;i++)
+		r->path[i] = path[i];
+	pthread_mutex_lock(&mutex);
+	s = Append(r,RECORD_LEN(len));
+	pthread_mutex_unlock(&mutex);
+	free(r);
+	return s;
+}
+
+u_int64_t Journal::Release(int id, enum lspState state){
+
+	struct journalRecord r;
+	u_int64_t s;
+
+	if(lf==NULL)
+		return 0;
+	memset(&r,0,sizeof(r));
+	r.type = JRN_RELEASE;
+	r.state = state;
+	r.id = id;
+	pthread_mutex_lock(&mutex);
+	s = Append(&r,RECORD_LEN(0));
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+void Journal::Commit(u_int64_t s){
+
+	if(lf==NULL)
+		return;
+	pthread_mutex_lock(&mutex);
+	while(synced<s)
+		pthread_cond_wait(&durable,&mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+u_int64_t Journal::Seq(){
+
+	u_int64_t s;
+	pthread_mutex_lock(&mutex);
+	s = seq;
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+bool Journal::Full(){
+
+	bool full;
+
+	if(lf==NULL)
+		return false;
+	pthread_mutex_lock(&mutex);
+	full = bytes>JOURNAL_DATA/2 || logfile_num_entries(lf)>JOURNAL_ENTRIES/2;
+	pthread_mutex_unlock(&mutex);
+	return full;
+}
+
+/* Records to read: from the last complete snapshot (or the oldest record)
+ * to the next snapshot, that was interrupted by a crash while written */
+static void journalRange(struct logfile *lf, int *start, int *end){
+
+	struct journalRecord *r;
+	int i,num;
+
+	num = logfile_num_entries(lf);
+	*start = -num;
+	*end = 0;
+	for(i=-num;i<0;i++){
+		if((r=readRecord(lf,i))==NULL)
+			continue;
+		if(r->type==JRN_SNAPSHOT && -i>r->id)
+			*start = i;
+		free(r);
+	}
+	for(i=*start+1;i<0 && *end==0;i++){
+		if((r=readRecord(lf,i))==NULL)
+			continue;
+		if(r->type==JRN_SNAPSHOT)
+			*end = i;
+		free(r);
+	}
+}
+
+/* Rebuild the LSP table from the journal and give back to the topology the
+ * reservations made after the checkpoint. A record is applied to the
+ * capacity only once, even if a compaction copied it twice. */
+int Journal::Replay(Topology *net, LspTable *table, u_int64_t checkpoint){
+
+	struct journalRecord *r;
+	u_int64_t last = checkpoint;
+	int i,start,end,maxId = -1,records = 0;
+
+	if(lf==NULL)
+		return 0;
+	journalRange(lf,&start,&end);
+	bytes = 0;
+	for(i=start;i<end;i++){
+		if((r=readRecord(lf,i))==NULL)
+			continue;
+		records++;
+		bytes+=RECORD_LEN(r->size);
+		switch(r->type){
+		case JRN_RESERVE:
+		case JRN_LSP:
+			table->Add(r->id,r->src,r->dst,r->capacity,r->path,r->size,r->state);
+			table->SetTree(r->id,r->tree);
+			table->SetState(r->id,LSP_UP);
+			if(r->type==JRN_RESERVE && r->seq>last){
+				net->UpdateTopology(r->path,r->size,r->capacity);
+				last = r->seq;
+			}
+			if(r->id>maxId)
+				maxId = r->id;
+			break;
+		case JRN_RELEASE:
+			if(r->seq>last){
+				table->Release(r->id,net,(enum lspState) r->state);
+				last = r->seq;
+			}
+			else
+				table->SetState(r->id,(enum lspState) r->state);
+			break;
+		}
+		if(r->seq>seq)
+			seq = r->seq;
+		free(r);
+	}
+	if(checkpoint>seq)
+		seq = checkpoint;
+	synced = seq;
+	printf("Journal: %d records replayed, %d LSPs up\n",records,table->Count(LSP_UP));
+	//The interrupted snapshot is followed by a complete one before new records are appended
+	if(end<0)
+		Compact(checkpoint);
+	return maxId+1;
+}
+
+/* Replace the records up to the checkpoint with the LSPs still alive.
+ * The snapshot and the newer records are written after the old ones and
+ * synced before the old ones are dropped, so a crash leaves a valid ring. */
+void Journal::Compact(u_int64_t checkpoint){
+
+	struct journalRecord **live = NULL,**tail = NULL,*r,snap;
+	int i,start,end,nlive = 0,ntail = 0,size = 0,kept,len = 0;
+
+	if(lf==NULL)
+		return;
+	pthread_mutex_lock(&mutex);
+	journalRange(lf,&start,&end);
+	for(i=start;i<end;i++){
+		if((r=readRecord(lf,i))==NULL)
+			continue;
+		if(r->type==JRN_SNAPSHOT){
+			free(r);
+			continue;
+		}
+		if(r->seq>checkpoint && r->type!=JRN_LSP){
+			tail = (struct journalRecord**) realloc(tail,(ntail+1)*sizeof(struct journalRecord*));
+			tail[ntail++] = r;
+			continue;
+		}
+		if(r->id>=size){
+			live = (struct journalRecord**) realloc(live,2*(r->id+1)*sizeof(struct journalRecord*));
+			memset(&live[size],0,(2*(r->id+1)-size)*sizeof(struct journalRecord*));
+			size = 2*(r->id+1);
+		}
+		free(live[r->id]);
+		live[r->id] = NULL;
+		if(r->type==JRN_RELEASE)
+			free(r);
+		else{
+			r->type = JRN_LSP;
+			live[r->id] = r;
+		}
+	}
+
+	for(i=0;i<size;i++)
+		if(live[i]!=NULL){
+			nlive++;
+			len+=RECORD_LEN(live[i]->size);
+		}
+	for(i=0;i<ntail;i++)
+		len+=RECORD_LEN(tail[i]->size);
+	kept = 1+nlive+ntail;
+
+	if(kept>JOURNAL_ENTRIES/2 || len>JOURNAL_DATA/2)
+		printf("Journal too small for %d LSPs, not compacted\n",nlive);
+	else{
+		memset(&snap,0,sizeof(snap));
+		snap.type = JRN_SNAPSHOT;
+		snap.seq = checkpoint;
+		snap.id = nlive+ntail;					//Records that follow the snapshot
+		snap.magic = JOURNAL_MAGIC;
+		logfile_put(lf,&snap,RECORD_LEN(0));
+		for(i=0;i<size;i++)
+			if(live[i]!=NULL)
+				logfile_put(lf,live[i],RECORD_LEN(live[i]->size));
+		for(i=0;i<ntail;i++)
+			logfile_put(lf,tail[i],RECORD_LEN(tail[i]->size));
+		logfile_sync(lf);
+		logfile_trim(lf,kept);
+		logfile_sync(lf);
+		bytes = len;
+	}
+
+	pthread_mutex_unlock(&mutex);
+	for(i=0;i<size;i++)
+		free(live[i]);
+	for(i=0;i<ntail;i++)
+		free(tail[i]);
+	free(live);
+	free(tail);
+}
+
+/******************* END JOURNAL CLASS METHODS *********************************/
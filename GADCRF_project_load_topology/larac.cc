@@ -0,0 +1,284 @@
+/*
+ * larac.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Least TE metric path with enough residual capacity and an
+ * 				end-to-end delay bound. LARAC searches the multiplier of the
+ * 				delay (metric + lambda*delay) with a few Dijkstra runs; when
+ * 				its path is not proven optimal, the paths are enumerated in
+ * 				order of that cost (Yen) until the Lagrangian bound closes
+ * 				the gap or DELAY_KPATHS paths have been seen.
+ */
+
+#include "header_project.h"
+
+#define LARAC_ITERATIONS 32
+#define LARAC_EPSILON 1e-9
+
+//Path with its metric, delay and cost for the current multiplier
+struct kPath{
+	int *path;
+	int size;
+	int metric;
+	int delay;
+	double cost;
+};
+
+//Links and routers excluded from a spur path of Yen
+struct pathFilter{
+	bool *removed;								//Routers of the root path
+	int *banned;								//Links i*n+j
+	int nbanned;
+};
+
+static int linkMetric(struct topologyLink *l){
+	return (l->metric>0)?l->metric:1;
+}
+
+static bool linkBanned(struct pathFilter *f, int link){
+
+	int k;
+
+	for(k=0;f!=NULL && k<f->nbanned;k++)
+		if(f->banned[k]==link)
+			return true;
+	return false;
+}
+
+static void measurePath(struct topologyLink **net, struct kPath *p, double lambda){
+
+	int i;
+
+	p->metric = 0;
+	p->delay = 0;
+	for(i=0;i<p->size-1;i++){
+		p->metric+=linkMetric(&net[p->path[i]][p->path[i+1]]);
+		p->delay+=net[p->path[i]][p->path[i+1]].delay;
+	}
+	p->cost = p->metric+lambda*p->delay;
+}
+
+/* Dijkstra on metric*a + delay*b over the links with at least c residual
+ * capacity, without the routers and links of the filter */
+static bool weightedPath(struct topologyLink **net, int n, int src, int dest, int c, double a,
+		double b, struct pathFilter *f, struct kPath *p){
+
+	double dist[n];
+	int prev[n];
+	bool sptSet[n];
+	int u,v,count;
+	double w;
+
+	for(v=0;v<n;v++){
+		dist[v] = -1;
+		prev[v] = -1;
+		sptSet[v] = (f!=NULL && f->removed[v]);
+	}
+	dist[src] = 0;
+	sptSet[src] = false;
+
+	for(count=0;count<n;count++){
+		u = -1;
+		for(v=0;v<n;v++)
+			if(!sptSet[v] && dist[v]>=0 && (u==-1 || dist[v]<dist[u]))
+				u = v;
+		if(u==-1 || u==dest)
+			break;
+		sptSet[u] = true;
+		for(v=0;v<n;v++){
+			if(sptSet[v] || net[u][v].capacity==-1 || net[u][v].capacity-net[u][v].used<c
+					|| linkBanned(f,u*n+v))
+				continue;
+			w = dist[u]+a*linkMetric(&net[u][v])+b*net[u][v].delay;
+			if(dist[v]<0 || w<dist[v]){
+				dist[v] = w;
+				prev[v] = u;
+			}
+		}
+	}
+	if(dist[dest]<0)
+		return false;
+
+	p->size = 1;
+	for(v=dest;v!=src;v=prev[v])
+		p->size++;
+	p->path = new int[p->size];
+	for(u=p->size-1,v=dest;u>=0;u--,v=prev[v])
+		p->path[u] = v;
+	return true;
+}
+
+//Keep p if it meets the bound with a lower metric than the best
+static void keepBest(struct kPath *p, struct kPath *best, int maxDelay){
+
+	if(p->delay<=maxDelay && p->metric<best->metric){
+		delete[] best->path;
+		*best = *p;
+		best->path = new int[p->size];
+		memcpy(best->path,p->path,p->size*sizeof(int));
+	}
+}
+
+static bool samePath(struct kPath *a, struct kPath *b){
+	return a->size==b->size && memcmp(a->path,b->path,a->size*sizeof(int))==0;
+}
+
+static void addPath(struct kPath **list, int *count, struct kPath *p){
+
+	if((*count&(*count-1))==0)
+		*list = (struct kPath*) realloc(*list,(*count>0?2*(*count):1)*sizeof(struct kPath));
+	(*list)[(*count)++] = *p;
+}
+
+/* Yen on metric + lambda*delay from the LARAC path: the paths come in order
+ * of cost, and a path of cost L has metric at least L - lambda*maxDelay when it
+ * meets the bound, so the search stops once L - lambda*maxDelay reaches the
+ * best metric found */
+static void kShortestFallback(struct topologyLink **net, int n, int dest, int c,
+		int maxDelay, double lambda, struct kPath *first, struct kPath *best){
+
+	struct kPath *found = NULL,*cand = NULL,spur,*last;
+	struct pathFilter f;
+	int nfound = 0,ncand = 0,i,j,k,b;
+	bool dup;
+
+	f.removed = (bool*) calloc(n,sizeof(bool));
+	f.banned = (int*) malloc(DELAY_KPATHS*sizeof(int));
+	first->cost = first->metric+lambda*first->delay;
+	addPath(&found,&nfound,first);
+
+	while(nfound<DELAY_KPATHS){
+		last = &found[nfound-1];
+		keepBest(last,best,maxDelay);
+		if(last->cost-lambda*maxDelay>=best->metric-LARAC_EPSILON)
+			break;
+
+		for(i=0;i<last->size-1;i++){
+			//Links out of the spur router used by the paths with the same root
+			f.nbanned = 0;
+			for(k=0;k<nfound;k++)
+				if(found[k].size>i+1 && memcmp(found[k].path,last->path,(i+1)*sizeof(int))==0)
+					f.banned[f.nbanned++] = found[k].path[i]*n+found[k].path[i+1];
+			for(j=0;j<i;j++)
+				f.removed[last->path[j]] = true;
+			if(weightedPath(net,n,last->path[i],dest,c,1,lambda,&f,&spur)){
+				int *whole = new int[i+spur.size];
+				memcpy(whole,last->path,i*sizeof(int));
+				memcpy(whole+i,spur.path,spur.size*sizeof(int));
+				delete[] spur.path;
+				spur.path = whole;
+				spur.size+=i;
+				measurePath(net,&spur,lambda);
+				dup = false;
+				for(k=0;k<ncand && !dup;k++)
+					dup = samePath(&cand[k],&spur);
+				for(k=0;k<nfound && !dup;k++)
+					dup = samePath(&found[k],&spur);
+				if(dup)
+					delete[] spur.path;
+				else
+					addPath(&cand,&ncand,&spur);
+			}
+			for(j=0;j<i;j++)
+				f.removed[last->path[j]] = false;
+		}
+		if(ncand==0)
+			break;
+		b = 0;
+		for(k=1;k<ncand;k++)
+			if(cand[k].cost<cand[b].cost)
+				b = k;
+		addPath(&found,&nfound,&cand[b]);
+		cand[b] = cand[--ncand];
+	}
+	keepBest(&found[nfound-1],best,maxDelay);
+
+	//The first path belongs to the caller
+	for(k=1;k<nfound;k++)
+		delete[] found[k].path;
+	for(k=0;k<ncand;k++)
+		delete[] cand[k].path;
+	free(found);
+	free(cand);
+	free(f.removed);
+	free(f.banned);
+}
+
+//LARAC from the least metric and the least delay paths, then Yen between them
+static int* laracPath(struct topologyLink **net, int nodes, int src, int dest, int c, int maxDelay, int *s){
+
+	struct kPath pc,pd,r,best;
+	double lambda = 0;
+	int it;
+
+	//Least metric: the answer if it meets the bound
+	if(!weightedPath(net,nodes,src,dest,c,1,0,NULL,&pc))
+		return NULL;
+	measurePath(net,&pc,0);
+	if(pc.delay<=maxDelay){
+		*s = pc.size;
+		return pc.path;
+	}
+	//Least delay: no path meets the bound if it does not
+	if(!weightedPath(net,nodes,src,dest,c,0,1,NULL,&pd))
+		goto none;
+	measurePath(net,&pd,0);
+	if(pd.delay>maxDelay){
+		delete[] pd.path;
+		goto none;
+	}
+
+	//pc is too slow, pd meets the bound: move lambda between them
+	for(it=0;it<LARAC_ITERATIONS;it++){
+		lambda = (double)(pd.metric-pc.metric)/(pc.delay-pd.delay);
+		weightedPath(net,nodes,src,dest,c,1,lambda,NULL,&r);
+		measurePath(net,&r,lambda);
+		if(r.cost>=pc.metric+lambda*pc.delay-LARAC_EPSILON){
+			delete[] r.path;
+			break;
+		}
+		if(r.delay<=maxDelay){
+			delete[] pd.path;
+			pd = r;
+		}
+		else{
+			delete[] pc.path;
+			pc = r;
+		}
+	}
+
+	//pd is the LARAC answer, the paths between the two may have a lower metric
+	best = pd;
+	best.path = new int[pd.size];
+	memcpy(best.path,pd.path,pd.size*sizeof(int));
+	kShortestFallback(net,nodes,dest,c,maxDelay,lambda,&pd,&best);
+	delete[] pd.path;
+	delete[] pc.path;
+
+	if(DEBUG){
+		printf("\nPath from node %d to node %d with delay %d <= %d, metric %d (lambda %.4f, %d iterations): ",
+				src,dest,best.delay,maxDelay,best.metric,lambda,it);
+		for(it=0;it<best.size;it++)
+			printf("%d ",best.path[it]);
+		printf("\n\n");
+	}
+	*s = best.size;
+	return best.path;
+
+none:
+	delete[] pc.path;
+	return NULL;
+}
+
+/* Least metric path with residual capacity c and delay at most maxDelay
+ * (microseconds), NULL if no path meets the bound */
+int* find_path_delay(struct topologyLink **net, int nodes, int src, int dest, int c, int maxDelay, int *s){
+
+	int64_t span = TraceBegin(),start = StatClock();
+	int *path;
+
+	path = laracPath(net,nodes,src,dest,c,maxDelay,s);
+	TraceEnd("path","delay",span,src);
+	StatPath(start,path!=NULL);
+	return path;
+}
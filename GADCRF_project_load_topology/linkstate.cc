@@ -0,0 +1,315 @@
+/*
+ * linkstate.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Link-state feed. TE link updates (in the style of OSPF-TE or
+ * 				BGP-LS: link up with its capacity and addresses, link down,
+ * 				new reservable bandwidth, router loopback) are read from a
+ * 				file that is followed as it grows, or from a local socket
+ * 				(source "unix:<path>"). Updates are gathered for
+ * 				LINKSTATE_BATCH milliseconds and only the last state of each
+ * 				link is applied, so a flapping link costs one update. The
+ * 				tunnels on the links that went down are rerouted after the
+ * 				batch.
+ */
+
+#include "header_project.h"
+
+enum pendingState{
+	PENDING_NONE,
+	PENDING_UP,
+	PENDING_DOWN,
+	PENDING_BW									//New capacity, link state unchanged
+};
+
+struct pendingLink{
+	enum pendingState state;
+	int capacity;
+	bool addr;									//Addresses given with the link up
+	char srcAddr[CHAR_ADDRESS];
+	char dstAddr[CHAR_ADDRESS];
+	char srcIf[CHAR_INTERFACE];
+	char dstIf[CHAR_INTERFACE];
+};
+
+/******************* BEGIN LINKSTATEFEED CLASS METHODS *************************/
+
+//Constructor
+LinkStateFeed::LinkStateFeed(Topology *t, PathCache *pc, ContractionHierarchy *ch, FastReroute *fr, int nodes,
+		const char *src){
+
+	net = t;
+	cache = pc;
+	hierarchy = ch;
+	frr = fr;
+	n = nodes;
+	stop = false;
+	pending = (struct pendingLink*) calloc(n*n,sizeof(struct pendingLink));
+	touched = (int*) calloc(n*n,sizeof(int));
+	ntouched = 0;
+	pendingLoop = (char**) calloc(n,sizeof(char*));
+	nnodes = 0;
+	memset(&stats,0,sizeof(stats));
+	pthread_mutex_init(&mutex,NULL);
+	input = new FeedSource(src,"link-state feed",Line,this);
+	if(input->Ok())
+		pthread_create(&tid,NULL,Worker,this);
+	else
+		stop = true;
+}
+
+//Destructor
+LinkStateFeed::~LinkStateFeed(){
+
+	bool running;
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	running = !stop;
+	stop = true;
+	pthread_mutex_unlock(&mutex);
+	if(running)
+		pthread_join(tid,NULL);
+	delete input;
+	for(i=0;i<n;i++)
+		free(pendingLoop[i]);
+	free(pendingLoop);
+	free(pending);
+	free(touched);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * LinkStateFeed::Worker(void *arg){
+
+	((LinkStateFeed*) arg)->Run();
+	return NULL;
+}
+
+void LinkStateFeed::Line(char *line, void *arg){
+	((LinkStateFeed*) arg)->Parse(line);
+}
+
+void LinkStateFeed::Run(){
+
+	int wait;
+	bool end = false;
+
+	while(!end){
+		//Wake up for the batch deadline, the next read of the file or to check stop
+		wait = LINKSTATE_POLL;
+		if(ntouched+nnodes>0 && LINKSTATE_BATCH-elapsed(&first)<wait)
+			wait = LINKSTATE_BATCH-elapsed(&first);
+		if(wait<0)
+			wait = 0;
+		input->Poll(wait);
+
+		if(ntouched+nnodes>0 && elapsed(&first)>=LINKSTATE_BATCH)
+			Apply();
+		pthread_mutex_lock(&mutex);
+		end = stop;
+		pthread_mutex_unlock(&mutex);
+	}
+	if(ntouched+nnodes>0)
+		Apply();
+}
+
+void LinkStateFeed::Parse(char *line){
+
+	struct pendingLink *p,u;
+	char cmd[CHAR_INTERFACE],addr[CHAR_ADDRESS],a[CHAR_ADDRESS],b[CHAR_ADDRESS];
+	int i,j,k,f;
+	bool iface = false;
+
+	pthread_mutex_lock(&mutex);
+	stats.received++;
+	pthread_mutex_unlock(&mutex);
+
+	memset(&u,0,sizeof(u));
+	if(sscanf(line,"node %d %49s",&i,addr)==2){
+		if(i<0 || i>=n){
+			printf("Link-state: router %d not in the topology, restart with a new topology file\n",i);
+			goto reject;
+		}
+		//Router down: all its links, replacing their pending updates
+		if(strcmp(addr,"down")==0){
+			if(ntouched+nnodes==0)
+				clock_gettime(CLOCK_MONOTONIC,&first);
+			net->Lock();
+			for(j=0;j<n;j++)
+				for(k=0;k<2 && j!=i;k++){
+					f = (k==0)?i*n+j:j*n+i;
+					if(net->Matrix()[f/n][f%n].capacity==-1 && pending[f].state==PENDING_NONE)
+						continue;
+					p = &pending[f];
+					if(p->state==PENDING_NONE)
+						touched[ntouched++] = f;
+					memset(p,0,sizeof(*p));
+					p->state = PENDING_DOWN;
+				}
+			net->Unlock();
+			return;
+		}
+		if(ntouched+nnodes==0)
+			clock_gettime(CLOCK_MONOTONIC,&first);
+		if(pendingLoop[i]==NULL)
+			nnodes++;
+		else{
+			pthread_mutex_lock(&mutex);
+			stats.coalesced++;
+			pthread_mutex_unlock(&mutex);
+		}
+		free(pendingLoop[i]);
+		pendingLoop[i] = strdup(addr);
+		return;
+	}
+
+	f = sscanf(line,"link %49s %49s %29s %d %49s %49s %29s %29s",a,b,cmd,&u.capacity,
+			u.srcAddr,u.dstAddr,u.srcIf,u.dstIf);
+	if(f<3){
+		f = sscanf(line,"iface %49s %29s %29s %d %49s %49s %29s %29s",a,b,cmd,&u.capacity,
+				u.srcAddr,u.dstAddr,u.srcIf,u.dstIf);
+		iface = true;
+	}
+	if(f<3)
+		goto reject;
+	//Routers by index or loopback, a link also by the name of its interface
+	net->Lock();
+	i = ParseNode(net,n,a);
+	if(iface){
+		k = net->LinkByInterface(i,b);
+		i = (k!=-1)?k/n:-1;
+		j = (k!=-1)?k%n:-1;
+	}
+	else
+		j = ParseNode(net,n,b);
+	net->Unlock();
+	if(i<0 || j<0 || i==j)
+		goto reject;
+	if(strcmp(cmd,"down")==0)
+		u.state = PENDING_DOWN;
+	else if(strcmp(cmd,"up")==0 && f>=4 && u.capacity>=0){
+		u.state = PENDING_UP;
+		u.addr = (f==8);
+	}
+	else if(strcmp(cmd,"bw")==0 && f>=4 && u.capacity>=0)
+		u.state = PENDING_BW;
+	else
+		goto reject;
+
+	//Coalesce with the update of the same link still pending
+	p = &pending[i*n+j];
+	if(ntouched+nnodes==0)
+		clock_gettime(CLOCK_MONOTONIC,&first);
+	if(p->state==PENDING_NONE)
+		touched[ntouched++] = i*n+j;
+	else{
+		pthread_mutex_lock(&mutex);
+		stats.coalesced++;
+		pthread_mutex_unlock(&mutex);
+		if(u.state==PENDING_BW && p->state!=PENDING_BW){
+			//New bandwidth of a link that goes up, or of a link down (kept down)
+			if(p->state==PENDING_UP)
+				p->capacity = u.capacity;
+			return;
+		}
+		if(u.state==PENDING_UP && !u.addr && p->addr){
+			//Addresses of an earlier up are kept
+			p->state = PENDING_UP;
+			p->capacity = u.capacity;
+			return;
+		}
+	}
+	*p = u;
+	return;
+
+reject:
+	pthread_mutex_lock(&mutex);
+	stats.rejected++;
+	pthread_mutex_unlock(&mutex);
+	printf("Link-state: update not valid: %s\n",line);
+}
+
+/* One pass on the topology for the whole batch. Paths cached through a link
+ * that went down are dropped; a new link drops the whole cache, while a
+ * change of bandwidth does not change a path computed without constraints. */
+void LinkStateFeed::Apply(){
+
+	struct topologyLink **m;
+	struct pendingLink *p;
+	int k,i,j,links = 0,dropped = 0,over = 0,ndown = 0;
+	bool added = false,hops = false;
+	int *down = (int*) malloc((ntouched>0?ntouched:1)*sizeof(int));
+	int64_t span = TraceBegin();
+
+	net->Lock();
+	m = net->Matrix();
+	for(k=0;k<ntouched;k++){
+		p = &pending[touched[k]];
+		i = touched[k]/n;
+		j = touched[k]%n;
+		switch(p->state){
+		case PENDING_DOWN:
+			if(m[i][j].capacity!=-1){
+				net->SetLink(i,j,-1,NULL,NULL,NULL,NULL);
+				dropped+=cache->Invalidate(i,j);
+				hops = true;
+				down[ndown++] = touched[k];
+			}
+			break;
+		case PENDING_UP:
+			if(m[i][j].capacity==-1)
+				added = hops = true;
+			if(p->addr)
+				net->SetLink(i,j,p->capacity,p->srcAddr,p->dstAddr,p->srcIf,p->dstIf);
+			else
+				net->SetLink(i,j,p->capacity,NULL,NULL,NULL,NULL);
+			break;
+		case PENDING_BW:
+			if(m[i][j].capacity!=-1)
+				net->SetLink(i,j,p->capacity,NULL,NULL,NULL,NULL);
+			break;
+		default:
+			break;
+		}
+		if(m[i][j].capacity!=-1 && m[i][j].used>m[i][j].capacity)
+			over++;
+		p->state = PENDING_NONE;
+		links++;
+	}
+	for(i=0;i<n;i++)
+		if(pendingLoop[i]!=NULL){
+			net->SetLoopback(i,pendingLoop[i]);
+			free(pendingLoop[i]);
+			pendingLoop[i] = NULL;
+		}
+	if(added)
+		cache->Clear();
+	//A new link needs a new order, the others only new weights
+	if(hops && !hierarchy->Customize(m))
+		hierarchy->Build(m);
+	net->Unlock();
+	TraceEnd("linkstate","apply",span,links);
+	ntouched = 0;
+	nnodes = 0;
+
+	pthread_mutex_lock(&mutex);
+	stats.batches++;
+	stats.invalidated+=dropped;
+	pthread_mutex_unlock(&mutex);
+	if(over>0)
+		printf("Link-state: %d links with less capacity than reserved\n",over);
+	if(DEBUG)
+		printf("Link-state: %d links updated%s\n",links,added?", path cache cleared":"");
+	if(frr!=NULL && ndown>0)
+		frr->LinksDown(down,ndown);
+	free(down);
+}
+
+void LinkStateFeed::Stats(struct feedStats *st){
+
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	pthread_mutex_unlock(&mutex);
+}
+
+/******************* END LINKSTATEFEED CLASS METHODS ***************************/
@@ -9,23 +9,51 @@
 
 void installLSP(Topology *net,int nodes);
 void installLSPdemo(Topology *net,int nodes);
+void installLSPbulk(Topology *net,int nodes,int mode);
+void installP2MP(Topology *net,int nodes,int mode);
+void addP2MPLeaves(Topology *net,int nodes,int mode);
+void interDomainPath();
+void scheduleLSP(Topology *net,int nodes);
+void optimizeMetrics(Topology *net,int nodes);
+void failLinks(Topology *net,int nodes);
+void switchTrace();
+void showProvisioning(Topology *net);
 void configureNet(Topology *net,int nodes);
 void configureNetdemo(Topology *net,int nodes);
+void testNet(Topology *net,int nodes);
 char *itoa(int i);
 
 int id=0;
 int simul;
+SessionPool *pool;
+ProvisionQueue *queue;
+ProvisionPipeline *pipeline;
+LspTable *lsps;
+Journal *journal;
+Checkpointer *checkpointer;
+PathCache *paths;
+LinkStateFeed *feed;
+ContractionHierarchy *hierarchy;
+DomainSet *domains;
+Calendar *calendar;
+AutoBandwidth *autobw;
+SegmentRouting *segments;
+PathScheduler *requests;
+FastReroute *frr;
+MetricsServer *metrics;
+enum pathMode pathMode;
+int splitLsps=1;
+int splitMin=0;
 
 
 int main(int argc, char *argv[]) {
 
 	struct xmlRoot2 *xmlTopology;
 	int nodes = 0;
-	char *command;
 
 	xmlTopology = (struct xmlRoot2*) malloc(sizeof(struct xmlRoot2));
 
-	int mode;
+	int mode = -1;
 	Topology *net;
 
 	while(mode!=0 && mode!= 1 && mode!=2){
@@ -46,15 +74,8 @@ int main(int argc, char *argv[]) {
 			printf("Enable tap interface and test it\n");
 
 			system("./script/config_tap.sh");
-			printf("test\n");
-			for (int i=0;i<nodes;i++){
-					command = (char*)calloc(CHAR_COMMAND,sizeof(char));
-					strcpy(command,"ping ");
-					strcat(command,net->LoopArray()[i].loopAddr);
-					strcat(command," -c 3");
-					system(command);
-			}
-			printf("test ended\n");
+			testNet(net,nodes);
+			pool = new SessionPool(net->LoopArray(),nodes);
 			break;
 		case 1:
 			printf("Real mode\n");
@@ -64,15 +85,8 @@ int main(int argc, char *argv[]) {
 			nodes = xmlTopology->nodes;
 			net = new Topology(nodes);
 			net->LoadTopology(xmlTopology);
-			printf("test\n");
-			for (int i=0;i<nodes;i++){
-					command = (char*)calloc(CHAR_COMMAND,sizeof(char));
-					strcpy(command,"ping ");
-					strcat(command,net->LoopArray()[i].loopAddr);
-					strcat(command," -c 3");
-					system(command);
-			}
-			printf("test ended\n");
+			testNet(net,nodes);
+			pool = new SessionPool(net->LoopArray(),nodes);
 			break;
 		case 2:
 			//Import from XML file topology_xml_simul
@@ -89,6 +103,52 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	//Spans of the work of the PCE, dumped as a Chrome trace to PCE_TRACE on exit
+	if(getenv("PCE_TRACE")!=NULL)
+		TraceEnable(true);
+	queue = new ProvisionQueue(nodes);
+	lsps = new LspTable(nodes);
+
+	//Reservations made after the last checkpoint are taken from the journal
+	u_int64_t checkpoint = LoadDelta(net,xmlTopology->journalSeq);
+	journal = new Journal((simul==0)?"topology_journal":"topology_journal_simul");
+	id = journal->Replay(net,lsps,checkpoint);
+	lsps->SetJournal(journal);
+	checkpointer = new Checkpointer(net,journal,nodes,checkpoint);
+	//Link-state updates from the routing daemons, if a source is given
+	paths = new PathCache(nodes);
+	hierarchy = new ContractionHierarchy(nodes);
+	hierarchy->Build(net->Matrix());
+	calendar = new Calendar(nodes);
+	//Objective of the paths of the LSPs: shortest, widest, shortest-widest or min-util
+	pathMode = pathModeByName(getenv("PCE_PATH_MODE"));
+	//A demand without a path may be split on up to PCE_SPLIT_LSPS tunnels of PCE_SPLIT_MIN at least
+	if(getenv("PCE_SPLIT_LSPS")!=NULL && atoi(getenv("PCE_SPLIT_LSPS"))>1)
+		splitLsps = atoi(getenv("PCE_SPLIT_LSPS"));
+	if(getenv("PCE_SPLIT_MIN")!=NULL && atoi(getenv("PCE_SPLIT_MIN"))>0)
+		splitMin = atoi(getenv("PCE_SPLIT_MIN"));
+	requests = new PathScheduler(net,calendar,nodes,pathMode,REQUEST_WORKERS);
+	if(mode==0 || mode==1)
+		pipeline = new ProvisionPipeline(pool,net,lsps,nodes);
+	//Other IGP areas or ASes, with the links between their border routers
+	domains = new DomainSet(net,nodes);
+	if(getenv("PCE_DOMAINS")!=NULL)
+		domains->Load(getenv("PCE_DOMAINS"));
+	//Tunnels on segment routing paths of at most PCE_SR_MSD SIDs, RSVP if not set
+	if(getenv("PCE_SR_MSD")!=NULL && atoi(getenv("PCE_SR_MSD"))>0)
+		segments = new SegmentRouting(nodes,atoi(getenv("PCE_SR_MSD")));
+	//Tunnels on links or routers that go down get a new path
+	frr = new FastReroute(net,lsps,calendar,requests,pipeline,queue,segments,nodes,pathMode);
+	if(getenv("PCE_LINKSTATE")!=NULL)
+		feed = new LinkStateFeed(net,paths,hierarchy,frr,nodes,getenv("PCE_LINKSTATE"));
+	//Rate samples of the tunnels, resized every AUTOBW_INTERVAL seconds
+	if(getenv("PCE_AUTOBW")!=NULL)
+		autobw = new AutoBandwidth(net,lsps,calendar,pipeline,queue,segments,nodes,pathMode,
+				getenv("PCE_AUTOBW"));
+	//Prometheus metrics on http://<pce>:PCE_METRICS_PORT/metrics
+	if(getenv("PCE_METRICS_PORT")!=NULL && atoi(getenv("PCE_METRICS_PORT"))>0)
+		metrics = new MetricsServer(net,lsps,requests,pipeline,queue,nodes,atoi(getenv("PCE_METRICS_PORT")));
+
 	int choise;
 	while(1){
 		printf("********* MENU *********\n");
@@ -96,6 +156,16 @@ int main(int argc, char *argv[]) {
 		printf("2: Configure net\n");
 		printf("3: Install LSP\n");
 		printf("4: Exit\n");
+		printf("5: Install LSPs in bulk\n");
+		printf("6: Provisioning status\n");
+		printf("7: Reconcile routers with the LSPs\n");
+		printf("8: Install P2MP LSP\n");
+		printf("9: Add leaves to a P2MP LSP\n");
+		printf("10: Inter-domain path\n");
+		printf("11: Book capacity for a time window\n");
+		printf("12: Optimize IGP metrics for a traffic matrix\n");
+		printf("13: Fail a link or a router\n");
+		printf("14: Tracing on/off\n");
 		printf("> ");
 		scanf("%i",&choise);
 		switch(choise){
@@ -115,7 +185,52 @@ int main(int argc, char *argv[]) {
 				installLSPdemo(net,nodes);
 			break;
 		case 4:
+			delete metrics;
+			delete autobw;
+			delete feed;
+			delete frr;
+			delete requests;
+			delete segments;
+			delete domains;
+			delete pipeline;
+			delete checkpointer;
+			delete journal;
+			if(TraceOn())
+				switchTrace();
 			return 0;
+		case 5:
+			installLSPbulk(net,nodes,mode);
+			break;
+		case 6:
+			showProvisioning(net);
+			break;
+		case 7:
+			if(mode==2)
+				printf("Not available in demo mode\n");
+			else
+				Reconcile(net,nodes,lsps,pool,pipeline,segments);
+			break;
+		case 8:
+			installP2MP(net,nodes,mode);
+			break;
+		case 9:
+			addP2MPLeaves(net,nodes,mode);
+			break;
+		case 10:
+			interDomainPath();
+			break;
+		case 11:
+			scheduleLSP(net,nodes);
+			break;
+		case 12:
+			optimizeMetrics(net,nodes);
+			break;
+		case 13:
+			failLinks(net,nodes);
+			break;
+		case 14:
+			switchTrace();
+			break;
 		default:
 			printf("Command not found\n");
 			break;
@@ -125,74 +240,501 @@ int main(int argc, char *argv[]) {
 	return 0;
 }
 
-void installLSP(Topology *net,int nodes){
+//Lowest residual capacity on the links of the path
+static int bottleneck(struct topologyLink **m,int *path,int size){
+	int b = -1;
+	for(int i=0;i<size-1;i++)
+		if(b==-1 || m[path[i]][path[i+1]].capacity-m[path[i]][path[i+1]].used<b)
+			b = m[path[i]][path[i+1]].capacity-m[path[i]][path[i+1]].used;
+	return b;
+}
+
+/* Demand split on up to splitLsps parallel tunnels, each one with its own
+ * id and at least splitMin of capacity: the rest of the demand goes on one
+ * path if it fits, otherwise the widest path carries as much as it can.
+ * The parts are found on a copy of the matrix and reserved only if the
+ * whole demand is placed. */
+static bool queueSplit(Topology *net,int nodes,int src,int dst,int capacity,int priority){
+	int *parts[splitLsps],sizes[splitLsps],caps[splitLsps],ids[splitLsps];
+	struct provOp *ops[splitLsps];
+	int nparts = 0,remaining = capacity,part,size,i,k;
+	int *path;
 
+	lsps->Lock();
+	net->Lock();
+	struct topologyLink **m = calendar->Copy(net->Matrix(),time(NULL),CALENDAR_FOREVER);
+	while(remaining>0 && nparts<splitLsps){
+		if((path=find_path_mode(m,nodes,src,dst,remaining,pathMode,&size))!=NULL)
+			part = remaining;
+		else if(nparts==splitLsps-1)
+			break;
+		else{
+			path = find_path_mode(m,nodes,src,dst,(splitMin>0)?splitMin:1,PATH_WIDEST,&size);
+			if(path==NULL)
+				break;
+			part = bottleneck(m,path,size);
+			//What is left must still be a tunnel of splitMin at least
+			if(remaining-part<splitMin)
+				part = remaining-splitMin;
+			if(part<splitMin || part<=0){
+				delete[] path;
+				break;
+			}
+		}
+		for(i=0;i<size-1;i++)
+			m[path[i]][path[i+1]].used+=part;
+		parts[nparts] = path;
+		sizes[nparts] = size;
+		caps[nparts++] = part;
+		remaining-=part;
+	}
+	calendar->FreeResidual(m);
+	if(remaining>0){
+		net->Unlock();
+		lsps->Unlock();
+		for(k=0;k<nparts;k++)
+			delete[] parts[k];
+		printf("It's not possible to install an LSP, %d of %d placed on %d tunnels\n",capacity-remaining,
+				capacity,nparts);
+		return false;
+	}
+
+	for(k=0;k<nparts;k++){
+		ids[k] = id++;
+		net->UpdateTopology(parts[k],sizes[k],caps[k]);
+		journal->Reserve(ids[k],src,dst,caps[k],parts[k],sizes[k],-1,priority);
+		int gen = lsps->Place(ids[k],src,dst,caps[k],parts[k],sizes[k],priority,-1);
+		char *hops[sizes[k]];
+		bool sr;
+		int nhops = TunnelHops(net,segments,parts[k],sizes[k],hops,&sr);
+		ops[k] = NewProvOp(OP_TUNNEL,src,ids[k],net->LoopArray()[dst].loopAddr,caps[k],hops,nhops,false);
+		ops[k]->segments = sr;
+		ops[k]->priority = priority;
+		ops[k]->gen = gen;
+	}
+	net->Unlock();
+	lsps->Unlock();
+	printf("Demand of %d split on %d tunnels:",capacity,nparts);
+	for(k=0;k<nparts;k++){
+		delete[] parts[k];
+		printf(" Tunnel%d (%d)",ids[k],caps[k]);
+		if(pipeline!=NULL)
+			pipeline->Submit(ops[k]);
+		else{
+			queue->Push(ops[k]);
+			lsps->SetState(ids[k],LSP_UP);
+		}
+	}
+	printf("\n");
+	StatAdd(STAT_LSP_ADMITTED,1);
+	if(journal->Full())
+		checkpointer->Request();
+	return true;
+}
+
+/* Compute the path and reserve its capacity, then hand the tunnel with its
+ * setup priority to the provisioning pipeline (or to the queue shown in demo mode).
+ * With a delay bound the path is the one of least TE metric within the bound.
+ * A path computed before (hint) is taken if it still has the capacity. */
+static bool queueLSP(Topology *net,int nodes,int src,int dst,int capacity,int maxDelay,
+		int priority=LSP_PRIORITY,int *hint=NULL,int hintSize=0){
 	int size;
+	int* path = NULL;
+	int64_t span = TraceBegin();
+	StatAdd(STAT_LSP_REQUESTS,1);
+	lsps->Lock();
+	net->Lock();
+	//Capacity booked for a later window is not free for an LSP that keeps it for ever
+	struct topologyLink **booked = calendar->Residual(net->Matrix(),time(NULL),CALENDAR_FOREVER);
+	struct topologyLink **m = (booked!=NULL)?booked:net->Matrix();
+	if(hint!=NULL && maxDelay<=0 && bottleneck(m,hint,hintSize)>=capacity){
+		path = new int[hintSize];
+		memcpy(path,hint,hintSize*sizeof(int));
+		size = hintSize;
+	}
+	else
+		path = (maxDelay>0)?find_path_delay(m,nodes,src,dst,capacity,maxDelay,&size)
+				:find_path_mode(m,nodes,src,dst,capacity,pathMode,&size);
+	calendar->FreeResidual(booked);
+	if(path==NULL){
+		net->Unlock();
+		lsps->Unlock();
+		TraceEnd("lsp","queue",span,src);
+		if(splitLsps>1 && maxDelay<=0)
+			return queueSplit(net,nodes,src,dst,capacity,priority);
+		printf("It's not possible to install an LSP\n");
+		return false;
+	}
+	int lsp = id++;
+	net->UpdateTopology(path,size,capacity);
+	journal->Reserve(lsp,src,dst,capacity,path,size,-1,priority);
+	int gen = lsps->Place(lsp,src,dst,capacity,path,size,priority,-1);
+	char *hops[size];
+	bool sr;
+	int nhops = TunnelHops(net,segments,path,size,hops,&sr);//insert PATH
+	struct provOp *op = NewProvOp(OP_TUNNEL,path[0],lsp,net->LoopArray()[path[size-1]].loopAddr,
+			capacity,hops,nhops,false);
+	op->segments = sr;
+	op->priority = priority;
+	op->gen = gen;
+	net->Unlock();
+	lsps->Unlock();
+	delete[] path;
+	TraceEnd("lsp","queue",span,src);
+	if(pipeline!=NULL)
+		pipeline->Submit(op);
+	else{
+		queue->Push(op);
+		lsps->SetState(lsp,LSP_UP);
+	}
+	StatAdd(STAT_LSP_ADMITTED,1);
+	if(journal->Full())
+		checkpointer->Request();
+	return true;
+}
+
+//Router given by index or by loopback address
+static int readNode(Topology *net,int nodes,const char *what){
+	char s[CHAR_ADDRESS];
+	int node=-1;
+
+	while(node<0){
+		printf("%s:\n> ",what);
+		scanf("%49s",s);
+		net->Lock();
+		node = ParseNode(net,nodes,s);
+		net->Unlock();
+		if(node<0)
+			printf("%s not valid\n",what);
+	}
+	return node;
+}
+
+void installLSP(Topology *net,int nodes){
+
 	int capacity=-1;
+	int maxDelay=-1;
 	int src=-1;
 	int dst=-1;
-	char *command;
 
-	while(src<0 || src>=nodes){
-		printf("Source node:\n> ");
-		scanf("%i",&src);
-		if(src<0 || src>=nodes)
-			printf("Source node not valid\n");
+	src = readNode(net,nodes,"Source node");
+	dst = readNode(net,nodes,"Destination node");
+	while(capacity<0){
+		printf("Capacity:\n> ");
+		scanf("%i",&capacity);
+		if(capacity<0)
+			printf("Negative capacity not valid\n");
 	}
-	while(dst<0 || dst>=nodes){
-		printf("Destination node:\n> ");
-		scanf("%i",&dst);
-		if(dst<0 || dst>=nodes)
-			printf("Destination node not valid\n");
+	while(maxDelay<0){
+		printf("Maximum delay in microseconds (0 = no bound):\n> ");
+		scanf("%i",&maxDelay);
+		if(maxDelay<0)
+			printf("Negative delay not valid\n");
 	}
+	if(queueLSP(net,nodes,src,dst,capacity,maxDelay))
+		printf("LSP queued for router %s\n",net->LoopArray()[src].loopAddr);
+}
+
+void installLSPdemo(Topology *net,int nodes){
+	int size;
+	int capacity=-1;
+	int maxDelay=-1;
+	int src=-1;
+	int dst=-1;
+
+	src = readNode(net,nodes,"Source node");
+	dst = readNode(net,nodes,"Destination node");
 	while(capacity<0){
 		printf("Capacity:\n> ");
 		scanf("%i",&capacity);
 		if(capacity<0)
 			printf("Negative capacity not valid\n");
 	}
-	int* path = find_path(net->Matrix(),nodes,src,dst,capacity,&size);
-	if(path==NULL){
+	while(maxDelay<0){
+		printf("Maximum delay in microseconds (0 = no bound):\n> ");
+		scanf("%i",&maxDelay);
+		if(maxDelay<0)
+			printf("Negative delay not valid\n");
+	}
+	net->Lock();
+	int* path_unc = paths->Get(src,dst,&size);
+	if(path_unc==NULL && (path_unc=hierarchy->Query(src,dst,&size))!=NULL)
+		paths->Put(src,dst,path_unc,size);
+	net->Unlock();
+	if(path_unc==NULL){
 		printf("It's not possible to install an LSP\n");
 		return;
 	}
-	net->UpdateTopology(path,size,capacity);
-	command = (char*)calloc(CHAR_COMMAND,sizeof(char));
-	strcpy(command,"expect ./script/lsp.sh ");
-	strcat(command,net->LoopArray()[path[0]].loopAddr);//insert IP
-	strcat(command," ");
-	strcat(command,net->LoopArray()[path[size-1]].loopAddr);//insert DEST
-	strcat(command," ");
-	char *buffer;
-	buffer = itoa(capacity);
-	strcat(command,buffer);//Insert CAPACITY
-	strcat(command," ");
-	buffer = itoa(id++);
-	strcat(command,buffer);//Insert ID
-	strcat(command," ");
-	for(int i=0;i<size-1;i++){
-		strcat(command,net->Matrix()[path[i]][path[i+1]].dstAddr);//insert PATH
-		strcat(command," ");
-	}
-	system(command);
+	//Shortest path without capacity, printed whether from the cache or the hierarchy
+	printf("\nPath from node %d to node %d with no capacity constrain: ",src,dst);
+	for(int i=0;i<size;i++)
+		printf("%d ",path_unc[i]);
+	printf("\n\n");
+	delete[] path_unc;
+	if(queueLSP(net,nodes,src,dst,capacity,maxDelay))
+		queue->Flush(NULL);
 }
 
-void installLSPdemo(Topology *net,int nodes){
-	int size;
+/* Install many LSPs at once: paths are computed while the routers are
+ * configured, each head-end with as few transactions as possible. All the
+ * paths are requested first, so that equal demands are computed once, then
+ * reserved in order (a path taken by the LSPs before is computed again).
+ * An LSP may give its setup priority and a deadline for its path: the
+ * scheduler computes the highest priorities and the nearest deadlines
+ * first, and gives up the paths whose deadline passed in the queue. */
+void installLSPbulk(Topology *net,int nodes,int mode){
+	int count=-1,installed=0,read=0;
+	int capacity,priority,deadline,size=0;
+	char line[CHAR_COMMAND],a[CHAR_ADDRESS],b[CHAR_ADDRESS];
+	enum schedStatus status;
+
+	while(count<0){
+		printf("Number of LSPs:\n> ");
+		scanf("%i",&count);
+	}
+	int *src = new int[count],*dst = new int[count],*cap = new int[count],*prio = new int[count];
+	struct pathRequest **req = new struct pathRequest*[count];
+	for(read=0;read<count;read++){
+		printf("Source, destination, capacity [setup priority 0-%d [deadline in ms]] of LSP %d:\n> ",
+				LSP_PRIORITIES-1,read);
+		if(scanf(" %499[^\n]",line)!=1)
+			break;
+		priority = LSP_PRIORITY;
+		deadline = 0;
+		if(sscanf(line,"%49s %49s %i %i %i",a,b,&capacity,&priority,&deadline)<3)
+			break;
+		net->Lock();
+		src[read] = ParseNode(net,nodes,a);
+		dst[read] = ParseNode(net,nodes,b);
+		net->Unlock();
+		cap[read] = capacity;
+		prio[read] = priority;
+		req[read] = NULL;
+		if(src[read]<0 || dst[read]<0 || capacity<0 || priority<0 || priority>=LSP_PRIORITIES
+				|| deadline<0)
+			printf("LSP not valid\n");
+		else	//The scheduler serves the highest value first, the tunnels the lowest
+			req[read] = requests->Submit(src[read],dst[read],capacity,LSP_PRIORITIES-1-priority,deadline);
+	}
+	for(int i=0;i<read;i++){
+		if(req[i]==NULL)
+			continue;
+		int *path = requests->Wait(req[i],&size,&status);
+		if(status==SCHED_EXPIRED)
+			printf("Deadline of LSP %d passed before its path was computed\n",i);
+		else if(queueLSP(net,nodes,src[i],dst[i],cap[i],0,prio[i],path,size))
+			installed++;
+		delete[] path;
+	}
+	delete[] src;
+	delete[] dst;
+	delete[] cap;
+	delete[] prio;
+	delete[] req;
+	printf("%d LSPs computed\n",installed);
+	if(mode==2)
+		queue->Flush(NULL);
+}
+
+/* Join the leaves to the P2MP tree of the root, a new one if *tree is -1
+ * (its id is the one of the first branch). Every branch is an LSP holding the
+ * capacity of the links it adds to the tree, and its leaf is configured in the
+ * destination list of the tunnel with the whole path from the root. */
+static int queueTree(Topology *net,int nodes,int src,int *tree,int capacity,int *leaves,int count){
+	struct lspEntry *e;
+	struct provOp *ops = NULL,**last = &ops,*op;
+	int **bpath = NULL,*bsize = NULL,*bleaf = NULL,nbranches = 0;
+	int remaining[count],nrem = 0;
+	int nadded = 0;
+	bool leaf[nodes];
+	int i,k,size,lsp,bsz,gen;
+	int *path,*branch;
+	bool created = (*tree==-1);
+
+	memset(leaf,0,sizeof(leaf));
+	lsps->Lock();
+	if(!created){
+		bpath = (int**) malloc(lsps->Size()*sizeof(int*));
+		bsize = (int*) malloc(lsps->Size()*sizeof(int));
+		bleaf = (int*) malloc(lsps->Size()*sizeof(int));
+		for(k=0;k<lsps->Size();k++){
+			e = lsps->Find(k);
+			if(e==NULL || e->tree!=*tree || e->state==LSP_FAILED)
+				continue;
+			bpath[nbranches] = new int[e->size];
+			memcpy(bpath[nbranches],e->path,e->size*sizeof(int));
+			bsize[nbranches] = e->size;
+			bleaf[nbranches++] = e->dst;
+			src = e->src;
+			capacity = e->capacity;
+		}
+		if(nbranches==0){
+			lsps->Unlock();
+			printf("P2MP LSP %d not found\n",*tree);
+			free(bpath);
+			free(bsize);
+			free(bleaf);
+			return 0;
+		}
+	}
+
+	net->Lock();
+	struct topologyLink **booked = calendar->Residual(net->Matrix(),time(NULL),CALENDAR_FOREVER);
+	SteinerTree steiner((booked!=NULL)?booked:net->Matrix(),nodes,src,capacity);
+	//Branches in the order they were added, the leaves of the orphaned ones can join again
+	for(k=0;k<nbranches;k++){
+		if(steiner.AddBranch(bpath[k],bsize[k]))
+			leaf[bleaf[k]] = true;
+		delete[] bpath[k];
+	}
+	//The root, the leaves already in the tree and the duplicates are skipped
+	leaf[src] = true;
+	for(k=0;k<count;k++)
+		if(leaves[k]>=0 && leaves[k]<nodes && !leaf[leaves[k]]){
+			leaf[leaves[k]] = true;
+			remaining[nrem++] = leaves[k];
+		}
+	//Shortest path heuristic: the leaf nearest to the tree joins first
+	while(nrem>0 && (k=steiner.Nearest(remaining,nrem))!=-1){
+		lsp = id++;
+		if(*tree==-1)
+			*tree = lsp;
+		branch = steiner.Attach(remaining[k],&bsz);
+		net->UpdateTopology(branch,bsz,capacity);
+		journal->Reserve(lsp,src,remaining[k],capacity,branch,bsz,*tree,LSP_PRIORITY);
+		gen = lsps->Place(lsp,src,remaining[k],capacity,branch,bsz,LSP_PRIORITY,*tree);
+		delete[] branch;
+		path = steiner.PathTo(remaining[k],&size);
+		char *hops[size];
+		for(i=0;i<size-1;i++)
+			hops[i] = net->Matrix()[path[i]][path[i+1]].dstAddr;
+		op = NewProvOp(OP_P2MP_LEAF,src,*tree,net->LoopArray()[remaining[k]].loopAddr,capacity,
+				hops,size-1,false);
+		op->branch = lsp;
+		op->gen = gen;
+		*last = op;
+		last = &op->next;
+		delete[] path;
+		nadded++;
+		remaining[k] = remaining[--nrem];
+	}
+	if(created && nadded>0)
+		*last = NewProvOp(OP_P2MP,src,*tree,NULL,capacity,NULL,0,false);
+	net->Unlock();
+	lsps->Unlock();
+	calendar->FreeResidual(booked);
+	free(bpath);
+	free(bsize);
+	free(bleaf);
+
+	while(ops!=NULL){
+		op = ops;
+		ops = op->next;
+		op->next = NULL;
+		if(pipeline!=NULL)
+			pipeline->Submit(op);
+		else{
+			if(op->type==OP_P2MP_LEAF)
+				lsps->SetState(op->branch,LSP_UP);
+			queue->Push(op);
+		}
+	}
+	for(k=0;k<nrem;k++)
+		printf("Leaf %d not reachable with capacity %d\n",remaining[k],capacity);
+	if(journal->Full())
+		checkpointer->Request();
+	return nadded;
+}
+
+static int readLeaves(Topology *net,int nodes,int **leaves){
+	int count=-1;
+	char what[CHAR_COMMAND];
+
+	while(count<1){
+		printf("Number of leaves:\n> ");
+		scanf("%i",&count);
+	}
+	*leaves = (int*) malloc(count*sizeof(int));
+	for(int i=0;i<count;i++){
+		snprintf(what,CHAR_COMMAND,"Leaf %d",i);
+		(*leaves)[i] = readNode(net,nodes,what);
+	}
+	return count;
+}
+
+//P2MP LSP from a source to many leaves, capacity reserved once on shared links
+void installP2MP(Topology *net,int nodes,int mode){
 	int capacity=-1;
 	int src=-1;
-	int dst=-1;
+	int tree=-1;
+	int *leaves,count,joined;
+
+	src = readNode(net,nodes,"Source node");
+	while(capacity<0){
+		printf("Capacity:\n> ");
+		scanf("%i",&capacity);
+		if(capacity<0)
+			printf("Negative capacity not valid\n");
+	}
+	count = readLeaves(net,nodes,&leaves);
+	joined = queueTree(net,nodes,src,&tree,capacity,leaves,count);
+	free(leaves);
+	if(joined==0){
+		printf("It's not possible to install a P2MP LSP\n");
+		return;
+	}
+	printf("P2MP LSP %d queued for router %s with %d leaves\n",tree,net->LoopArray()[src].loopAddr,joined);
+	if(mode==2)
+		queue->Flush(NULL);
+}
+
+//New leaves of a P2MP LSP, joined to the routers already in the tree
+void addP2MPLeaves(Topology *net,int nodes,int mode){
+	int tree=-1;
+	int *leaves,count,joined;
+
+	while(tree<0){
+		printf("P2MP LSP:\n> ");
+		scanf("%i",&tree);
+	}
+	count = readLeaves(net,nodes,&leaves);
+	joined = queueTree(net,nodes,-1,&tree,0,leaves,count);
+	free(leaves);
+	printf("%d leaves added to P2MP LSP %d\n",joined,tree);
+	if(mode==2 && joined>0)
+		queue->Flush(NULL);
+}
 
-	while(src<0 || src>=nodes){
+//Path from a router of a domain to a router of another one (BRPC)
+void interDomainPath(){
+	int srcDomain=-1,dstDomain=-1;
+	int src=-1,dst=-1;
+	int capacity=-1;
+	int size;
+	struct domainHop *path;
+
+	if(domains->Count()==1){
+		printf("Only one domain, set PCE_DOMAINS to the domains file\n");
+		return;
+	}
+	while(srcDomain<0 || srcDomain>=domains->Count()){
+		printf("Source domain:\n> ");
+		scanf("%i",&srcDomain);
+	}
+	while(src<0 || src>=domains->Nodes(srcDomain)){
 		printf("Source node:\n> ");
 		scanf("%i",&src);
-		if(src<0 || src>=nodes)
+		if(src<0 || src>=domains->Nodes(srcDomain))
 			printf("Source node not valid\n");
 	}
-	while(dst<0 || dst>=nodes){
+	while(dstDomain<0 || dstDomain>=domains->Count()){
+		printf("Destination domain:\n> ");
+		scanf("%i",&dstDomain);
+	}
+	while(dst<0 || dst>=domains->Nodes(dstDomain)){
 		printf("Destination node:\n> ");
 		scanf("%i",&dst);
-		if(dst<0 || dst>=nodes)
+		if(dst<0 || dst>=domains->Nodes(dstDomain))
 			printf("Destination node not valid\n");
 	}
 	while(capacity<0){
@@ -201,48 +743,232 @@ void installLSPdemo(Topology *net,int nodes){
 		if(capacity<0)
 			printf("Negative capacity not valid\n");
 	}
-	int* path = find_path(net->Matrix(),nodes,src,dst,capacity,&size);
-	if(path==NULL){
-		printf("It's not possible to install an LSP\n");
+	if((path=domains->FindPath(srcDomain,src,dstDomain,dst,capacity,&size))==NULL){
+		printf("No inter-domain path with capacity %d\n",capacity);
 		return;
 	}
-	int* path_unc = find_path_unconstrained(net->Matrix(),nodes,src,dst,&size);
-	if(path_unc==NULL){
-		printf("It's not possible to install an LSP\n");
+	printf("Path:");
+	for(int i=0;i<size;i++)
+		printf(" %d:%d",path[i].domain,path[i].node);
+	printf("\n");
+	free(path);
+}
+
+/* Book the capacity of an LSP on its path for a time window: the path has
+ * enough capacity for the installed LSPs and the peak of the other bookings
+ * at every second of the window */
+void scheduleLSP(Topology *net,int nodes){
+	int capacity=-1;
+	int src=-1;
+	int dst=-1;
+	int start=-1;
+	int duration=0;
+	int size;
+	time_t now;
+
+	src = readNode(net,nodes,"Source node");
+	dst = readNode(net,nodes,"Destination node");
+	while(capacity<0){
+		printf("Capacity:\n> ");
+		scanf("%i",&capacity);
+		if(capacity<0)
+			printf("Negative capacity not valid\n");
+	}
+	while(start<0){
+		printf("Start of the window in seconds from now:\n> ");
+		scanf("%i",&start);
+	}
+	while(duration<=0){
+		printf("Duration in seconds:\n> ");
+		scanf("%i",&duration);
+	}
+	now = time(NULL);
+	net->Lock();
+	struct topologyLink **booked = calendar->Residual(net->Matrix(),now+start,now+start+duration);
+	int* path = find_path_mode((booked!=NULL)?booked:net->Matrix(),nodes,src,dst,capacity,pathMode,&size);
+	calendar->FreeResidual(booked);
+	if(path!=NULL)
+		calendar->Book(path,size,capacity,now+start,now+start+duration);
+	net->Unlock();
+	if(path==NULL){
+		printf("Not enough capacity in the window\n");
 		return;
 	}
-	char *buffer1,*buffer2;
-	buffer1 = itoa(capacity);
-	buffer2 = itoa(id++);
-	net->UpdateTopology(path,size,capacity);
-	showConfigureLSP(src,net->LoopArray()[path[0]].loopAddr,net->LoopArray()[path[size-1]].loopAddr,
-			buffer1,buffer2,size-1,net->Matrix());
-
+	printf("Capacity %d booked from node %d to node %d in %d seconds for %d seconds:",capacity,src,dst,
+			start,duration);
+	for(int i=0;i<size;i++)
+		printf(" %d",path[i]);
+	printf("\n");
+	delete[] path;
 }
 
-void configureNet(Topology *net,int nodes){
-	char *command[nodes];
-	int i,j;
-	for (i=0;i<nodes;i++){
-		command[i] = (char*)calloc(CHAR_COMMAND,sizeof(char));
-		strcpy(command[i],"expect ./script/cef.sh ");
-		strcat(command[i],net->LoopArray()[i].loopAddr);
-
-		for(j=0;j<nodes;j++){
-
-			if(net->Matrix()[i][j].capacity!=-1){
-				strcat(command[i]," ");
-				strcat(command[i],net->Matrix()[i][j].srcInterface);
+/* IGP metrics that spread a traffic matrix on the links, written in the
+ * topology with the next checkpoint */
+void optimizeMetrics(Topology *net,int nodes){
+	char file[CHAR_COMMAND];
+	struct tmDemand *d;
+	int count,changed=0;
+	double before,after;
+
+	printf("Traffic matrix file (lines <src> <dst> <rate>):\n> ");
+	scanf("%499s",file);
+	if((d=ReadTrafficMatrix(file,nodes,&count))==NULL)
+		return;
+	net->Lock();
+	MetricOptimizer *opt = new MetricOptimizer(net->Matrix(),nodes,d,count);
+	net->Unlock();
+	free(d);
+	before = opt->MaxUtil();
+	after = opt->Run(METRIC_STEPS);
+
+	int *metric = new int[nodes*nodes];
+	opt->Metrics(metric);
+	delete opt;
+	net->Lock();
+	struct topologyLink **m = net->Matrix();
+	for(int i=0;i<nodes;i++)
+		for(int j=0;j<nodes;j++)
+			if(m[i][j].capacity!=-1 && metric[i*nodes+j]!=linkIgpMetric(&m[i][j])){
+				net->SetIgpMetric(i,j,metric[i*nodes+j]);
+				changed++;
 			}
+	net->Unlock();
+	delete[] metric;
+	if(changed>0)
+		checkpointer->Request();
+	printf("%d demands, highest utilization %.3f -> %.3f, %d metrics changed\n",count,before,after,changed);
+}
+
+/* Link between two routers, or all the links of a router, taken down in
+ * both directions; the tunnels on them are rerouted */
+void failLinks(Topology *net,int nodes){
+	char s[CHAR_ADDRESS];
+	int src,dst=-1,count=0;
+	int *down = new int[2*nodes];
+
+	src = readNode(net,nodes,"Router");
+	printf("Other end of the link (-1 for all the links of the router):\n> ");
+	scanf("%49s",s);
+	net->Lock();
+	if(strcmp(s,"-1")!=0 && ((dst=ParseNode(net,nodes,s))<0 || dst==src)){
+		net->Unlock();
+		printf("Router not valid\n");
+		delete[] down;
+		return;
+	}
+	struct topologyLink **m = net->Matrix();
+	for(int j=0;j<nodes;j++){
+		if(j==src || (dst!=-1 && j!=dst))
+			continue;
+		if(m[src][j].capacity!=-1){
+			net->SetLink(src,j,-1,NULL,NULL,NULL,NULL);
+			paths->Invalidate(src,j);
+			down[count++] = src*nodes+j;
+		}
+		if(m[j][src].capacity!=-1){
+			net->SetLink(j,src,-1,NULL,NULL,NULL,NULL);
+			paths->Invalidate(j,src);
+			down[count++] = j*nodes+src;
 		}
-		system(command[i]);
 	}
+	if(count>0 && !hierarchy->Customize(m))
+		hierarchy->Build(m);
+	net->Unlock();
+	printf("%d links down\n",count);
+	if(count>0)
+		frr->LinksDown(down,count);
+	delete[] down;
+}
+
+//Tracing is switched on, or off with the spans written to the trace file
+void switchTrace(){
+	const char *file = (getenv("PCE_TRACE")!=NULL)?getenv("PCE_TRACE"):TRACE_FILE;
+	int count;
+	if(!TraceOn()){
+		TraceEnable(true);
+		printf("Tracing on\n");
+		return;
+	}
+	TraceEnable(false);
+	if((count=TraceDump(file))<0)
+		printf("Trace not written\n");
+	else
+		printf("Tracing off, %d spans written to %s\n",count,file);
+}
+
+void showProvisioning(Topology *net){
+	struct pipelineStats st;
+	struct feedStats fs;
+	struct autobwStats as;
+	struct srStats ss;
+	struct schedStats rs;
+	struct frrStats fr;
+	if(feed!=NULL){
+		feed->Stats(&fs);
+		printf("Link-state: %d updates, %d coalesced, %d rejected, %d batches, %d paths invalidated\n",
+				fs.received,fs.coalesced,fs.rejected,fs.batches,fs.invalidated);
+	}
+	printf("Path selection: %s\n",pathModeName(pathMode));
+	requests->Stats(&rs);
+	printf("Path requests: %d submitted, %d merged, %d shed, %d computed in %d batches, %d queued\n",
+			rs.submitted,rs.merged,rs.shed,rs.computed,rs.batches,rs.queued);
+	printf("Bookings: %d\n",calendar->Bookings());
+	frr->Stats(&fr);
+	printf("Reroutes: %d failures, %d tunnels affected, %d on a new path, %d without path, %d P2MP branches, last %d ms\n",
+			fr.events,fr.affected,fr.rerouted,fr.failed,fr.branches,fr.lastMs);
+	if(autobw!=NULL){
+		autobw->Stats(&as);
+		printf("Auto-bandwidth: %d samples, %d rejected, %d intervals, %d tunnels resized, %d on a new path, %d without capacity\n",
+				as.samples,as.rejected,as.intervals,as.resized,as.rerouted,as.failed);
+	}
+	if(segments!=NULL){
+		net->Lock();
+		segments->Stats(&ss);
+		net->Unlock();
+		printf("Segment routing: %d paths, %d SIDs for %d hops, %d over the max SID depth\n",ss.encoded,
+				ss.sids,ss.hops,ss.tooDeep);
+	}
+	printf("LSPs: %d pending, %d up, %d failed\n",lsps->Count(LSP_PENDING),lsps->Count(LSP_UP),
+			lsps->Count(LSP_FAILED));
+	if(pipeline==NULL)
+		return;
+	pipeline->Stats(&st);
+	printf("Queue depth: %d (longest lane %d)\n",st.depth,st.maxLane);
+	printf("Operations: %d submitted, %d completed, %d failed, %d retries\n",st.submitted,
+			st.completed,st.failed,st.retries);
+}
+
+static bool configureRouter(int node, void *arg){
+	Topology *net = (Topology*) arg;
+	return pool->ConfigureNet(node,net->Matrix());
+}
+
+void configureNet(Topology *net,int nodes){
+	int failed = FanOut(nodes,FANOUT_PARALLEL,configureRouter,net,"Configuration of",NULL);
+	printf("%d routers configured, %d failed\n",nodes-failed,failed);
 }
 
 void configureNetdemo(Topology *net,int nodes){
 	showConfigureNet(net->LoopArray(),net->Matrix(),nodes);
 }
 
+static bool pingRouter(int node, void *arg){
+	Topology *net = (Topology*) arg;
+	char command[CHAR_COMMAND];
+	int64_t span = TraceBegin();
+	snprintf(command,CHAR_COMMAND,"ping %s -c 3 > /dev/null",net->LoopArray()[node].loopAddr);
+	bool ok = system(command)==0;
+	TraceEnd("provision","ping",span,node);
+	return ok;
+}
+
+//Ping all the loopback addresses at the same time
+void testNet(Topology *net,int nodes){
+	printf("test\n");
+	int failed = FanOut(nodes,FANOUT_PARALLEL,pingRouter,net,"Ping of",NULL);
+	printf("test ended: %d routers reachable, %d unreachable\n",nodes-failed,failed);
+}
+
 //Conversion from int to string
 char *itoa(int i)
 {
@@ -0,0 +1,284 @@
+/*
+ * lsp_table.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Table of the LSPs installed by the PCE, with path and reserved
+ * 				capacity, so that a reservation can be given back when the
+ * 				tunnel fails or is removed. Every link has the list of the
+ * 				LSPs holding capacity on it, for the reroute after a failure.
+ */
+
+#include "header_project.h"
+
+#define LSP_TABLE_INIT 64
+
+//The LSP stays in the lists of the links of its path
+static bool onLinks(enum lspState state){
+	return state==LSP_PENDING || state==LSP_UP || state==LSP_REROUTING;
+}
+
+/******************* BEGIN LSPTABLE CLASS METHODS ******************************/
+
+//Constructor
+LspTable::LspTable(int nodes){
+
+	n = nodes;
+	size = LSP_TABLE_INIT;
+	lsps = (struct lspEntry*) calloc(size,sizeof(struct lspEntry));
+	users = (struct linkUse**) calloc(n*n,sizeof(struct linkUse*));
+	nusers = (int*) calloc(n*n,sizeof(int));
+	journal = NULL;
+	pthread_mutex_init(&mutex,NULL);
+}
+
+//Destructor
+LspTable::~LspTable(){
+
+	int i;
+	for(i=0;i<size;i++){
+		delete[] lsps[i].path;
+		free(lsps[i].slot);
+	}
+	for(i=0;i<n*n;i++)
+		free(users[i]);
+	free(users);
+	free(nusers);
+	free(lsps);
+	pthread_mutex_destroy(&mutex);
+}
+
+/* The LSP in the lists of the links of its path (add) or out of them; the
+ * last LSP of a list takes the place of the one removed */
+void LspTable::Index(int id, bool add){
+
+	struct lspEntry *e = &lsps[id];
+	struct linkUse *u;
+	int h,k,c;
+
+	if(add==(e->slot!=NULL))
+		return;
+	if(add)
+		e->slot = (int*) malloc((e->size>1?e->size-1:1)*sizeof(int));
+	for(h=0;h<e->size-1;h++){
+		k = e->path[h]*n+e->path[h+1];
+		if(add){
+			c = nusers[k];
+			if((c&(c-1))==0)
+				users[k] = (struct linkUse*) realloc(users[k],(c>0?2*c:1)*sizeof(struct linkUse));
+			users[k][c].id = id;
+			users[k][c].hop = h;
+			e->slot[h] = nusers[k]++;
+		}
+		else{
+			u = &users[k][--nusers[k]];
+			users[k][e->slot[h]] = *u;
+			lsps[u->id].slot[u->hop] = e->slot[h];
+		}
+	}
+	if(!add){
+		free(e->slot);
+		e->slot = NULL;
+	}
+}
+
+//LSPs with capacity on the link i->j (table locked)
+struct linkUse * LspTable::OnLink(int i, int j, int *count){
+
+	*count = nusers[i*n+j];
+	return users[i*n+j];
+}
+
+void LspTable::Lock(){
+	pthread_mutex_lock(&mutex);
+}
+
+void LspTable::Unlock(){
+	pthread_mutex_unlock(&mutex);
+}
+
+int LspTable::Size(){
+	return size;
+}
+
+struct lspEntry * LspTable::Find(int id){
+
+	if(id<0 || id>=size || lsps[id].state==LSP_FREE)
+		return NULL;
+	return &lsps[id];
+}
+
+//New LSP with reserved capacity, waiting for the configuration of the head-end
+void LspTable::Add(int id,int src,int dst,int capacity,int *path,int len,int priority){
+
+	pthread_mutex_lock(&mutex);
+	Place(id,src,dst,capacity,path,len,priority,-1);
+	pthread_mutex_unlock(&mutex);
+}
+
+/* As Add, with the table locked: the LSP is on the lists of its links before
+ * the topology is unlocked, so a reroute after the reservation finds it.
+ * Returns the generation of the reservation, for the configuration queued. */
+int LspTable::Place(int id,int src,int dst,int capacity,int *path,int len,int priority,int tree){
+
+	int i,old;
+
+	if(id>=size){
+		old = size;
+		while(id>=size)
+			size*=2;
+		lsps = (struct lspEntry*) realloc(lsps,size*sizeof(struct lspEntry));
+		memset(&lsps[old],0,(size-old)*sizeof(struct lspEntry));
+	}
+	Index(id,false);
+	delete[] lsps[id].path;
+	lsps[id].state = LSP_PENDING;
+	lsps[id].src = src;
+	lsps[id].dst = dst;
+	lsps[id].capacity = capacity;
+	lsps[id].size = len;
+	lsps[id].tree = tree;
+	lsps[id].priority = priority;
+	lsps[id].path = new int[len];
+	for(i=0;i<len;i++)
+		lsps[id].path[i] = path[i];
+	Index(id,true);
+	return ++lsps[id].gen;
+}
+
+//Only a pending LSP goes up: a failed or released one keeps its state
+void LspTable::SetState(int id, enum lspState state){
+
+	pthread_mutex_lock(&mutex);
+	if(Find(id)!=NULL && (state!=LSP_UP || lsps[id].state==LSP_PENDING)){
+		lsps[id].state = state;
+		if(!onLinks(state))
+			Index(id,false);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* The configuration of the reservation gen is on the head-end: nothing is
+ * done if the LSP has been released or given a new reservation since */
+void LspTable::Confirm(int id, int gen){
+
+	pthread_mutex_lock(&mutex);
+	if(Find(id)!=NULL && lsps[id].gen==gen && lsps[id].state==LSP_PENDING)
+		lsps[id].state = LSP_UP;
+	pthread_mutex_unlock(&mutex);
+}
+
+void LspTable::SetTree(int id, int tree){
+
+	pthread_mutex_lock(&mutex);
+	if(Find(id)!=NULL)
+		lsps[id].tree = tree;
+	pthread_mutex_unlock(&mutex);
+}
+
+/* Give back the capacity of an LSP on a link that went down, while its new
+ * path is computed; called with the table and the topology locked, so that
+ * a checkpoint of the topology has the journal record of the release. */
+void LspTable::Unreserve(int id, Topology *net){
+
+	struct lspEntry *e = &lsps[id];
+
+	net->UpdateTopology(e->path,e->size,-e->capacity);
+	if(journal!=NULL)
+		journal->Release(id,LSP_REROUTING);
+	e->state = LSP_REROUTING;
+	e->gen++;
+}
+
+/* New capacity (and path, if not the one of the entry) of an LSP whose
+ * reservation has already been changed on the topology; called with the
+ * table and the topology locked. The journal gets the release of the old
+ * reservation, unless the LSP is being rerouted and has already released
+ * it, and the new one. Returns the generation of the new reservation. */
+int LspTable::Resize(int id, int capacity, int *path, int len){
+
+	struct lspEntry *e = &lsps[id];
+	int i;
+
+	if(path!=e->path){
+		Index(id,false);
+		delete[] e->path;
+		e->path = new int[len];
+		for(i=0;i<len;i++)
+			e->path[i] = path[i];
+		e->size = len;
+		Index(id,true);
+	}
+	e->capacity = capacity;
+	if(journal!=NULL && e->state!=LSP_REROUTING)
+		journal->Release(id,e->state);
+	if(e->state==LSP_REROUTING)
+		e->state = LSP_UP;
+	if(journal!=NULL)
+		journal->Reserve(id,e->src,e->dst,capacity,e->path,e->size,e->tree,e->priority);
+	return ++e->gen;
+}
+
+/* Give back the capacity reserved on the path and move the LSP in the new state.
+ * Nothing is done if the LSP has already been released; an LSP being
+ * rerouted has no capacity to give back and only changes state. With gen,
+ * only the reservation of that generation is released. */
+bool LspTable::Release(int id, Topology *net, enum lspState state, int gen){
+
+	struct lspEntry *e;
+	bool done = false;
+
+	pthread_mutex_lock(&mutex);
+	e = Find(id);
+	if(e!=NULL && onLinks(e->state) && (gen==-1 || e->gen==gen)){
+		net->Lock();
+		if(e->state!=LSP_REROUTING)
+			net->UpdateTopology(e->path,e->size,-e->capacity);
+		if(journal!=NULL)
+			journal->Release(id,state);
+		net->Unlock();
+		e->state = state;
+		e->gen++;
+		if(!onLinks(state))
+			Index(id,false);
+		done = true;
+	}
+	pthread_mutex_unlock(&mutex);
+	return done;
+}
+
+/* The LSP moves in the new state, its capacity has already been given back
+ * on the topology by the caller (table and topology locked) */
+void LspTable::Drop(int id, enum lspState state){
+
+	struct lspEntry *e = &lsps[id];
+
+	if(journal!=NULL)
+		journal->Release(id,state);
+	e->state = state;
+	e->gen++;
+	Index(id,false);
+}
+
+int LspTable::Count(enum lspState state){
+
+	int i,c = 0;
+	pthread_mutex_lock(&mutex);
+	for(i=0;i<size;i++)
+		if(lsps[i].state==state)
+			c++;
+	pthread_mutex_unlock(&mutex);
+	return c;
+}
+
+void LspTable::SetJournal(Journal *j){
+	journal = j;
+}
+
+//Reservations logged so far are on disk when it returns
+void LspTable::Sync(){
+
+	if(journal!=NULL)
+		journal->Commit(journal->Seq());
+}
+
+/******************* END LSPTABLE CLASS METHODS ********************************/
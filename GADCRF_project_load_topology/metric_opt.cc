@@ -0,0 +1,347 @@
+/*
+ * metric_opt.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Offline optimization of the IGP metrics for a traffic matrix.
+ * 				The demands are routed on the shortest paths with ECMP (equal
+ * 				split on all the next hops of a router) and a local search
+ * 				changes one metric at a time to lower the highest utilization
+ * 				(then the sum of the utilizations). The candidates of a step
+ * 				are evaluated in parallel; a candidate only routes again the
+ * 				destinations whose shortest paths cross the changed link.
+ */
+
+#include "header_project.h"
+
+//Change of one metric evaluated in a step
+struct metricCandidate{
+	int link;
+	int weight;
+	double maxUtil;
+	double sumUtil;
+};
+
+/* Traffic matrix from a file, one demand per line: <src> <dst> <rate>
+ * (same unit as the capacity of the links) */
+struct tmDemand * ReadTrafficMatrix(const char *file, int nodes, int *count){
+
+	struct tmDemand *d = NULL;
+	char line[CHAR_COMMAND];
+	FILE *Ptr;
+	int src,dst;
+	double rate;
+
+	*count = 0;
+	if((Ptr=fopen(file,"r"))==NULL){
+		printf("Error opening %s\n",file);
+		return NULL;
+	}
+	while(fgets(line,CHAR_COMMAND,Ptr)!=NULL){
+		if(line[0]=='#' || sscanf(line,"%d %d %lf",&src,&dst,&rate)!=3)
+			continue;
+		if(src<0 || src>=nodes || dst<0 || dst>=nodes || src==dst || rate<=0){
+			printf("Demand not valid: %s",line);
+			continue;
+		}
+		if((*count&(*count-1))==0)
+			d = (struct tmDemand*) realloc(d,(*count>0?2*(*count):1)*sizeof(struct tmDemand));
+		d[*count].src = src;
+		d[*count].dst = dst;
+		d[(*count)++].rate = rate;
+	}
+	fclose(Ptr);
+	return d;
+}
+
+/******************* BEGIN METRICOPTIMIZER CLASS METHODS ***********************/
+
+//Constructor: links and IGP metrics of the matrix
+MetricOptimizer::MetricOptimizer(struct topologyLink **net, int nodes, struct tmDemand *d, int count){
+
+	int i,j,k;
+
+	n = nodes;
+	m = 0;
+	for(i=0;i<n;i++)
+		for(j=0;j<n;j++)
+			if(net[i][j].capacity!=-1)
+				m++;
+	lsrc = (int*) malloc(m*sizeof(int));
+	ldst = (int*) malloc(m*sizeof(int));
+	cap = (double*) malloc(m*sizeof(double));
+	w = (int*) malloc(m*sizeof(int));
+	firstIn = (int*) calloc(n+1,sizeof(int));
+	in = (int*) malloc(m*sizeof(int));
+	firstOut = (int*) calloc(n+1,sizeof(int));
+	out = (int*) malloc(m*sizeof(int));
+	k = 0;
+	for(i=0;i<n;i++)
+		for(j=0;j<n;j++)
+			if(net[i][j].capacity!=-1){
+				lsrc[k] = i;
+				ldst[k] = j;
+				cap[k] = (net[i][j].capacity>0)?net[i][j].capacity:1;
+				w[k] = linkIgpMetric(&net[i][j]);
+				firstOut[i+1]++;
+				firstIn[j+1]++;
+				k++;
+			}
+	//Links entering and leaving every router, as positions in the arrays above
+	for(i=0;i<n;i++){
+		firstOut[i+1]+=firstOut[i];
+		firstIn[i+1]+=firstIn[i];
+	}
+	int posIn[n],posOut[n];
+	for(i=0;i<n;i++){
+		posIn[i] = firstIn[i];
+		posOut[i] = firstOut[i];
+	}
+	for(k=0;k<m;k++){
+		out[posOut[lsrc[k]]++] = k;
+		in[posIn[ldst[k]]++] = k;
+	}
+
+	demand = (double*) calloc(n*n,sizeof(double));
+	for(k=0;k<count;k++)
+		demand[d[k].src*n+d[k].dst]+=d[k].rate;
+
+	dist = (int*) malloc(n*n*sizeof(int));
+	load = (double*) calloc(n*m,sizeof(double));
+	total = (double*) calloc(m,sizeof(double));
+	cand = (struct metricCandidate*) malloc(METRIC_CANDIDATES*sizeof(struct metricCandidate));
+	for(i=0;i<n;i++)
+		Route(i,-1,0,&dist[i*n],&load[i*m]);
+	for(i=0;i<n;i++)
+		for(k=0;k<m;k++)
+			total[k]+=load[i*m+k];
+}
+
+//Destructor
+MetricOptimizer::~MetricOptimizer(){
+
+	free(lsrc);
+	free(ldst);
+	free(cap);
+	free(w);
+	free(firstIn);
+	free(in);
+	free(firstOut);
+	free(out);
+	free(demand);
+	free(dist);
+	free(load);
+	free(total);
+	free(cand);
+}
+
+/* Distances of all the routers from destination t and the load of its
+ * demands with ECMP, with link c at weight cw (c = -1: current metrics) */
+void MetricOptimizer::Route(int t, int c, int cw, int *d, double *ld){
+
+	bool done[n];
+	int order[n];
+	double flow[n];
+	int u,v,x,k,a,cnt,nhops;
+	double share;
+
+	for(v=0;v<n;v++){
+		d[v] = -1;
+		done[v] = false;
+		flow[v] = demand[v*n+t];
+	}
+	for(k=0;k<m;k++)
+		ld[k] = 0;
+	d[t] = 0;
+	//Dijkstra towards t on the links entering the settled routers
+	for(cnt=0;cnt<n;cnt++){
+		x = -1;
+		for(v=0;v<n;v++)
+			if(!done[v] && d[v]!=-1 && (x==-1 || d[v]<d[x]))
+				x = v;
+		if(x==-1)
+			break;
+		done[x] = true;
+		order[cnt] = x;
+		for(a=firstIn[x];a<firstIn[x+1];a++){
+			k = in[a];
+			u = lsrc[k];
+			if(!done[u] && (d[u]==-1 || d[x]+((k==c)?cw:w[k])<d[u]))
+				d[u] = d[x]+((k==c)?cw:w[k]);
+		}
+	}
+	//From the farthest router, the flow is split on all the shortest next hops
+	while(--cnt>0){
+		u = order[cnt];
+		if(flow[u]==0)
+			continue;
+		nhops = 0;
+		for(a=firstOut[u];a<firstOut[u+1];a++){
+			k = out[a];
+			if(d[ldst[k]]!=-1 && d[ldst[k]]+((k==c)?cw:w[k])==d[u])
+				nhops++;
+		}
+		share = flow[u]/nhops;
+		for(a=firstOut[u];a<firstOut[u+1];a++){
+			k = out[a];
+			if(d[ldst[k]]!=-1 && d[ldst[k]]+((k==c)?cw:w[k])==d[u]){
+				ld[k]+=share;
+				flow[ldst[k]]+=share;
+			}
+		}
+	}
+}
+
+/* A new weight of link k changes the routes to t only if the link is on a
+ * shortest path to t (higher weight) or becomes one (lower weight) */
+bool MetricOptimizer::Affected(int t, int k, int weight){
+
+	int du = dist[t*n+lsrc[k]],dv = dist[t*n+ldst[k]];
+
+	if(dv==-1)
+		return false;
+	if(weight>w[k])
+		return du==dv+w[k];
+	return du==-1 || dv+weight<=du;
+}
+
+void MetricOptimizer::Utilization(double *tot, double *maxUtil, double *sumUtil){
+
+	int k;
+
+	*maxUtil = 0;
+	*sumUtil = 0;
+	for(k=0;k<m;k++){
+		if(tot[k]/cap[k]>*maxUtil)
+			*maxUtil = tot[k]/cap[k];
+		*sumUtil+=tot[k]/cap[k];
+	}
+}
+
+//Utilization with one candidate, computed by the threads of FanOut
+bool MetricOptimizer::Evaluate(int c, void *arg){
+
+	MetricOptimizer *o = (MetricOptimizer*) arg;
+	struct metricCandidate *mc = &o->cand[c];
+	double *tot,*ld;
+	int *d,t,k;
+
+	tot = (double*) malloc(o->m*sizeof(double));
+	ld = (double*) malloc(o->m*sizeof(double));
+	d = (int*) malloc(o->n*sizeof(int));
+	memcpy(tot,o->total,o->m*sizeof(double));
+	for(t=0;t<o->n;t++){
+		if(!o->Affected(t,mc->link,mc->weight))
+			continue;
+		o->Route(t,mc->link,mc->weight,d,ld);
+		for(k=0;k<o->m;k++)
+			tot[k]+=ld[k]-o->load[t*o->m+k];
+	}
+	o->Utilization(tot,&mc->maxUtil,&mc->sumUtil);
+	free(tot);
+	free(ld);
+	free(d);
+	return true;
+}
+
+//The candidate becomes the current solution
+void MetricOptimizer::Apply(int k, int weight){
+
+	int t,i;
+	bool affected[n];
+
+	for(t=0;t<n;t++)
+		affected[t] = Affected(t,k,weight);
+	w[k] = weight;
+	for(t=0;t<n;t++){
+		if(!affected[t])
+			continue;
+		for(i=0;i<m;i++)
+			total[i]-=load[t*m+i];
+		Route(t,-1,0,&dist[t*n],&load[t*m]);
+		for(i=0;i<m;i++)
+			total[i]+=load[t*m+i];
+	}
+}
+
+static bool better(double max1, double sum1, double max2, double sum2){
+
+	if(max1<max2-METRIC_EPSILON)
+		return true;
+	return max1<=max2+METRIC_EPSILON && sum1<sum2-METRIC_EPSILON;
+}
+
+/* Local search: every step tries METRIC_CANDIDATES changes, half of them on
+ * the most loaded links (a higher metric moves traffic away from them) and
+ * half at random, and keeps the best one if it is an improvement. The
+ * search ends after METRIC_PATIENCE steps without improvement. */
+double MetricOptimizer::Run(int steps){
+
+	double maxUtil,sumUtil;
+	int s,c,k,best,idle = 0,hot[METRIC_CANDIDATES],nhot,i;
+
+	srand(1);
+	Utilization(total,&maxUtil,&sumUtil);
+	for(s=0;s<steps && idle<METRIC_PATIENCE && m>0;s++){
+		//Links sorted by utilization, the first ones get a higher metric
+		nhot = 0;
+		for(k=0;k<m;k++){
+			for(i=nhot;i>0 && total[k]/cap[k]>total[hot[i-1]]/cap[hot[i-1]];i--)
+				if(i<METRIC_CANDIDATES/2)
+					hot[i] = hot[i-1];
+			if(i<METRIC_CANDIDATES/2){
+				hot[i] = k;
+				if(nhot<METRIC_CANDIDATES/2)
+					nhot++;
+			}
+		}
+		for(c=0;c<METRIC_CANDIDATES;c++){
+			if(c<nhot && w[hot[c]]<METRIC_MAX){
+				cand[c].link = hot[c];
+				cand[c].weight = w[hot[c]]+1+rand()%3;
+				if(cand[c].weight>METRIC_MAX)
+					cand[c].weight = METRIC_MAX;
+			}
+			else{
+				cand[c].link = rand()%m;
+				do
+					cand[c].weight = 1+rand()%METRIC_MAX;
+				while(METRIC_MAX>1 && cand[c].weight==w[cand[c].link]);
+			}
+		}
+		FanOut(METRIC_CANDIDATES,METRIC_PARALLEL,Evaluate,this,NULL,NULL);
+
+		best = -1;
+		for(c=0;c<METRIC_CANDIDATES;c++)
+			if(cand[c].weight!=w[cand[c].link] && better(cand[c].maxUtil,cand[c].sumUtil,
+					(best==-1)?maxUtil:cand[best].maxUtil,(best==-1)?sumUtil:cand[best].sumUtil))
+				best = c;
+		if(best==-1){
+			idle++;
+			continue;
+		}
+		idle = 0;
+		Apply(cand[best].link,cand[best].weight);
+		Utilization(total,&maxUtil,&sumUtil);
+		if(DEBUG)
+			printf("Step %d: metric of %d->%d = %d, max utilization %.3f\n",s,lsrc[cand[best].link],
+					ldst[cand[best].link],cand[best].weight,maxUtil);
+	}
+	return maxUtil;
+}
+
+double MetricOptimizer::MaxUtil(){
+
+	double maxUtil,sumUtil;
+	Utilization(total,&maxUtil,&sumUtil);
+	return maxUtil;
+}
+
+//Metric of every link i->j of the solution
+void MetricOptimizer::Metrics(int *metric){
+
+	int k;
+	for(k=0;k<m;k++)
+		metric[lsrc[k]*n+ldst[k]] = w[k];
+}
+
+/******************* END METRICOPTIMIZER CLASS METHODS *************************/
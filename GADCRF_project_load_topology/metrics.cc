@@ -0,0 +1,308 @@
+/*
+ * metrics.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Metrics of the PCE in the Prometheus text format, served by
+ * 				the libpdel HTTP server on /metrics. Counters and the latency
+ * 				histogram of the path computations are kept in one shard per
+ * 				thread, written only by their thread and summed when scraped,
+ * 				so the threads that count never wait for a scrape. The other
+ * 				values (LSPs, queues, link utilization, typed memory) are read
+ * 				when scraped. A recurring timer on the event loop of the server
+ * 				measures how late the loop runs its events.
+ */
+
+#include "header_project.h"
+#include <openssl/ssl.h>
+#include <signal.h>
+#include <pdel/util/typed_mem.h>
+#include <pdel/util/pevent.h>
+#include <pdel/http/http_server.h>
+#include <pdel/http/http_servlet.h>
+
+struct statShard{
+	struct threadSlot slot;
+	u_int64_t counters[STAT_COUNTERS];
+	u_int64_t latency[STAT_BUCKETS];			//Computations under 2^k microseconds
+	u_int64_t latencySum;						//Microseconds
+};
+
+static ThreadSlots shards(sizeof(struct statShard));
+static __thread struct statShard *mine = NULL;
+
+static const char *counterNames[STAT_COUNTERS][2] = {
+	{"pce_lsp_requests_total","LSPs asked to the PCE"},
+	{"pce_lsp_admitted_total","LSPs with a path and capacity reserved"},
+	{"pce_paths_total","Path computations"},
+	{"pce_paths_none_total","Path computations without a path"},
+	{"pce_provision_ops_total","Operations sent to the head-ends"},
+	{"pce_provision_failed_total","Operations the head-ends did not take"},
+	{"pce_feed_lines_total","Lines read from the feeds"}
+};
+
+/* Shard of the calling thread, taken from the pool the first time; a shard
+ * keeps its counts when its thread ends */
+static struct statShard * threadShard(){
+
+	if(mine==NULL)
+		mine = (struct statShard*) shards.Take();
+	return mine;
+}
+
+//Only the thread of the shard writes it, the scrape reads a value at a time
+static void bump(u_int64_t *v, u_int64_t add){
+	__atomic_store_n(v,*v+add,__ATOMIC_RELAXED);
+}
+
+int64_t StatClock(){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+//Milliseconds since from (CLOCK_MONOTONIC)
+int elapsed(struct timespec *from){
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (now.tv_sec-from->tv_sec)*1000+(now.tv_nsec-from->tv_nsec)/1000000;
+}
+
+void StatAdd(enum statCounter c, int v){
+	bump(&threadShard()->counters[c],v);
+}
+
+//Path computation from start (StatClock) to now
+void StatPath(int64_t start, bool found){
+
+	struct statShard *s = threadShard();
+	int64_t us = StatClock()-start;
+	int k = 0;
+
+	while(k<STAT_BUCKETS-1 && us>=((int64_t)1<<k))
+		k++;
+	bump(&s->latency[k],1);
+	bump(&s->latencySum,us);
+	bump(&s->counters[STAT_PATHS],1);
+	if(!found)
+		bump(&s->counters[STAT_PATHS_NONE],1);
+}
+
+/* Quantile q of the latency from the histogram, interpolated inside its
+ * bucket, in seconds */
+static double quantile(u_int64_t *h, u_int64_t count, double q){
+
+	double rank = q*count,low,high;
+	u_int64_t seen = 0;
+	int k;
+
+	if(count==0)
+		return 0;
+	for(k=0;k<STAT_BUCKETS;k++){
+		if(seen+h[k]>=rank && h[k]>0){
+			low = (k==0)?0:(double)((int64_t)1<<(k-1));
+			high = (double)((int64_t)1<<k);
+			return (low+(high-low)*(rank-seen)/h[k])/1e6;
+		}
+		seen+=h[k];
+	}
+	return (double)((int64_t)1<<(STAT_BUCKETS-1))/1e6;
+}
+
+/******************* BEGIN METRICSSERVER CLASS METHODS *************************/
+
+//Constructor, the server listens on port of all the addresses
+MetricsServer::MetricsServer(Topology *t, LspTable *lt, PathScheduler *ps, ProvisionPipeline *p,
+		ProvisionQueue *q, int nodes, int port){
+
+	struct in_addr any;
+
+	net = t;
+	table = lt;
+	scheduler = ps;
+	pipeline = p;
+	queue = q;
+	n = nodes;
+	lag = 0;
+	maxLag = 0;
+	tick = NULL;
+	server = NULL;
+	pthread_mutex_init(&mutex,NULL);
+	servlet = (struct http_servlet*) calloc(1,sizeof(struct http_servlet));
+	servlet->arg = this;
+	servlet->run = Serve;
+	servlet->destroy = Destroy;
+	any.s_addr = htonl(INADDR_ANY);
+	//The server writes the replies with stdio: a client gone would kill the PCE
+	signal(SIGPIPE,SIG_IGN);
+	if((ctx=pevent_ctx_create("pce.metrics",NULL))==NULL){
+		printf("Metrics: event loop not created\n");
+		return;
+	}
+	if((server=http_server_start(ctx,any,port,NULL,"pce",NULL))==NULL
+			|| http_server_register_servlet(server,servlet,NULL,"^/metrics$",0)==-1){
+		printf("Metrics: server not started on port %d: %s\n",port,strerror(errno));
+		http_server_stop(&server);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC,&last);
+	pevent_register(ctx,&tick,PEVENT_RECURRING,NULL,Tick,this,PEVENT_TIME,METRICS_TICK);
+	printf("Metrics on port %d, /metrics\n",port);
+}
+
+//Destructor
+MetricsServer::~MetricsServer(){
+
+	pevent_unregister(&tick);
+	http_server_stop(&server);
+	pevent_ctx_destroy(&ctx);
+	free(servlet);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool MetricsServer::Ok(){
+	return server!=NULL;
+}
+
+//The servlet is freed with the object
+void MetricsServer::Destroy(struct http_servlet *s){
+}
+
+//Delay of the recurring timer over METRICS_TICK: how late the loop runs its events
+void MetricsServer::Tick(void *arg){
+
+	MetricsServer *m = (MetricsServer*) arg;
+	struct timespec now;
+	int64_t late;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	late = (now.tv_sec-m->last.tv_sec)*1000000+(now.tv_nsec-m->last.tv_nsec)/1000-METRICS_TICK*1000;
+	if(late<0)
+		late = 0;
+	pthread_mutex_lock(&m->mutex);
+	m->last = now;
+	m->lag = late;
+	if(late>m->maxLag)
+		m->maxLag = late;
+	pthread_mutex_unlock(&m->mutex);
+}
+
+//1: request served, -1: error reported by the server
+int MetricsServer::Serve(struct http_servlet *s, struct http_request *req, struct http_response *resp){
+
+	MetricsServer *m = (MetricsServer*) s->arg;
+	FILE *fp;
+
+	http_response_set_header(resp,0,"Content-Type","text/plain; version=0.0.4");
+	if((fp=http_response_get_output(resp,1))==NULL)
+		return -1;
+	m->Write(fp);
+	return 1;
+}
+
+void MetricsServer::Write(FILE *fp){
+
+	struct threadSlot *slot;
+	struct statShard *s;
+	struct typed_mem_stats mem;
+	struct pipelineStats ps;
+	struct schedStats ss;
+	struct topologyLink **mx;
+	u_int64_t counters[STAT_COUNTERS],hist[STAT_BUCKETS],sum = 0,count = 0;
+	int k,i,j,nshards = 0,pending,up,failed;
+	int64_t lagNow,lagMax;
+	double *util;
+
+	//Counters of all the shards, also of the threads that ended
+	memset(counters,0,sizeof(counters));
+	memset(hist,0,sizeof(hist));
+	for(slot=shards.First();slot!=NULL;slot=slot->next){
+		s = (struct statShard*) slot;
+		for(k=0;k<STAT_COUNTERS;k++)
+			counters[k]+=__atomic_load_n(&s->counters[k],__ATOMIC_RELAXED);
+		for(k=0;k<STAT_BUCKETS;k++)
+			hist[k]+=__atomic_load_n(&s->latency[k],__ATOMIC_RELAXED);
+		sum+=__atomic_load_n(&s->latencySum,__ATOMIC_RELAXED);
+		nshards++;
+	}
+	for(k=0;k<STAT_BUCKETS;k++)
+		count+=hist[k];
+	for(k=0;k<STAT_COUNTERS;k++)
+		fprintf(fp,"# HELP %s %s\n# TYPE %s counter\n%s %llu\n",counterNames[k][0],counterNames[k][1],
+				counterNames[k][0],counterNames[k][0],(unsigned long long)counters[k]);
+	fprintf(fp,"# HELP pce_path_latency_seconds Time of a path computation\n");
+	fprintf(fp,"# TYPE pce_path_latency_seconds summary\n");
+	fprintf(fp,"pce_path_latency_seconds{quantile=\"0.5\"} %g\n",quantile(hist,count,0.5));
+	fprintf(fp,"pce_path_latency_seconds{quantile=\"0.9\"} %g\n",quantile(hist,count,0.9));
+	fprintf(fp,"pce_path_latency_seconds{quantile=\"0.99\"} %g\n",quantile(hist,count,0.99));
+	fprintf(fp,"pce_path_latency_seconds_sum %g\n",sum/1e6);
+	fprintf(fp,"pce_path_latency_seconds_count %llu\n",(unsigned long long)count);
+	fprintf(fp,"# HELP pce_stat_shards Threads that counted, running or ended\n");
+	fprintf(fp,"# TYPE pce_stat_shards gauge\npce_stat_shards %d\n",nshards);
+
+	scheduler->Stats(&ss);
+	fprintf(fp,"# HELP pce_path_requests_total Path requests by outcome\n");
+	fprintf(fp,"# TYPE pce_path_requests_total counter\n");
+	fprintf(fp,"pce_path_requests_total{outcome=\"merged\"} %d\n",ss.merged);
+	fprintf(fp,"pce_path_requests_total{outcome=\"shed\"} %d\n",ss.shed);
+	fprintf(fp,"pce_path_requests_total{outcome=\"computed\"} %d\n",ss.computed);
+	fprintf(fp,"# HELP pce_path_requests_queued Path requests waiting for a worker\n");
+	fprintf(fp,"# TYPE pce_path_requests_queued gauge\npce_path_requests_queued %d\n",ss.queued);
+
+	pending = table->Count(LSP_PENDING);
+	up = table->Count(LSP_UP);
+	failed = table->Count(LSP_FAILED);
+	fprintf(fp,"# HELP pce_lsps LSPs of the table by state\n# TYPE pce_lsps gauge\n");
+	fprintf(fp,"pce_lsps{state=\"pending\"} %d\npce_lsps{state=\"up\"} %d\npce_lsps{state=\"failed\"} %d\n",
+			pending,up,failed);
+
+	fprintf(fp,"# HELP pce_provision_queue_depth Operations queued or in progress\n");
+	fprintf(fp,"# TYPE pce_provision_queue_depth gauge\n");
+	if(pipeline!=NULL){
+		pipeline->Stats(&ps);
+		fprintf(fp,"pce_provision_queue_depth %d\n",ps.depth);
+	}
+	else
+		fprintf(fp,"pce_provision_queue_depth %d\n",queue->Pending());
+
+	//Utilization copied under the lock, written after
+	util = (double*) malloc(n*n*sizeof(double));
+	net->Lock();
+	mx = net->Matrix();
+	for(i=0;i<n;i++)
+		for(j=0;j<n;j++)
+			util[i*n+j] = (mx[i][j].capacity>0)?(double)mx[i][j].used/mx[i][j].capacity:-1;
+	net->Unlock();
+	fprintf(fp,"# HELP pce_link_utilization Reserved over capacity of the links up\n");
+	fprintf(fp,"# TYPE pce_link_utilization gauge\n");
+	for(k=0;k<n*n;k++)
+		if(util[k]>=0)
+			fprintf(fp,"pce_link_utilization{src=\"%d\",dst=\"%d\"} %g\n",k/n,k%n,util[k]);
+	free(util);
+
+	//Only when libpdel keeps the typed memory statistics
+	if(typed_mem_usage(&mem)==0){
+		fprintf(fp,"# HELP pce_typed_mem_bytes Memory of libpdel by type\n# TYPE pce_typed_mem_bytes gauge\n");
+		for(k=0;k<(int)mem.length;k++)
+			fprintf(fp,"pce_typed_mem_bytes{type=\"%s\"} %u\n",mem.elems[k].type,mem.elems[k].bytes);
+		fprintf(fp,"# HELP pce_typed_mem_allocs Blocks of libpdel by type\n# TYPE pce_typed_mem_allocs gauge\n");
+		for(k=0;k<(int)mem.length;k++)
+			fprintf(fp,"pce_typed_mem_allocs{type=\"%s\"} %u\n",mem.elems[k].type,mem.elems[k].allocs);
+		structs_free(&typed_mem_stats_type,NULL,&mem);
+	}
+
+	pthread_mutex_lock(&mutex);
+	lagNow = lag;
+	lagMax = maxLag;
+	maxLag = 0;
+	pthread_mutex_unlock(&mutex);
+	fprintf(fp,"# HELP pce_event_loop_lag_seconds Delay of the last timer of the event loop\n");
+	fprintf(fp,"# TYPE pce_event_loop_lag_seconds gauge\npce_event_loop_lag_seconds %g\n",lagNow/1e6);
+	fprintf(fp,"# HELP pce_event_loop_lag_max_seconds Highest delay since the last scrape\n");
+	fprintf(fp,"# TYPE pce_event_loop_lag_max_seconds gauge\npce_event_loop_lag_max_seconds %g\n",lagMax/1e6);
+	fprintf(fp,"# HELP pce_event_loop_events Events registered on the event loop\n");
+	fprintf(fp,"# TYPE pce_event_loop_events gauge\npce_event_loop_events %u\n",pevent_ctx_count(ctx));
+}
+
+/******************* END METRICSSERVER CLASS METHODS ***************************/
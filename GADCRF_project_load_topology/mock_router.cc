@@ -0,0 +1,577 @@
+/*
+ * mock_router.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Simulator of the telnet CLI of the routers, used to test the
+ * 				provisioning without GNS3 or real routers. Every virtual router
+ * 				listens on its own address or port and answers the dialogue of
+ * 				cef.sh, lsp.sh and telnet_test.sh: login, configuration modes
+ * 				and show running-config. Answers can be delayed and commands
+ * 				can fail or drop the session with a given probability.
+ *
+ * Usage: mock_router <routers> [-a first_address] [-p port] [-l latency_ms]
+ * 				[-f failure_percent] [-d drop_percent]
+ *
+ * 				Without -a all the routers are on 127.0.0.1 and router i
+ * 				listens on port+i (default port 2300). With -a router i
+ * 				listens on first_address+i, all on the same port (default 23).
+ */
+
+#include "header_project.h"
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+
+#define MOCK_EVENTS 256
+#define MOCK_DEFAULT_PORT 2300
+
+enum mockKind{
+	MOCK_LISTENER,
+	MOCK_CONNECTION
+};
+
+//Block of the running configuration (interface, explicit path, router)
+struct cfgBlock{
+	char *name;
+	char **lines;
+	int nlines;
+	struct cfgBlock *next;
+};
+
+struct mockRouter{
+	enum mockKind kind;
+	int index;
+	int fd;
+	struct cfgBlock *blocks;
+	struct cfgBlock global;						//Lines outside any block
+};
+
+struct mockConn{
+	enum mockKind kind;
+	int fd;
+	struct mockRouter *router;
+	enum cliMode mode;
+	struct cfgBlock *cur;						//Block of the current sub-mode
+	char in[CHAR_COMMAND];
+	int inLen;
+	int iac;									//Telnet command: 1 command, 2 option, 3 subnegotiation
+	bool cr;
+	char *out;
+	int outLen;
+	int outSize;
+	long readyAt;								//Time when the output can be sent
+	bool queued;
+	bool closed;
+	struct mockConn *nextReady;
+};
+
+static int latency = 0;
+static int failPct = 0;
+static int dropPct = 0;
+static int epfd;
+static struct mockConn *readyHead = NULL,*readyTail = NULL;
+static long sessions = 0,commands = 0;
+static volatile bool stop = false;
+
+static long now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+/******************* RUNNING CONFIGURATION *************************************/
+
+static void addLine(struct cfgBlock *b, const char *line, bool replace){
+
+	int i,key;
+	const char *sp;
+
+	//A command replaces the one with the same keywords (all but the last word)
+	if(replace){
+		sp = strrchr(line,' ');
+		key = (sp!=NULL)?(int)(sp-line):(int)strlen(line);
+		for(i=0;i<b->nlines;i++){
+			if(strncmp(b->lines[i],line,key)==0 && (b->lines[i][key]==' ' || b->lines[i][key]=='\0')){
+				free(b->lines[i]);
+				b->lines[i] = strdup(line);
+				return;
+			}
+		}
+	}
+	else{
+		for(i=0;i<b->nlines;i++)
+			if(strcmp(b->lines[i],line)==0)
+				return;
+	}
+	b->lines = (char**) realloc(b->lines,(b->nlines+1)*sizeof(char*));
+	b->lines[b->nlines++] = strdup(line);
+}
+
+static struct cfgBlock *findBlock(struct mockRouter *r, const char *name, bool create){
+
+	struct cfgBlock **p;
+
+	for(p=&r->blocks;*p!=NULL;p=&(*p)->next)
+		if(strcmp((*p)->name,name)==0)
+			return *p;
+	if(!create)
+		return NULL;
+	*p = (struct cfgBlock*) calloc(1,sizeof(struct cfgBlock));
+	(*p)->name = strdup(name);
+	return *p;
+}
+
+static void removeBlock(struct mockRouter *r, const char *name){
+
+	struct cfgBlock **p,*b;
+	int i;
+
+	for(p=&r->blocks;*p!=NULL;p=&(*p)->next){
+		if(strcmp((*p)->name,name)==0){
+			b = *p;
+			*p = b->next;
+			for(i=0;i<b->nlines;i++)
+				free(b->lines[i]);
+			free(b->lines);
+			free(b->name);
+			free(b);
+			return;
+		}
+	}
+}
+
+/******************* OUTPUT ****************************************************/
+
+static void put(struct mockConn *c, const char *fmt, ...){
+
+	va_list ap;
+	int len;
+
+	while(1){
+		va_start(ap,fmt);
+		len = vsnprintf(c->out+c->outLen,c->outSize-c->outLen,fmt,ap);
+		va_end(ap);
+		if(c->outLen+len<c->outSize)
+			break;
+		c->outSize = 2*(c->outSize+len);
+		c->out = (char*) realloc(c->out,c->outSize);
+	}
+	c->outLen+=len;
+}
+
+static void prompt(struct mockConn *c){
+
+	const char *m = "";
+
+	switch(c->mode){
+	case CLI_CONFIG:
+		m = "(config)";
+		break;
+	case CLI_CONFIG_IF:
+		m = "(config-if)";
+		break;
+	case CLI_CONFIG_ROUTER:
+		m = "(config-router)";
+		break;
+	case CLI_EXPL_PATH:
+		m = "(cfg-ip-expl-path)";
+		break;
+	case CLI_DEST_LIST:
+		m = "(cfg-dest-list)";
+		break;
+	default:
+		break;
+	}
+	put(c,"R%d%s#",c->router->index+1,m);
+}
+
+static void enqueue(struct mockConn *c, long when){
+
+	c->readyAt = when;
+	c->queued = true;
+	c->nextReady = NULL;
+	if(readyTail!=NULL)
+		readyTail->nextReady = c;
+	else
+		readyHead = c;
+	readyTail = c;
+}
+
+//The connection is freed by the event loop, after the events already read
+static void closeConn(struct mockConn *c){
+
+	if(c->closed)
+		return;
+	epoll_ctl(epfd,EPOLL_CTL_DEL,c->fd,NULL);
+	close(c->fd);
+	c->closed = true;
+	if(!c->queued)
+		enqueue(c,now());
+}
+
+//Write what can be written now, the rest waits for the next round
+static void flush(struct mockConn *c){
+
+	int w;
+
+	while(c->outLen>0){
+		w = write(c->fd,c->out,c->outLen);
+		if(w<=0)
+			break;
+		memmove(c->out,c->out+w,c->outLen-w);
+		c->outLen-=w;
+	}
+}
+
+//Output is sent after the configured latency
+static void schedule(struct mockConn *c){
+
+	if(latency==0){
+		flush(c);
+		if(c->outLen==0)
+			return;
+	}
+	if(!c->queued)
+		enqueue(c,now()+latency);
+}
+
+static void showRunning(struct mockConn *c){
+
+	struct mockRouter *r = c->router;
+	struct cfgBlock *b;
+	int i;
+
+	put(c,"Building configuration...\r\n\r\nCurrent configuration:\r\n!\r\nhostname R%d\r\n!\r\n",r->index+1);
+	for(i=0;i<r->global.nlines;i++)
+		put(c,"%s\r\n",r->global.lines[i]);
+	put(c,"!\r\n");
+	for(b=r->blocks;b!=NULL;b=b->next){
+		put(c,"%s\r\n",b->name);
+		for(i=0;i<b->nlines;i++)
+			put(c," %s\r\n",b->lines[i]);
+		put(c,"!\r\n");
+	}
+	put(c,"end\r\n\r\n");
+}
+
+/******************* COMMANDS **************************************************/
+
+static bool prefix(const char *cmd, const char *p){
+	return strncmp(cmd,p,strlen(p))==0;
+}
+
+//Commands accepted in every configuration mode
+static bool globalCommand(struct mockConn *c, const char *cmd){
+
+	struct mockRouter *r = c->router;
+
+	if(prefix(cmd,"interface ")){
+		c->cur = findBlock(r,cmd,true);
+		c->mode = CLI_CONFIG_IF;
+	}
+	else if(prefix(cmd,"ip explicit-path name ")){
+		c->cur = findBlock(r,cmd,true);
+		c->mode = CLI_EXPL_PATH;
+	}
+	else if(prefix(cmd,"mpls traffic-eng destination list name ")){
+		c->cur = findBlock(r,cmd,true);
+		c->mode = CLI_DEST_LIST;
+	}
+	else if(prefix(cmd,"router ")){
+		c->cur = findBlock(r,cmd,true);
+		c->mode = CLI_CONFIG_ROUTER;
+	}
+	else if(prefix(cmd,"no interface ")){
+		char name[CHAR_COMMAND];
+		snprintf(name,CHAR_COMMAND,"%s",cmd+3);
+		removeBlock(r,name);
+		c->mode = CLI_CONFIG;
+	}
+	else if(prefix(cmd,"no ip explicit-path name ")){
+		char name[CHAR_COMMAND];
+		snprintf(name,CHAR_COMMAND,"%s enable",cmd+3);
+		c->mode = CLI_CONFIG;
+		if(findBlock(r,name,false)==NULL){
+			put(c,"%% Explicit-path does not exist\r\n");
+			return true;
+		}
+		removeBlock(r,name);
+	}
+	else if(strcmp(cmd,"end")==0)
+		c->mode = CLI_EXEC;
+	else
+		return false;
+	return true;
+}
+
+static void command(struct mockConn *c, char *cmd){
+
+	struct mockRouter *r = c->router;
+
+	if(c->mode==CLI_USERNAME_PROMPT){
+		put(c,"%s\r\nPassword: ",cmd);
+		c->mode = CLI_PASSWORD_PROMPT;
+		return;
+	}
+	if(c->mode==CLI_PASSWORD_PROMPT){
+		if(strcmp(cmd,CLI_PASSWORD)==0){
+			c->mode = CLI_EXEC;
+			put(c,"\r\n");
+			prompt(c);
+		}
+		else{
+			put(c,"\r\n%% Login invalid\r\n\r\nUsername: ");
+			c->mode = CLI_USERNAME_PROMPT;
+		}
+		return;
+	}
+
+	put(c,"%s\r\n",cmd);
+	if(cmd[0]=='\0'){
+		prompt(c);
+		return;
+	}
+	commands++;
+	if(dropPct>0 && rand()%100<dropPct){
+		closeConn(c);
+		return;
+	}
+	if(failPct>0 && c->mode!=CLI_EXEC && rand()%100<failPct){
+		put(c,"%% Invalid input detected at '^' marker.\r\n\r\n");
+		prompt(c);
+		return;
+	}
+
+	switch(c->mode){
+	case CLI_EXEC:
+		if(strcmp(cmd,"config t")==0 || strcmp(cmd,"configure terminal")==0)
+			c->mode = CLI_CONFIG;
+		else if(strcmp(cmd,"show running-config")==0)
+			showRunning(c);
+		else if(strcmp(cmd,"exit")==0 || strcmp(cmd,"logout")==0){
+			flush(c);
+			closeConn(c);
+			return;
+		}
+		else if(!prefix(cmd,"terminal ") && strcmp(cmd,"end")!=0)
+			put(c,"%% Invalid input detected at '^' marker.\r\n\r\n");
+		break;
+	case CLI_CONFIG:
+		if(globalCommand(c,cmd))
+			break;
+		if(strcmp(cmd,"exit")==0)
+			c->mode = CLI_EXEC;
+		else
+			addLine(&r->global,cmd,false);
+		break;
+	case CLI_CONFIG_IF:
+	case CLI_CONFIG_ROUTER:
+	case CLI_EXPL_PATH:
+	case CLI_DEST_LIST:
+		if(globalCommand(c,cmd))
+			break;
+		if(strcmp(cmd,"exit")==0)
+			c->mode = CLI_CONFIG;
+		else if(c->mode==CLI_EXPL_PATH || c->mode==CLI_DEST_LIST)
+			addLine(c->cur,cmd,false);
+		else
+			addLine(c->cur,cmd,c->mode==CLI_CONFIG_IF);
+		break;
+	default:
+		break;
+	}
+	prompt(c);
+}
+
+//Strip telnet commands and split the input in lines
+static void input(struct mockConn *c, unsigned char *buf, int len){
+
+	int i;
+
+	for(i=0;i<len && !c->closed;i++){
+		if(c->iac==1){
+			c->iac = (buf[i]>=251 && buf[i]<=254)?2:(buf[i]==250)?3:0;
+			continue;
+		}
+		if(c->iac==2 || (c->iac==3 && buf[i]==240)){
+			c->iac = 0;
+			continue;
+		}
+		if(c->iac==3)
+			continue;
+		if(buf[i]==255){
+			c->iac = 1;
+			continue;
+		}
+		if(buf[i]=='\0' || (buf[i]=='\n' && c->cr)){
+			c->cr = false;
+			continue;
+		}
+		if(buf[i]=='\r' || buf[i]=='\n'){
+			c->cr = (buf[i]=='\r');
+			c->in[c->inLen] = '\0';
+			command(c,c->in);
+			c->inLen = 0;
+			continue;
+		}
+		c->cr = false;
+		if(c->inLen<CHAR_COMMAND-1)
+			c->in[c->inLen++] = buf[i];
+	}
+	if(!c->closed)
+		schedule(c);
+}
+
+/******************* EVENT LOOP ************************************************/
+
+static void accept_conn(struct mockRouter *r){
+
+	struct epoll_event ev;
+	struct mockConn *c;
+	int fd,one = 1;
+	unsigned char hello[] = {255,251,1,255,251,3};
+
+	while((fd=accept(r->fd,NULL,NULL))>=0){
+		fcntl(fd,F_SETFL,O_NONBLOCK);
+		setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+		c = (struct mockConn*) calloc(1,sizeof(struct mockConn));
+		c->kind = MOCK_CONNECTION;
+		c->fd = fd;
+		c->router = r;
+		c->mode = CLI_USERNAME_PROMPT;
+		c->outSize = CHAR_CLI_BUFFER;
+		c->out = (char*) malloc(c->outSize);
+		memcpy(c->out,hello,sizeof(hello));
+		c->outLen = sizeof(hello);
+		put(c,"\r\n\r\nUser Access Verification\r\n\r\nUsername: ");
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		epoll_ctl(epfd,EPOLL_CTL_ADD,fd,&ev);
+		sessions++;
+		schedule(c);
+	}
+}
+
+static void onSignal(int sig){
+	stop = true;
+}
+
+int main(int argc, char *argv[]){
+
+	struct mockRouter *routers;
+	struct epoll_event ev,events[MOCK_EVENTS];
+	struct sockaddr_in addr;
+	struct in_addr first;
+	struct mockConn *c;
+	unsigned char buf[CHAR_CLI_BUFFER];
+	int n,i,k,r,opt,timeout,one = 1;
+	int port = -1;
+	bool byAddress = false;
+
+	if(argc<2 || (n=atoi(argv[1]))<=0){
+		printf("Usage: %s <routers> [-a first_address] [-p port] [-l latency_ms]"
+				" [-f failure_percent] [-d drop_percent]\n",argv[0]);
+		return 1;
+	}
+	inet_pton(AF_INET,"127.0.0.1",&first);
+	optind = 2;
+	while((opt=getopt(argc,argv,"a:p:l:f:d:"))!=-1){
+		switch(opt){
+		case 'a':
+			if(inet_pton(AF_INET,optarg,&first)!=1){
+				printf("Address %s not valid\n",optarg);
+				return 1;
+			}
+			byAddress = true;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'l':
+			latency = atoi(optarg);
+			break;
+		case 'f':
+			failPct = atoi(optarg);
+			break;
+		case 'd':
+			dropPct = atoi(optarg);
+			break;
+		default:
+			return 1;
+		}
+	}
+	if(port<0)
+		port = byAddress?TELNET_PORT:MOCK_DEFAULT_PORT;
+
+	signal(SIGPIPE,SIG_IGN);
+	signal(SIGINT,onSignal);
+	signal(SIGTERM,onSignal);
+	epfd = epoll_create1(0);
+	routers = (struct mockRouter*) calloc(n,sizeof(struct mockRouter));
+	for(i=0;i<n;i++){
+		routers[i].kind = MOCK_LISTENER;
+		routers[i].index = i;
+		memset(&addr,0,sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = byAddress?htonl(ntohl(first.s_addr)+i):first.s_addr;
+		addr.sin_port = htons(byAddress?port:port+i);
+		routers[i].fd = socket(AF_INET,SOCK_STREAM,0);
+		setsockopt(routers[i].fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+		if(routers[i].fd<0 || bind(routers[i].fd,(struct sockaddr*)&addr,sizeof(addr))<0
+				|| listen(routers[i].fd,16)<0){
+			printf("Router %d: cannot listen on %s:%d (%s)\n",i,inet_ntoa(addr.sin_addr),
+					ntohs(addr.sin_port),strerror(errno));
+			return 1;
+		}
+		fcntl(routers[i].fd,F_SETFL,O_NONBLOCK);
+		ev.events = EPOLLIN;
+		ev.data.ptr = &routers[i];
+		epoll_ctl(epfd,EPOLL_CTL_ADD,routers[i].fd,&ev);
+	}
+	printf("%d routers listening, latency %d ms, failures %d%%, drops %d%%\n",n,latency,failPct,dropPct);
+
+	while(!stop){
+		timeout = -1;
+		if(readyHead!=NULL)
+			timeout = (readyHead->readyAt>now())?(int)(readyHead->readyAt-now()):0;
+
+		k = epoll_wait(epfd,events,MOCK_EVENTS,timeout);
+		for(i=0;i<k;i++){
+			if(*(enum mockKind*)events[i].data.ptr==MOCK_LISTENER){
+				accept_conn((struct mockRouter*)events[i].data.ptr);
+				continue;
+			}
+			c = (struct mockConn*) events[i].data.ptr;
+			if(c->closed)
+				continue;
+			r = read(c->fd,buf,sizeof(buf));
+			if(r<=0){
+				if(r==0 || errno!=EAGAIN)
+					closeConn(c);
+				continue;
+			}
+			input(c,buf,r);
+		}
+
+		//Send the answers whose latency is elapsed
+		while(readyHead!=NULL && readyHead->readyAt<=now()){
+			c = readyHead;
+			readyHead = c->nextReady;
+			if(readyHead==NULL)
+				readyTail = NULL;
+			c->queued = false;
+			if(c->closed){
+				free(c->out);
+				free(c);
+				continue;
+			}
+			flush(c);
+			if(c->outLen>0)
+				enqueue(c,now()+1);
+		}
+	}
+
+	printf("%ld sessions, %ld commands\n",sessions,commands);
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * p2mp.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Point-to-multipoint trees (shortest path heuristic for the
+ * 				Steiner tree). The distances from the whole tree to every
+ * 				router are kept: the nearest leaf is joined to the tree by a
+ * 				branch on links with enough residual capacity, and the
+ * 				routers of the branch only lower the distances around it, so
+ * 				each new leaf costs a partial update and not a new search.
+ * 				A branch holds the capacity of its own links only, so a link
+ * 				shared by many leaves is reserved once.
+ */
+
+#include "header_project.h"
+
+/******************* BEGIN STEINERTREE CLASS METHODS ***************************/
+
+//Constructor: the tree is the root only
+SteinerTree::SteinerTree(struct topologyLink **m, int nodes, int root, int capacity){
+
+	int i;
+	net = m;
+	n = nodes;
+	src = root;
+	c = capacity;
+	parent = (int*) malloc(n*sizeof(int));
+	inTree = (bool*) calloc(n,sizeof(bool));
+	dist = (int*) malloc(n*sizeof(int));
+	prev = (int*) malloc(n*sizeof(int));
+	open = (bool*) calloc(n,sizeof(bool));
+	for(i=0;i<n;i++){
+		parent[i] = -1;
+		dist[i] = -1;
+		prev[i] = -1;
+	}
+	inTree[src] = true;
+	dist[src] = 0;
+	open[src] = true;
+	stale = true;
+}
+
+//Destructor
+SteinerTree::~SteinerTree(){
+
+	free(parent);
+	free(inTree);
+	free(dist);
+	free(prev);
+	free(open);
+}
+
+/* Dijkstra from the open routers, keeping the distances already known:
+ * only the routers that get closer to the tree are visited again */
+void SteinerTree::Relax(){
+
+	int u,v;
+
+	while(1){
+		u = -1;
+		for(v=0;v<n;v++)
+			if(open[v] && (u==-1 || dist[v]<dist[u]))
+				u = v;
+		if(u==-1)
+			break;
+		open[u] = false;
+		for(v=0;v<n;v++){
+			if(inTree[v] || net[u][v].capacity==-1 || net[u][v].capacity-net[u][v].used<c)
+				continue;
+			if(dist[v]==-1 || dist[u]+1<dist[v]){
+				dist[v] = dist[u]+1;
+				prev[v] = u;
+				open[v] = true;
+			}
+		}
+	}
+	stale = false;
+}
+
+//Routers of a branch in the tree, new sources of the distances
+void SteinerTree::Join(int *path, int size){
+
+	int i;
+
+	for(i=1;i<size;i++){
+		if(inTree[path[i]])
+			continue;
+		inTree[path[i]] = true;
+		parent[path[i]] = path[i-1];
+		dist[path[i]] = 0;
+		prev[path[i]] = -1;
+		open[path[i]] = true;
+	}
+	stale = true;
+}
+
+/* Branch already reserved (from the LSP table), given in the order the
+ * branches were added. A branch hanging from one that failed is not joined
+ * and false is returned: its leaf is reached again by a new branch. */
+bool SteinerTree::AddBranch(int *path, int size){
+	if(!inTree[path[0]])
+		return false;
+	Join(path,size);
+	return true;
+}
+
+//Index of the leaf nearest to the tree, -1 if none can be reached
+int SteinerTree::Nearest(int *leaves, int count){
+
+	int k,best = -1;
+
+	if(stale)
+		Relax();
+	for(k=0;k<count;k++)
+		if(dist[leaves[k]]!=-1 && (best==-1 || dist[leaves[k]]<dist[leaves[best]]))
+			best = k;
+	return best;
+}
+
+/* New branch from the tree to the leaf (a single router if the leaf is
+ * already in the tree), NULL if the leaf cannot be reached */
+int * SteinerTree::Attach(int leaf, int *s){
+
+	int *branch;
+	int i,v;
+	int64_t span = TraceBegin(),start = StatClock();
+
+	if(stale)
+		Relax();
+	if(dist[leaf]==-1){
+		TraceEnd("path","p2mp",span,leaf);
+		StatPath(start,false);
+		return NULL;
+	}
+	*s = dist[leaf]+1;
+	branch = new int[*s];
+	for(i=*s-1,v=leaf;i>=0;i--,v=prev[v])
+		branch[i] = v;
+	Join(branch,*s);
+	TraceEnd("path","p2mp",span,leaf);
+	StatPath(start,true);
+	return branch;
+}
+
+//Path of the sub-LSP from the root to a router of the tree
+int * SteinerTree::PathTo(int leaf, int *s){
+
+	int *path;
+	int i,v;
+
+	*s = 1;
+	for(v=leaf;v!=src;v=parent[v])
+		(*s)++;
+	path = new int[*s];
+	for(i=*s-1,v=leaf;i>=0;i--,v=parent[v])
+		path[i] = v;
+	return path;
+}
+
+/******************* END STEINERTREE CLASS METHODS *****************************/
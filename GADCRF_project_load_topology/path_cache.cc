@@ -0,0 +1,113 @@
+/*
+ * path_cache.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Cache of the paths computed without capacity constraints.
+ * 				Every link keeps the pairs whose path crosses it, so when a
+ * 				link goes down only those paths are dropped; a new link may
+ * 				shorten any path and empties the whole cache.
+ */
+
+#include "header_project.h"
+
+/******************* BEGIN PATHCACHE CLASS METHODS *****************************/
+
+//Constructor
+PathCache::PathCache(int nodes){
+
+	n = nodes;
+	gen = 1;
+	paths = (struct cachedPath*) calloc(n*n,sizeof(struct cachedPath));
+	users = (int**) calloc(n*n,sizeof(int*));
+	nusers = (int*) calloc(n*n,sizeof(int));
+	pthread_mutex_init(&mutex,NULL);
+}
+
+//Destructor
+PathCache::~PathCache(){
+
+	int i;
+	for(i=0;i<n*n;i++){
+		delete[] paths[i].path;
+		free(users[i]);
+	}
+	free(paths);
+	free(users);
+	free(nusers);
+	pthread_mutex_destroy(&mutex);
+}
+
+int * PathCache::Get(int src, int dst, int *s){
+
+	struct cachedPath *c;
+	int *path = NULL;
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	c = &paths[src*n+dst];
+	if(c->gen==gen){
+		path = new int[c->size];
+		for(i=0;i<c->size;i++)
+			path[i] = c->path[i];
+		*s = c->size;
+	}
+	pthread_mutex_unlock(&mutex);
+	return path;
+}
+
+void PathCache::Put(int src, int dst, int *path, int s){
+
+	struct cachedPath *c;
+	int i,k;
+
+	pthread_mutex_lock(&mutex);
+	c = &paths[src*n+dst];
+	delete[] c->path;
+	c->path = new int[s];
+	c->size = s;
+	c->gen = gen;
+	for(i=0;i<s;i++)
+		c->path[i] = path[i];
+	//The lists are cleaned when the link changes, a pair may appear twice
+	for(i=0;i<s-1;i++){
+		k = path[i]*n+path[i+1];
+		if((nusers[k]&(nusers[k]-1))==0)
+			users[k] = (int*) realloc(users[k],(nusers[k]>0?2*nusers[k]:1)*sizeof(int));
+		users[k][nusers[k]++] = src*n+dst;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+int PathCache::Invalidate(int u, int v){
+
+	struct cachedPath *c;
+	int i,j,k = u*n+v,dropped = 0;
+
+	pthread_mutex_lock(&mutex);
+	for(i=0;i<nusers[k];i++){
+		c = &paths[users[k][i]];
+		if(c->gen!=gen)
+			continue;
+		//The pair may have been computed again on a path without the link
+		for(j=0;j<c->size-1;j++)
+			if(c->path[j]==u && c->path[j+1]==v){
+				c->gen = 0;
+				dropped++;
+				break;
+			}
+	}
+	free(users[k]);
+	users[k] = NULL;
+	nusers[k] = 0;
+	pthread_mutex_unlock(&mutex);
+	return dropped;
+}
+
+void PathCache::Clear(){
+
+	pthread_mutex_lock(&mutex);
+	gen++;
+	pthread_mutex_unlock(&mutex);
+}
+
+/******************* END PATHCACHE CLASS METHODS *******************************/
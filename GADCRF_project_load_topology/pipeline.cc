@@ -0,0 +1,185 @@
+/*
+ * pipeline.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Asynchronous provisioning. Path computation and reservation are
+ * 				done by the caller, the configuration of the routers is queued
+ * 				on the lane (libpdel message port) of the head-end and sent by
+ * 				its thread, so a slow or dead router only delays its own LSPs.
+ * 				Failed head-ends are retried with exponential backoff, then
+ * 				the capacity of their LSPs is released.
+ */
+
+#include "header_project.h"
+
+struct pipelineLane{
+	int index;
+	struct mesg_port *port;
+	pthread_t tid;
+	ProvisionPipeline *pipe;
+};
+
+//Message that stops a lane thread
+static struct provOp stopOp;
+
+/******************* BEGIN PROVISIONPIPELINE CLASS METHODS *********************/
+
+//Constructor
+ProvisionPipeline::ProvisionPipeline(SessionPool *sp, Topology *t, LspTable *lt, int nodes){
+
+	int i;
+	n = nodes;
+	pool = sp;
+	net = t;
+	table = lt;
+	memset(&stats,0,sizeof(stats));
+	pthread_mutex_init(&mutex,NULL);
+	pthread_cond_init(&space,NULL);
+
+	lane = (struct pipelineLane*) calloc(n,sizeof(struct pipelineLane));
+	for(i=0;i<n;i++){
+		lane[i].index = i;
+		lane[i].pipe = this;
+		lane[i].port = mesg_port_create("pce.pipeline");
+		pthread_create(&lane[i].tid,NULL,Worker,&lane[i]);
+	}
+}
+
+//Destructor: operations already queued are sent before the threads exit
+ProvisionPipeline::~ProvisionPipeline(){
+
+	int i;
+	for(i=0;i<n;i++)
+		mesg_port_put(lane[i].port,&stopOp);
+	for(i=0;i<n;i++){
+		pthread_join(lane[i].tid,NULL);
+		mesg_port_destroy(&lane[i].port);
+	}
+	free(lane);
+	pthread_cond_destroy(&space);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * ProvisionPipeline::Worker(void *arg){
+
+	struct pipelineLane *l = (struct pipelineLane*) arg;
+	l->pipe->Run(l);
+	return NULL;
+}
+
+/* Lane thread of a head-end: everything waiting on the port is taken at once,
+ * so its operations are coalesced in a single transaction. The retries of a
+ * router that does not answer hold only its own lane. */
+void ProvisionPipeline::Run(struct pipelineLane *l){
+
+	ProvisionQueue batch(n);
+	struct provOp *op,*ops;
+	int taken,attempt;
+	bool stop = false,ok;
+	int64_t span,sync;
+
+	while(!stop){
+		op = (struct provOp*) mesg_port_get(l->port,-1);
+		span = TraceBegin();
+		taken = 0;
+		while(op!=NULL){
+			if(op==&stopOp)
+				stop = true;
+			else{
+				batch.Push(op);
+				taken++;
+			}
+			op = (struct provOp*) mesg_port_get(l->port,0);
+		}
+		//A tunnel is configured only when its reservation can survive a restart
+		if(taken>0){
+			sync = TraceBegin();
+			table->Sync();
+			TraceEnd("pipeline","sync",sync,taken);
+		}
+
+		if((ops=batch.Take(l->index))!=NULL){
+			ok = false;
+			for(attempt=0;attempt<PIPELINE_RETRIES && !ok;attempt++){
+				if(attempt>0){
+					pthread_mutex_lock(&mutex);
+					stats.retries++;
+					pthread_mutex_unlock(&mutex);
+					usleep((PIPELINE_BACKOFF<<(attempt-1))*1000);
+				}
+				ok = pool->ConfigureBatch(l->index,ops);
+			}
+			Complete(ops,ok,attempt);
+			FreeProvOps(ops);
+		}
+
+		TraceEnd("pipeline","lane",span,taken);
+		pthread_mutex_lock(&mutex);
+		stats.depth-=taken;
+		pthread_cond_broadcast(&space);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+/* Last stage: LSPs are marked up, or their reservation is rolled back. An
+ * operation built for a reservation that has since been released or changed
+ * leaves the LSP as it is. */
+void ProvisionPipeline::Complete(struct provOp *ops, bool ok, int attempts){
+
+	struct provOp *op;
+
+	for(op=ops;op!=NULL;op=op->next){
+		if(op->type==OP_TUNNEL || op->type==OP_P2MP_LEAF){
+			//The branch of a leaf holds the capacity of the links it added to the tree
+			int lsp = (op->type==OP_TUNNEL)?op->id:op->branch;
+			if(ok)
+				table->Confirm(lsp,op->gen);
+			else
+				table->Release(lsp,net,LSP_FAILED,op->gen);
+		}
+		pthread_mutex_lock(&mutex);
+		if(ok)
+			stats.completed++;
+		else
+			stats.failed++;
+		pthread_mutex_unlock(&mutex);
+		if(op->type==OP_P2MP_LEAF)
+			printf("Tunnel-mte%d leaf %s on router %d: %s\n",op->id,op->dest,op->src,
+					ok?"configured":"failed, capacity released");
+		else if(op->type==OP_P2MP)
+			printf("Tunnel-mte%d on router %d: %s\n",op->id,op->src,ok?"configured":"failed");
+		else if(ok)
+			printf("Tunnel%d on router %d: %s\n",op->id,op->src,(op->type==OP_TUNNEL)?"configured":"removed");
+		else
+			printf("Tunnel%d on router %d: failed after %d attempts%s\n",op->id,op->src,attempts,
+					(op->type==OP_TUNNEL)?", capacity released":"");
+	}
+}
+
+void ProvisionPipeline::Submit(struct provOp *op){
+
+	pthread_mutex_lock(&mutex);
+	while(stats.depth>=PIPELINE_QUEUE_MAX)
+		pthread_cond_wait(&space,&mutex);
+	stats.depth++;
+	stats.submitted++;
+	pthread_mutex_unlock(&mutex);
+	mesg_port_put(lane[op->src].port,op);
+}
+
+void ProvisionPipeline::Stats(struct pipelineStats *st){
+
+	int i,q;
+
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	pthread_mutex_unlock(&mutex);
+	st->maxLane = 0;
+	for(i=0;i<n;i++){
+		q = mesg_port_qlen(lane[i].port);
+		if(q>st->maxLane)
+			st->maxLane = q;
+	}
+}
+
+/******************* END PROVISIONPIPELINE CLASS METHODS ***********************/
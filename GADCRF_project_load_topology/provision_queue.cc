@@ -0,0 +1,192 @@
+/*
+ * provision_queue.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Queue of tunnel configurations waiting to be sent to the routers.
+ * 				Operations are grouped by head-end so that each router is
+ * 				configured with a single transaction; an operation on a tunnel
+ * 				(or on a leaf of a P2MP tree) replaces the pending one on the
+ * 				same tunnel.
+ */
+
+#include "header_project.h"
+
+struct flushCtx{
+	int *heads;
+	struct provOp **ops;
+	SessionPool *pool;
+};
+
+//New operation, with its own copy of the addresses
+struct provOp * NewProvOp(enum provOpType type, int src, int id, char *dest, int cap,
+		char **hops, int nhops, bool replace){
+
+	struct provOp *op;
+	int i;
+
+	op = (struct provOp*) calloc(1,sizeof(struct provOp));
+	op->type = type;
+	op->id = id;
+	op->src = src;
+	op->capacity = cap;
+	op->replace = replace;
+	op->priority = LSP_PRIORITY;
+	op->gen = -1;
+	op->dest = strdup((dest!=NULL)?dest:"");
+	op->nhops = nhops;
+	op->hops = (char**) calloc(nhops,sizeof(char*));
+	for(i=0;i<nhops;i++)
+		op->hops[i] = strdup(hops[i]);
+	return op;
+}
+
+void FreeProvOps(struct provOp *ops){
+
+	struct provOp *next;
+	int i;
+
+	while(ops!=NULL){
+		next = ops->next;
+		for(i=0;i<ops->nhops;i++)
+			free(ops->hops[i]);
+		free(ops->hops);
+		free(ops->dest);
+		free(ops);
+		ops = next;
+	}
+}
+
+/* Operations on the same configuration: a tunnel (created or removed), the
+ * leaf of a P2MP tree or the P2MP tunnel */
+static bool sameTarget(struct provOp *a, struct provOp *b){
+
+	bool p2p = (a->type==OP_TUNNEL || a->type==OP_REMOVE);
+
+	if(a->id!=b->id || p2p!=(b->type==OP_TUNNEL || b->type==OP_REMOVE))
+		return false;
+	return p2p || (a->type==b->type && (a->type!=OP_P2MP_LEAF || a->branch==b->branch));
+}
+
+/******************* BEGIN PROVISIONQUEUE CLASS METHODS ************************/
+
+//Constructor
+ProvisionQueue::ProvisionQueue(int nodes){
+
+	n = nodes;
+	count = 0;
+	pending = (struct provOp**) calloc(n,sizeof(struct provOp*));
+	pthread_mutex_init(&mutex,NULL);
+}
+
+//Destructor
+ProvisionQueue::~ProvisionQueue(){
+
+	int i;
+	for(i=0;i<n;i++)
+		FreeProvOps(pending[i]);
+	free(pending);
+	pthread_mutex_destroy(&mutex);
+}
+
+//Append to the head-end list, dropping the operation superseded by the new one
+void ProvisionQueue::Push(struct provOp *op){
+
+	struct provOp **p,*old;
+
+	pthread_mutex_lock(&mutex);
+	p = &pending[op->src];
+	while(*p!=NULL){
+		if(sameTarget(*p,op)){
+			old = *p;
+			*p = old->next;
+			old->next = NULL;
+			//The tunnel may already be on the router with the old path
+			op->replace = true;
+			FreeProvOps(old);
+			count--;
+			continue;
+		}
+		p = &(*p)->next;
+	}
+	*p = op;
+	count++;
+	pthread_mutex_unlock(&mutex);
+}
+
+void ProvisionQueue::AddTunnel(int src, char *dest, int cap, int id, char **hops, int nhops, bool replace){
+	Push(NewProvOp(OP_TUNNEL,src,id,dest,cap,hops,nhops,replace));
+}
+
+void ProvisionQueue::RemoveTunnel(int src, int id){
+	Push(NewProvOp(OP_REMOVE,src,id,NULL,0,NULL,0,false));
+}
+
+int ProvisionQueue::Pending(){
+
+	int c;
+	pthread_mutex_lock(&mutex);
+	c = count;
+	pthread_mutex_unlock(&mutex);
+	return c;
+}
+
+struct provOp * ProvisionQueue::Take(int src){
+
+	struct provOp *ops,*op;
+
+	pthread_mutex_lock(&mutex);
+	ops = pending[src];
+	pending[src] = NULL;
+	for(op=ops;op!=NULL;op=op->next)
+		count--;
+	pthread_mutex_unlock(&mutex);
+	return ops;
+}
+
+static bool flushRouter(int i, void *arg){
+
+	struct flushCtx *ctx = (struct flushCtx*) arg;
+	struct provOp *op;
+	int k = 0;
+	bool ok;
+
+	for(op=ctx->ops[i];op!=NULL;op=op->next)
+		k++;
+	ok = ctx->pool->ConfigureBatch(ctx->heads[i],ctx->ops[i]);
+	printf("Provisioning of router %d: %s (%d operations)\n",ctx->heads[i],ok?"done":"failed",k);
+	return ok;
+}
+
+/* Send all the pending operations, one transaction per head-end router.
+ * Head-ends are configured concurrently; without a pool (demo mode)
+ * the commands are only shown. */
+int ProvisionQueue::Flush(SessionPool *pool){
+
+	struct flushCtx ctx;
+	int i,heads = 0,failed = 0;
+	int64_t span = TraceBegin();
+
+	ctx.heads = (int*) calloc(n,sizeof(int));
+	ctx.ops = (struct provOp**) calloc(n,sizeof(struct provOp*));
+	ctx.pool = pool;
+	for(i=0;i<n;i++){
+		if((ctx.ops[heads]=Take(i))!=NULL)
+			ctx.heads[heads++] = i;
+	}
+
+	if(pool==NULL){
+		for(i=0;i<heads;i++)
+			showConfigureBatch(ctx.heads[i],ctx.ops[i]);
+	}
+	else
+		failed = FanOut(heads,FANOUT_PARALLEL,flushRouter,&ctx,NULL,NULL);
+
+	for(i=0;i<heads;i++)
+		FreeProvOps(ctx.ops[i]);
+	free(ctx.heads);
+	free(ctx.ops);
+	TraceEnd("provision","flush",span,heads);
+	return failed;
+}
+
+/******************* END PROVISIONQUEUE CLASS METHODS **************************/
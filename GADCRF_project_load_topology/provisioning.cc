@@ -0,0 +1,471 @@
+/*
+ * provisioning.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Pool of persistent telnet sessions towards the routers.
+ * 				Each session is logged in once and then reused for every
+ * 				configuration, following the CLI prompts the same way
+ * 				cef.sh and lsp.sh do with expect.
+ */
+
+#include "header_project.h"
+
+//Telnet protocol bytes
+#define TELNET_IAC 255
+#define TELNET_DONT 254
+#define TELNET_DO 253
+#define TELNET_WONT 252
+#define TELNET_WILL 251
+#define TELNET_SB 250
+#define TELNET_SE 240
+#define TELNET_ECHO 1
+#define TELNET_SGA 3
+
+//Mode suffix between the hostname and # in the prompt
+static const struct{
+	const char *suffix;
+	enum cliMode mode;
+} cliPrompts[] = {
+	{"",CLI_EXEC},
+	{"(config)",CLI_CONFIG},
+	{"(config-if)",CLI_CONFIG_IF},
+	{"(config-router)",CLI_CONFIG_ROUTER},
+	{"(cfg-ip-expl-path)",CLI_EXPL_PATH},
+	{"(cfg-dest-list)",CLI_DEST_LIST}
+};
+static const int nPrompts = sizeof(cliPrompts)/sizeof(cliPrompts[0]);
+
+/******************* BEGIN SESSIONPOOL CLASS METHODS ***************************/
+
+//Constructor
+SessionPool::SessionPool(struct loopback *loopArray, int nodes){
+
+	int i;
+	n = nodes;
+	loopbackArray = loopArray;
+	//Routers simulated by mock_router: router i on 127.0.0.1, port PCE_MOCK_PORT+i
+	mockPort = (getenv("PCE_MOCK_PORT")!=NULL)?atoi(getenv("PCE_MOCK_PORT")):0;
+	sessions = (struct cliSession*) calloc(n,sizeof(struct cliSession));
+	for(i=0;i<n;i++){
+		sessions[i].fd = -1;
+		sessions[i].mode = CLI_DISCONNECTED;
+		sessions[i].size = CHAR_CLI_BUFFER;
+		sessions[i].output = (char*) calloc(CHAR_CLI_BUFFER,sizeof(char));
+		pthread_mutex_init(&sessions[i].mutex,NULL);
+	}
+}
+
+//Destructor
+SessionPool::~SessionPool(){
+
+	int i;
+	for(i=0;i<n;i++){
+		if(sessions[i].fd!=-1){
+			send(sessions[i].fd,"end\rexit\r",9,MSG_NOSIGNAL);
+			close(sessions[i].fd);
+		}
+		free(sessions[i].output);
+		pthread_mutex_destroy(&sessions[i].mutex);
+	}
+	free(sessions);
+}
+
+/* Read from the session until a known prompt is found at the end of the output.
+ * The prompt is the whole last line: hostname, mode suffix and # (or >), so
+ * a line of show running-config ending with # is not taken for it. The
+ * hostname is learned from the first exec prompt after the login.
+ * Telnet options are refused except echo and suppress-go-ahead,
+ * which are the ones sent by IOS. A telnet command split between two reads
+ * is kept in the session until its last byte arrives. */
+bool SessionPool::ReadPrompt(int node){
+
+	struct cliSession *s = &sessions[node];
+	unsigned char raw[512];
+	struct pollfd pfd;
+	int r,i,end,start,h,len;
+	char *line;
+
+	s->len = 0;
+	s->output[0] = '\0';
+	pfd.fd = s->fd;
+	pfd.events = POLLIN;
+
+	while(1){
+		if(poll(&pfd,1,CLI_TIMEOUT)<=0)
+			return false;
+		if((r=read(s->fd,raw,sizeof(raw)))<=0)
+			return false;
+
+		for(i=0;i<r;i++){
+			if(s->niac==0 && raw[i]!=TELNET_IAC){
+				if(s->sb || raw[i]=='\0')
+					continue;
+			}
+			else{
+				s->iac[s->niac++] = raw[i];
+				//WILL, WONT, DO and DONT are followed by the option
+				if(s->niac==2 && s->iac[1]>=TELNET_WILL && s->iac[1]<=TELNET_DONT)
+					continue;
+				if(s->niac==2){
+					if(s->iac[1]==TELNET_SB)
+						s->sb = true;
+					else if(s->iac[1]==TELNET_SE)
+						s->sb = false;
+				}
+				else if(s->niac==3 && !s->sb && (s->iac[1]==TELNET_WILL || s->iac[1]==TELNET_DO)){
+					unsigned char reply[3] = {TELNET_IAC,TELNET_WONT,s->iac[2]};
+					if(s->iac[1]==TELNET_WILL)
+						reply[1] = (s->iac[2]==TELNET_ECHO || s->iac[2]==TELNET_SGA)?TELNET_DO:TELNET_DONT;
+					send(s->fd,reply,3,MSG_NOSIGNAL);
+				}
+				if(s->niac>1)
+					s->niac = 0;
+				continue;
+			}
+			if(s->len+1>=s->size){
+				s->size*=2;
+				s->output = (char*) realloc(s->output,s->size);
+			}
+			s->output[s->len++] = raw[i];
+		}
+		s->output[s->len] = '\0';
+
+		//Prompt is the last line of the output, without trailing blanks
+		end = s->len;
+		while(end>0 && (s->output[end-1]==' ' || s->output[end-1]=='\r' || s->output[end-1]=='\n'))
+			end--;
+		if(end==0)
+			continue;
+		start = end;
+		while(start>0 && s->output[start-1]!='\r' && s->output[start-1]!='\n')
+			start--;
+		line = &s->output[start];
+
+		if(end>=9 && strncmp(&s->output[end-9],"Username:",9)==0){
+			s->mode = CLI_USERNAME_PROMPT;
+			return true;
+		}
+		if(end>=9 && strncmp(&s->output[end-9],"Password:",9)==0){
+			s->mode = CLI_PASSWORD_PROMPT;
+			return true;
+		}
+		if(s->output[end-1]!='#' && s->output[end-1]!='>')
+			continue;
+		len = end-1-start;
+		if(s->host[0]=='\0' && s->mode==CLI_PASSWORD_PROMPT){
+			for(h=0;h<len && line[h]!='(' && h<CHAR_HOSTNAME-1;h++)
+				s->host[h] = line[h];
+			s->host[h] = '\0';
+		}
+		h = strlen(s->host);
+		if(h==0 || len<h || strncmp(line,s->host,h)!=0)
+			continue;
+		for(i=0;i<nPrompts;i++)
+			if((int)strlen(cliPrompts[i].suffix)==len-h && strncmp(&line[h],cliPrompts[i].suffix,len-h)==0)
+				break;
+		if(i==nPrompts)
+			continue;
+		s->mode = cliPrompts[i].mode;
+		return true;
+	}
+}
+
+//Connect and log in, leaving the session at the exec prompt
+bool SessionPool::Open(int node){
+
+	struct cliSession *s = &sessions[node];
+	struct sockaddr_in addr;
+	int one = 1;
+
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(TELNET_PORT);
+	if(mockPort>0){
+		addr.sin_port = htons(mockPort+node);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+	else if(inet_pton(AF_INET,loopbackArray[node].loopAddr,&addr.sin_addr)!=1)
+		return false;
+
+	if((s->fd=socket(AF_INET,SOCK_STREAM,0))<0)
+		return false;
+	setsockopt(s->fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+	if(connect(s->fd,(struct sockaddr*)&addr,sizeof(addr))<0){
+		Close(node);
+		return false;
+	}
+
+	if(!ReadPrompt(node) || s->mode!=CLI_USERNAME_PROMPT
+			|| !Send(node,CLI_USERNAME,CLI_PASSWORD_PROMPT)
+			|| !Send(node,CLI_PASSWORD,CLI_EXEC)
+			|| !Send(node,"terminal length 0",CLI_EXEC)){
+		if (DEBUG)
+			printf("Login to %s failed\n",loopbackArray[node].loopAddr);
+		Close(node);
+		return false;
+	}
+	return true;
+}
+
+void SessionPool::Close(int node){
+
+	if(sessions[node].fd!=-1)
+		close(sessions[node].fd);
+	sessions[node].fd = -1;
+	sessions[node].mode = CLI_DISCONNECTED;
+	sessions[node].niac = 0;
+	sessions[node].sb = false;
+	sessions[node].host[0] = '\0';
+}
+
+/* Send a command and wait for the next prompt.
+ * The command fails if the prompt is not the expected one or,
+ * when strict, if the router answers with an error message. */
+bool SessionPool::Send(int node, const char *cmd, enum cliMode expect, bool strict){
+
+	struct cliSession *s = &sessions[node];
+	char line[CHAR_COMMAND];
+	int len;
+
+	len = snprintf(line,CHAR_COMMAND,"%s\r",cmd);
+	if(send(s->fd,line,len,MSG_NOSIGNAL)!=len || !ReadPrompt(node))
+		return false;
+	if(strict && (strstr(s->output,"\n% ")!=NULL || strncmp(s->output,"% ",2)==0))
+		return false;
+	return s->mode==expect;
+}
+
+//Tunnel block of lsp.sh, from (config)# back to (config)#
+bool SessionPool::RunTunnel(int src, struct provOp *op){
+
+	char cmd[CHAR_COMMAND];
+	int i;
+
+	snprintf(cmd,CHAR_COMMAND,"interface Tunnel%d",op->id);
+	if(!Send(src,cmd,CLI_CONFIG_IF) || !Send(src,"ip unnumbered Loopback0",CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel destination %s",op->dest);
+	if(!Send(src,cmd,CLI_CONFIG_IF) || !Send(src,"tunnel mode mpls traffic-eng",CLI_CONFIG_IF)
+			|| !Send(src,"tunnel mpls traffic-eng autoroute announce",CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng priority %d %d",op->priority,op->priority);
+	if(!Send(src,cmd,CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng bandwidth %d",op->capacity);
+	if(!Send(src,cmd,CLI_CONFIG_IF))
+		return false;
+	//A segment routing path lists SIDs: loopbacks (node SIDs) and next hops (adjacency SIDs)
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng path-option 1 explicit name path%d%s",op->id,
+			op->segments?" segment-routing":"");
+	if(!Send(src,cmd,CLI_CONFIG_IF) || !Send(src,"exit",CLI_CONFIG))
+		return false;
+	//next-address are appended to an existing path, so an old one is removed first
+	if(op->replace){
+		snprintf(cmd,CHAR_COMMAND,"no ip explicit-path name path%d",op->id);
+		if(!Send(src,cmd,CLI_CONFIG,false))
+			return false;
+	}
+	snprintf(cmd,CHAR_COMMAND,"ip explicit-path name path%d enable",op->id);
+	if(!Send(src,cmd,CLI_EXPL_PATH))
+		return false;
+	for(i=0;i<op->nhops;i++){
+		snprintf(cmd,CHAR_COMMAND,"next-address %s",op->hops[i]);
+		if(!Send(src,cmd,CLI_EXPL_PATH))
+			return false;
+	}
+	return Send(src,"exit",CLI_CONFIG);
+}
+
+//Remove tunnel and explicit path, from (config)# back to (config)#
+bool SessionPool::RunRemove(int src, struct provOp *op){
+
+	char cmd[CHAR_COMMAND];
+
+	snprintf(cmd,CHAR_COMMAND,"no interface Tunnel%d",op->id);
+	if(!Send(src,cmd,CLI_CONFIG,false))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"no ip explicit-path name path%d",op->id);
+	return Send(src,cmd,CLI_CONFIG,false);
+}
+
+/* Explicit path of a leaf and its entry in the destination list of the tree,
+ * from (config)# back to (config)# */
+bool SessionPool::RunP2mpLeaf(int src, struct provOp *op){
+
+	char cmd[CHAR_COMMAND];
+	int i;
+
+	if(op->replace){
+		snprintf(cmd,CHAR_COMMAND,"no ip explicit-path name p2mp%dleaf%d",op->id,op->branch);
+		if(!Send(src,cmd,CLI_CONFIG,false))
+			return false;
+	}
+	snprintf(cmd,CHAR_COMMAND,"ip explicit-path name p2mp%dleaf%d enable",op->id,op->branch);
+	if(!Send(src,cmd,CLI_EXPL_PATH))
+		return false;
+	for(i=0;i<op->nhops;i++){
+		snprintf(cmd,CHAR_COMMAND,"next-address %s",op->hops[i]);
+		if(!Send(src,cmd,CLI_EXPL_PATH))
+			return false;
+	}
+	if(!Send(src,"exit",CLI_CONFIG))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"mpls traffic-eng destination list name p2mp%d",op->id);
+	if(!Send(src,cmd,CLI_DEST_LIST))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"ip %s path-option 1 explicit name p2mp%dleaf%d",op->dest,op->id,op->branch);
+	if(!Send(src,cmd,CLI_DEST_LIST))
+		return false;
+	return Send(src,"exit",CLI_CONFIG);
+}
+
+//P2MP tunnel on the destination list, from (config)# back to (config)#
+bool SessionPool::RunP2mp(int src, struct provOp *op){
+
+	char cmd[CHAR_COMMAND];
+
+	snprintf(cmd,CHAR_COMMAND,"interface Tunnel-mte%d",op->id);
+	if(!Send(src,cmd,CLI_CONFIG_IF) || !Send(src,"ip unnumbered Loopback0",CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng destination list name p2mp%d",op->id);
+	if(!Send(src,cmd,CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng priority %d %d",op->priority,op->priority);
+	if(!Send(src,cmd,CLI_CONFIG_IF))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"tunnel mpls traffic-eng bandwidth %d",op->capacity);
+	if(!Send(src,cmd,CLI_CONFIG_IF))
+		return false;
+	return Send(src,"exit",CLI_CONFIG);
+}
+
+//All the operations of the head-end in a single configuration session
+bool SessionPool::RunBatch(int src, struct provOp *ops){
+
+	struct provOp *op;
+
+	if(!Send(src,"config t",CLI_CONFIG))
+		return false;
+	for(op=ops;op!=NULL;op=op->next){
+		if(op->type==OP_TUNNEL && !RunTunnel(src,op))
+			return false;
+		if(op->type==OP_REMOVE && !RunRemove(src,op))
+			return false;
+		if(op->type==OP_P2MP_LEAF && !RunP2mpLeaf(src,op))
+			return false;
+		if(op->type==OP_P2MP && !RunP2mp(src,op))
+			return false;
+	}
+	return Send(src,"end",CLI_EXEC);
+}
+
+bool SessionPool::RunNet(int node, struct topologyLink **net){
+
+	char cmd[CHAR_COMMAND];
+	int j;
+
+	if(!Send(node,"config t",CLI_CONFIG) || !Send(node,"ip cef",CLI_CONFIG))
+		return false;
+	for(j=0;j<n;j++){
+		if(net[node][j].capacity==-1)
+			continue;
+		snprintf(cmd,CHAR_COMMAND,"interface %s",net[node][j].srcInterface);
+		if(!Send(node,cmd,CLI_CONFIG_IF) || !Send(node,"tag-switching ip",CLI_CONFIG_IF)
+				|| !Send(node,"exit",CLI_CONFIG))
+			return false;
+	}
+	if(!Send(node,"mpls traffic-eng tunnels",CLI_CONFIG))
+		return false;
+	for(j=0;j<n;j++){
+		if(net[node][j].capacity==-1)
+			continue;
+		snprintf(cmd,CHAR_COMMAND,"interface %s",net[node][j].srcInterface);
+		if(!Send(node,cmd,CLI_CONFIG_IF) || !Send(node,"mpls traffic-eng tunnels",CLI_CONFIG_IF)
+				|| !Send(node,"ip rsvp bandwidth 1024 1024",CLI_CONFIG_IF)
+				|| !Send(node,"exit",CLI_CONFIG))
+			return false;
+	}
+	if(!Send(node,"router ospf 100",CLI_CONFIG_ROUTER)
+			|| !Send(node,"mpls traffic-eng area 1",CLI_CONFIG_ROUTER)
+			|| !Send(node,"mpls traffic-eng router-id Loopback0",CLI_CONFIG_ROUTER))
+		return false;
+	snprintf(cmd,CHAR_COMMAND,"network %s 0.0.0.0 area 1",loopbackArray[node].loopAddr);
+	if(!Send(node,cmd,CLI_CONFIG_ROUTER))
+		return false;
+	return Send(node,"exit",CLI_CONFIG) && Send(node,"end",CLI_EXEC);
+}
+
+/* Apply a list of tunnel operations on the head-end router.
+ * If the session was dropped by the router it is opened again
+ * and the whole configuration is repeated once (commands are idempotent). */
+bool SessionPool::ConfigureBatch(int src, struct provOp *ops){
+
+	bool done = false;
+	int attempt,count = 0;
+	int64_t span = TraceBegin();
+
+	pthread_mutex_lock(&sessions[src].mutex);
+	for(attempt=0;attempt<2 && !done;attempt++){
+		if(sessions[src].mode!=CLI_EXEC && sessions[src].fd!=-1)
+			Close(src);
+		if(sessions[src].fd==-1 && !Open(src))
+			continue;
+		if(!(done=RunBatch(src,ops)))
+			Close(src);
+	}
+	pthread_mutex_unlock(&sessions[src].mutex);
+	TraceEnd("provision","configure",span,src);
+	for(struct provOp *op=ops; op!=NULL; op=op->next)
+		count++;
+	StatAdd(STAT_PROV_OPS,count);
+	if(!done)
+		StatAdd(STAT_PROV_FAILED,count);
+	return done;
+}
+
+//Enable CEF, MPLS and TE tunnels on the router, same commands of cef.sh
+bool SessionPool::ConfigureNet(int node, struct topologyLink **net){
+
+	bool done = false;
+	int attempt;
+
+	pthread_mutex_lock(&sessions[node].mutex);
+	for(attempt=0;attempt<2 && !done;attempt++){
+		if(sessions[node].mode!=CLI_EXEC && sessions[node].fd!=-1)
+			Close(node);
+		if(sessions[node].fd==-1 && !Open(node))
+			continue;
+		if(!(done=RunNet(node,net)))
+			Close(node);
+	}
+	pthread_mutex_unlock(&sessions[node].mutex);
+	return done;
+}
+
+//Dump the running configuration in a new buffer (to be freed by the caller)
+bool SessionPool::ShowRunningConfig(int node, char **out, int *len){
+
+	bool done = false;
+	int attempt;
+
+	*out = NULL;
+	*len = 0;
+	pthread_mutex_lock(&sessions[node].mutex);
+	for(attempt=0;attempt<2 && !done;attempt++){
+		if(sessions[node].mode!=CLI_EXEC && sessions[node].fd!=-1)
+			Close(node);
+		if(sessions[node].fd==-1 && !Open(node))
+			continue;
+		if(!(done=Send(node,"show running-config",CLI_EXEC)))
+			Close(node);
+	}
+	if(done){
+		*len = sessions[node].len;
+		*out = (char*) malloc(*len+1);
+		memcpy(*out,sessions[node].output,*len+1);
+	}
+	pthread_mutex_unlock(&sessions[node].mutex);
+	return done;
+}
+
+/******************* END SESSIONPOOL CLASS METHODS *****************************/
@@ -0,0 +1,313 @@
+/*
+ * reconcile.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Comparison between the tunnels configured on the routers and
+ * 				the LSPs installed by the PCE. The running configuration of all
+ * 				the routers is read concurrently and parsed line by line; every
+ * 				difference becomes an operation for the provisioning pipeline.
+ */
+
+#include "header_project.h"
+
+//Tunnel and explicit path found in the running configuration
+struct devTunnel{
+	int id;
+	int capacity;
+	bool hasPath;								//Explicit path pathN configured
+	bool segments;								//Path option with segment routing
+	char dest[CHAR_ADDRESS];
+	int nhops;
+	char **hops;
+};
+
+struct devConfig{
+	int count;
+	int size;
+	struct devTunnel *tunnels;
+};
+
+//Expected state of a tunnel, copied from the LSP table
+struct expTunnel{
+	int id;
+	int capacity;
+	int priority;
+	char *dest;
+	int nhops;
+	char **hops;
+	bool segments;
+	bool pending;								//Configuration in progress, left as it is
+	int gen;									//Reservation of the LSP when copied
+	struct expTunnel *next;
+};
+
+struct reconcileCtx{
+	SessionPool *pool;
+	ProvisionPipeline *pipeline;
+	LspTable *table;
+	struct expTunnel **expected;				//Expected tunnels of each head-end
+	int next;									//First tunnel id not in the table when copied
+	pthread_mutex_t mutex;
+	int missing;
+	int changed;
+	int extra;
+	int unreachable;
+};
+
+static struct devTunnel *devFind(struct devConfig *dc, int id, bool create){
+
+	int i;
+
+	for(i=0;i<dc->count;i++)
+		if(dc->tunnels[i].id==id)
+			return &dc->tunnels[i];
+	if(!create)
+		return NULL;
+	if(dc->count==dc->size){
+		dc->size = (dc->size==0)?16:2*dc->size;
+		dc->tunnels = (struct devTunnel*) realloc(dc->tunnels,dc->size*sizeof(struct devTunnel));
+	}
+	memset(&dc->tunnels[dc->count],0,sizeof(struct devTunnel));
+	dc->tunnels[dc->count].id = id;
+	dc->tunnels[dc->count].capacity = -1;
+	return &dc->tunnels[dc->count++];
+}
+
+static void devFree(struct devConfig *dc){
+
+	int i,j;
+
+	for(i=0;i<dc->count;i++){
+		for(j=0;j<dc->tunnels[i].nhops;j++)
+			free(dc->tunnels[i].hops[j]);
+		free(dc->tunnels[i].hops);
+	}
+	free(dc->tunnels);
+}
+
+/* Parse the running configuration one line at a time, keeping only the
+ * interface TunnelN and ip explicit-path name pathN blocks */
+static void parseRunningConfig(char *buf, int len, struct devConfig *dc){
+
+	struct devTunnel *cur = NULL;
+	bool inPath = false;
+	char line[CHAR_COMMAND],addr[CHAR_ADDRESS];
+	int i,k,id,v;
+
+	memset(dc,0,sizeof(struct devConfig));
+	i = 0;
+	while(i<len){
+		k = 0;
+		while(i<len && buf[i]!='\n'){
+			if(buf[i]!='\r' && k<CHAR_COMMAND-1)
+				line[k++] = buf[i];
+			i++;
+		}
+		line[k] = '\0';
+		i++;
+
+		//A line not indented closes the current block
+		if(line[0]!=' '){
+			cur = NULL;
+			inPath = false;
+			if(sscanf(line,"interface Tunnel%d",&id)==1)
+				cur = devFind(dc,id,true);
+			else if(sscanf(line,"ip explicit-path name path%d",&id)==1){
+				cur = devFind(dc,id,true);
+				cur->hasPath = true;
+				inPath = true;
+			}
+			continue;
+		}
+		if(cur==NULL)
+			continue;
+
+		if(inPath){
+			if(sscanf(line," next-address %49s",addr)==1
+					|| sscanf(line," index %d next-address %49s",&v,addr)==2){
+				cur->hops = (char**) realloc(cur->hops,(cur->nhops+1)*sizeof(char*));
+				cur->hops[cur->nhops++] = strdup(addr);
+			}
+		}
+		else if(sscanf(line," tunnel destination %49s",addr)==1)
+			strcpy(cur->dest,addr);
+		else if(sscanf(line," tunnel mpls traffic-eng bandwidth %d",&v)==1)
+			cur->capacity = v;
+		else if(strstr(line," tunnel mpls traffic-eng path-option ")==line)
+			cur->segments = strstr(line," segment-routing")!=NULL;
+	}
+}
+
+static bool sameTunnel(struct expTunnel *e, struct devTunnel *d){
+
+	int i;
+
+	if(!d->hasPath || e->capacity!=d->capacity || strcmp(e->dest,d->dest)!=0 || e->nhops!=d->nhops
+			|| e->segments!=d->segments)
+		return false;
+	for(i=0;i<e->nhops;i++)
+		if(strcmp(e->hops[i],d->hops[i])!=0)
+			return false;
+	return true;
+}
+
+/* The LSP is still up on the reservation copied: it may have been rerouted,
+ * resized or released while the routers were read */
+static bool stillExpected(struct reconcileCtx *ctx, struct expTunnel *e){
+
+	struct lspEntry *l;
+	bool ok;
+
+	ctx->table->Lock();
+	l = ctx->table->Find(e->id);
+	ok = l!=NULL && l->state==LSP_UP && l->gen==e->gen;
+	ctx->table->Unlock();
+	return ok;
+}
+
+/* A tunnel of the router unknown to the copy is removed only if it was not
+ * installed by the PCE since, on this head-end */
+static bool stillUnknown(struct reconcileCtx *ctx, int node, int id){
+
+	struct lspEntry *l;
+	bool ok;
+
+	if(id>=ctx->next)
+		return false;
+	ctx->table->Lock();
+	l = ctx->table->Find(id);
+	ok = l==NULL || l->tree!=-1 || l->src!=node
+			|| (l->state!=LSP_PENDING && l->state!=LSP_UP && l->state!=LSP_REROUTING);
+	ctx->table->Unlock();
+	return ok;
+}
+
+static bool reconcileRouter(int node, void *arg){
+
+	struct reconcileCtx *ctx = (struct reconcileCtx*) arg;
+	struct devConfig dc;
+	struct devTunnel *d;
+	struct expTunnel *e;
+	struct provOp *op;
+	char *out;
+	int len,i,missing = 0,changed = 0,extra = 0;
+
+	if(!ctx->pool->ShowRunningConfig(node,&out,&len)){
+		pthread_mutex_lock(&ctx->mutex);
+		ctx->unreachable++;
+		pthread_mutex_unlock(&ctx->mutex);
+		return false;
+	}
+	parseRunningConfig(out,len,&dc);
+	free(out);
+
+	//Tunnels of the PCE missing or different on the router are configured again
+	for(e=ctx->expected[node];e!=NULL;e=e->next){
+		d = devFind(&dc,e->id,false);
+		if(e->pending){
+			if(d!=NULL)
+				d->id = -1;
+			continue;
+		}
+		if(d!=NULL && sameTunnel(e,d)){
+			d->id = -1;
+			continue;
+		}
+		if(d!=NULL)
+			d->id = -1;
+		if(!stillExpected(ctx,e))
+			continue;
+		if(d==NULL)
+			missing++;
+		else
+			changed++;
+		op = NewProvOp(OP_TUNNEL,node,e->id,e->dest,e->capacity,e->hops,e->nhops,d!=NULL);
+		op->segments = e->segments;
+		op->priority = e->priority;
+		op->gen = e->gen;
+		ctx->pipeline->Submit(op);
+	}
+	//Tunnels unknown to the PCE are removed
+	for(i=0;i<dc.count;i++){
+		if(dc.tunnels[i].id==-1 || !stillUnknown(ctx,node,dc.tunnels[i].id))
+			continue;
+		extra++;
+		ctx->pipeline->Submit(NewProvOp(OP_REMOVE,node,dc.tunnels[i].id,NULL,0,NULL,0,false));
+	}
+	devFree(&dc);
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->missing+=missing;
+	ctx->changed+=changed;
+	ctx->extra+=extra;
+	pthread_mutex_unlock(&ctx->mutex);
+	if(missing+changed+extra>0)
+		printf("Router %d: %d tunnels missing, %d different, %d unknown\n",node,missing,changed,extra);
+	return true;
+}
+
+/* Audit all the routers against the LSPs that are up and queue the corrections.
+ * LSPs still pending are not corrected, their configuration is in progress,
+ * but what is already on the router is not removed either. Each correction
+ * is checked again against the table before it is queued.
+ * With segment routing the expected paths are the SID lists of the LSPs. */
+void Reconcile(Topology *net, int nodes, LspTable *table, SessionPool *pool, ProvisionPipeline *pipeline,
+		SegmentRouting *sr){
+
+	struct reconcileCtx ctx;
+	struct lspEntry *l;
+	struct expTunnel *e;
+	int i,j;
+
+	memset(&ctx,0,sizeof(ctx));
+	ctx.pool = pool;
+	ctx.pipeline = pipeline;
+	ctx.table = table;
+	ctx.expected = (struct expTunnel**) calloc(nodes,sizeof(struct expTunnel*));
+	pthread_mutex_init(&ctx.mutex,NULL);
+
+	table->Lock();
+	net->Lock();
+	for(i=0;i<table->Size();i++){
+		if((l=table->Find(i))!=NULL)
+			ctx.next = i+1;
+		if(l==NULL || (l->state!=LSP_UP && l->state!=LSP_PENDING))
+			continue;
+		//Branches of P2MP trees are not TunnelN interfaces
+		if(l->tree!=-1)
+			continue;
+		e = (struct expTunnel*) calloc(1,sizeof(struct expTunnel));
+		e->id = i;
+		e->pending = l->state==LSP_PENDING;
+		e->capacity = l->capacity;
+		e->priority = l->priority;
+		e->gen = l->gen;
+		e->dest = strdup(net->LoopArray()[l->dst].loopAddr);
+		char *hops[l->size];
+		e->nhops = TunnelHops(net,sr,l->path,l->size,hops,&e->segments);
+		e->hops = (char**) calloc(l->size,sizeof(char*));
+		for(j=0;j<e->nhops;j++)
+			e->hops[j] = strdup(hops[j]);
+		e->next = ctx.expected[l->src];
+		ctx.expected[l->src] = e;
+	}
+	net->Unlock();
+	table->Unlock();
+
+	FanOut(nodes,FANOUT_PARALLEL,reconcileRouter,&ctx,NULL,NULL);
+	printf("Reconciliation: %d tunnels missing, %d different, %d unknown, %d routers unreachable\n",
+			ctx.missing,ctx.changed,ctx.extra,ctx.unreachable);
+
+	for(i=0;i<nodes;i++){
+		while((e=ctx.expected[i])!=NULL){
+			ctx.expected[i] = e->next;
+			for(j=0;j<e->nhops;j++)
+				free(e->hops[j]);
+			free(e->hops);
+			free(e->dest);
+			free(e);
+		}
+	}
+	free(ctx.expected);
+	pthread_mutex_destroy(&ctx.mutex);
+}
@@ -0,0 +1,450 @@
+/*
+ * replay.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Replay of a trace of LSP events on the path engine of the PCE,
+ * 				for repeatable capacity and performance tests. The tunnels are
+ * 				placed, resized and released on the topology and the LSP table
+ * 				as the PCE does, and the tunnels on failed links are rerouted by
+ * 				FastReroute, with no provisioning: nothing is sent to the
+ * 				routers or printed while the events run. The events run as
+ * 				fast as possible or at the pace of their times. The report has
+ * 				one "key value" per line in a fixed order, to diff the reports
+ * 				of two builds: admissions and utilization first, which must not
+ * 				change for the same trace, then the times.
+ *
+ * Usage: replay <trace> [-t topology_file] [-m path_mode] [-p] [-o report]
+ *
+ * 				One event per line, <ms> from the start of the trace:
+ * 				<ms> setup <lsp> <src> <dst> <capacity>
+ * 				<ms> teardown <lsp>
+ * 				<ms> resize <lsp> <capacity>
+ * 				<ms> link <i> <j> down
+ * 				<ms> node <i> down
+ * 				-p keeps the times of the events, -m is a mode of PCE_PATH_MODE.
+ */
+
+#include "header_project.h"
+
+//The paths printed for debugging would be timed with the events
+#if DEBUG
+#error "Build the replay with -DDEBUG=false"
+#endif
+
+#define REPLAY_REPORT "replay_report"
+#define REPLAY_BUCKETS 10						//Utilization buckets of 10%
+
+int simul = 1;
+
+enum replayType{
+	REPLAY_SETUP,
+	REPLAY_TEARDOWN,
+	REPLAY_RESIZE,
+	REPLAY_LINK_DOWN,
+	REPLAY_NODE_DOWN,
+	REPLAY_TYPES
+};
+
+enum replayResult{
+	REPLAY_DONE,
+	REPLAY_REJECTED,							//No path or no capacity
+	REPLAY_INVALID								//Unknown tunnel or link
+};
+
+struct replayEvent{
+	int64_t at;									//Milliseconds from the start
+	enum replayType type;
+	int lsp;
+	int src;									//Also the router or the first end of the link
+	int dst;
+	int capacity;
+	int line;
+};
+
+//Latencies of the events of a type, in microseconds
+struct replaySamples{
+	int64_t *us;
+	int count;
+	int results[REPLAY_INVALID+1];
+};
+
+static const char *typeNames[REPLAY_TYPES] = {"setup","teardown","resize","link_down","node_down"};
+static const char *resultNames[REPLAY_INVALID+1] = {"done","rejected","invalid"};
+
+static Topology *net;
+static LspTable *lsps;
+static FastReroute *frr;
+static int nodes;
+static enum pathMode mode;
+
+//Events of the trace in the order of their times, lines with the same time in file order
+static int compareEvent(const void *a, const void *b){
+
+	const struct replayEvent *x = (const struct replayEvent*) a,*y = (const struct replayEvent*) b;
+
+	if(x->at!=y->at)
+		return (x->at<y->at)?-1:1;
+	return x->line-y->line;
+}
+
+static int compareUs(const void *a, const void *b){
+
+	int64_t x = *(const int64_t*) a,y = *(const int64_t*) b;
+	return (x<y)?-1:(x>y);
+}
+
+static int compareUtil(const void *a, const void *b){
+
+	double x = *(const double*) a,y = *(const double*) b;
+	return (x<y)?-1:(x>y);
+}
+
+static struct replayEvent * readTrace(const char *file, int *count){
+
+	struct replayEvent *ev = NULL,e;
+	char line[CHAR_COMMAND],word[CHAR_COMMAND],state[CHAR_COMMAND];
+	long long at;
+	int k,ok,number = 0;
+	FILE *Ptr;
+
+	*count = 0;
+	if((Ptr=fopen(file,"r"))==NULL){
+		printf("Error opening %s\n",file);
+		return NULL;
+	}
+	while(fgets(line,CHAR_COMMAND,Ptr)!=NULL){
+		number++;
+		if(line[0]=='#' || sscanf(line,"%lld %s%n",&at,word,&k)<2)
+			continue;
+		memset(&e,0,sizeof(e));
+		e.at = at;
+		e.line = number;
+		e.lsp = -1;
+		if(strcmp(word,"setup")==0){
+			e.type = REPLAY_SETUP;
+			ok = sscanf(line+k,"%d %d %d %d",&e.lsp,&e.src,&e.dst,&e.capacity)==4;
+		}
+		else if(strcmp(word,"teardown")==0){
+			e.type = REPLAY_TEARDOWN;
+			ok = sscanf(line+k,"%d",&e.lsp)==1;
+		}
+		else if(strcmp(word,"resize")==0){
+			e.type = REPLAY_RESIZE;
+			ok = sscanf(line+k,"%d %d",&e.lsp,&e.capacity)==2;
+		}
+		else if(strcmp(word,"link")==0){
+			e.type = REPLAY_LINK_DOWN;
+			ok = sscanf(line+k,"%d %d %s",&e.src,&e.dst,state)==3 && strcmp(state,"down")==0;
+		}
+		else if(strcmp(word,"node")==0){
+			e.type = REPLAY_NODE_DOWN;
+			ok = sscanf(line+k,"%d %s",&e.src,state)==2 && strcmp(state,"down")==0;
+		}
+		else
+			ok = false;
+		if(!ok || at<0){
+			printf("Event not valid at line %d: %s",number,line);
+			continue;
+		}
+		if((*count&(*count-1))==0)
+			ev = (struct replayEvent*) realloc(ev,(*count>0?2*(*count):1)*sizeof(struct replayEvent));
+		ev[(*count)++] = e;
+	}
+	fclose(Ptr);
+	qsort(ev,*count,sizeof(struct replayEvent),compareEvent);
+	return ev;
+}
+
+static bool validNode(int i){
+	return i>=0 && i<nodes;
+}
+
+//New tunnel on the path of the mode, reserved and up
+static enum replayResult setup(struct replayEvent *ev){
+
+	struct lspEntry *e;
+	int *path,size;
+	bool busy;
+
+	if(ev->lsp<0 || !validNode(ev->src) || !validNode(ev->dst) || ev->src==ev->dst || ev->capacity<=0)
+		return REPLAY_INVALID;
+	lsps->Lock();
+	busy = (e=lsps->Find(ev->lsp))!=NULL && (e->state==LSP_PENDING || e->state==LSP_UP);
+	lsps->Unlock();
+	if(busy)
+		return REPLAY_INVALID;
+	net->Lock();
+	path = find_path_mode(net->Matrix(),nodes,ev->src,ev->dst,ev->capacity,mode,&size);
+	if(path!=NULL)
+		net->UpdateTopology(path,size,ev->capacity);
+	net->Unlock();
+	if(path==NULL)
+		return REPLAY_REJECTED;
+	lsps->Add(ev->lsp,ev->src,ev->dst,ev->capacity,path,size,LSP_PRIORITY);
+	lsps->SetState(ev->lsp,LSP_UP);
+	delete[] path;
+	return REPLAY_DONE;
+}
+
+static enum replayResult teardown(struct replayEvent *ev){
+	return lsps->Release(ev->lsp,net,LSP_FREE)?REPLAY_DONE:REPLAY_INVALID;
+}
+
+/* New capacity on the same path if it fits, else on a new path; the tunnel
+ * keeps its reservation if there is none (make-before-break) */
+static enum replayResult resize(struct replayEvent *ev){
+
+	struct lspEntry *e;
+	struct topologyLink **m;
+	enum replayResult r = REPLAY_DONE;
+	int *path,len;
+
+	if(ev->capacity<=0)
+		return REPLAY_INVALID;
+	lsps->Lock();
+	net->Lock();
+	m = net->Matrix();
+	e = lsps->Find(ev->lsp);
+	if(e==NULL || e->state!=LSP_UP)
+		r = REPLAY_INVALID;
+	else if(ev->capacity<=e->capacity || fits(m,e->path,e->size,ev->capacity-e->capacity)){
+		net->UpdateTopology(e->path,e->size,ev->capacity-e->capacity);
+		lsps->Resize(ev->lsp,ev->capacity,e->path,e->size);
+	}
+	else{
+		net->UpdateTopology(e->path,e->size,-e->capacity);
+		if((path=find_path_mode(m,nodes,e->src,e->dst,ev->capacity,mode,&len))==NULL){
+			net->UpdateTopology(e->path,e->size,e->capacity);
+			r = REPLAY_REJECTED;
+		}
+		else{
+			net->UpdateTopology(path,len,ev->capacity);
+			lsps->Resize(ev->lsp,ev->capacity,path,len);
+			delete[] path;
+		}
+	}
+	net->Unlock();
+	lsps->Unlock();
+	return r;
+}
+
+/* The link src-dst (both directions) or all the links of the router src go
+ * down, then their tunnels are rerouted */
+static enum replayResult linksDown(struct replayEvent *ev){
+
+	struct topologyLink **m;
+	int *down,count = 0,j;
+
+	if(!validNode(ev->src) || (ev->type==REPLAY_LINK_DOWN && (!validNode(ev->dst) || ev->dst==ev->src)))
+		return REPLAY_INVALID;
+	down = new int[2*nodes];
+	net->Lock();
+	m = net->Matrix();
+	for(j=0;j<nodes;j++){
+		if(j==ev->src || (ev->type==REPLAY_LINK_DOWN && j!=ev->dst))
+			continue;
+		if(m[ev->src][j].capacity!=-1){
+			net->SetLink(ev->src,j,-1,NULL,NULL,NULL,NULL);
+			down[count++] = ev->src*nodes+j;
+		}
+		if(m[j][ev->src].capacity!=-1){
+			net->SetLink(j,ev->src,-1,NULL,NULL,NULL,NULL);
+			down[count++] = j*nodes+ev->src;
+		}
+	}
+	net->Unlock();
+	if(count>0)
+		frr->LinksDown(down,count);
+	delete[] down;
+	return (count>0)?REPLAY_DONE:REPLAY_INVALID;
+}
+
+static int64_t quantile(int64_t *v, int count, double q){
+
+	int k = (int)(q*count+0.999999)-1;
+	return v[(k<0)?0:k];
+}
+
+/* Report of the replay in file. Utilization is the reserved capacity over
+ * the capacity of each link still up at the end of the trace. */
+static bool writeReport(const char *file, const char *trace, const char *topology, bool paced,
+		struct replaySamples *s, int64_t requested, int64_t admitted, int64_t total, int64_t late){
+
+	struct topologyLink **m;
+	struct frrStats fs;
+	char tmp[CHAR_COMMAND];
+	double *util,sum = 0;
+	int buckets[REPLAY_BUCKETS+1],links = 0,events = 0,t,r,i,j,k;
+	FILE *Ptr;
+
+	snprintf(tmp,CHAR_COMMAND,"%s.tmp",file);
+	if((Ptr=fopen(tmp,"w"))==NULL){
+		printf("Error opening %s\n",tmp);
+		return false;
+	}
+	util = (double*) malloc((nodes*nodes>0?nodes*nodes:1)*sizeof(double));
+	memset(buckets,0,sizeof(buckets));
+	net->Lock();
+	m = net->Matrix();
+	for(i=0;i<nodes;i++)
+		for(j=0;j<nodes;j++)
+			if(m[i][j].capacity>0){
+				util[links] = (double)m[i][j].used/m[i][j].capacity;
+				sum+=util[links];
+				k = (int)(util[links]*REPLAY_BUCKETS);
+				buckets[(k<0)?0:(k>REPLAY_BUCKETS)?REPLAY_BUCKETS:k]++;
+				links++;
+			}
+	net->Unlock();
+	qsort(util,links,sizeof(double),compareUtil);
+	frr->Stats(&fs);
+
+	fprintf(Ptr,"# Replay of %s on %s, %s paths, %s\n",trace,topology,pathModeName(mode),
+			paced?"recorded pace":"as fast as possible");
+	for(t=0;t<REPLAY_TYPES;t++){
+		events+=s[t].count;
+		for(r=0;r<=REPLAY_INVALID;r++)
+			fprintf(Ptr,"%s.%s %d\n",typeNames[t],resultNames[r],s[t].results[r]);
+	}
+	fprintf(Ptr,"events %d\n",events);
+	fprintf(Ptr,"admission.ratio %.4f\n",(s[REPLAY_SETUP].results[REPLAY_DONE]+s[REPLAY_SETUP].results[REPLAY_REJECTED]>0)
+			?(double)s[REPLAY_SETUP].results[REPLAY_DONE]
+			/(s[REPLAY_SETUP].results[REPLAY_DONE]+s[REPLAY_SETUP].results[REPLAY_REJECTED]):0);
+	fprintf(Ptr,"admission.capacity_ratio %.4f\n",(requested>0)?(double)admitted/requested:0);
+	fprintf(Ptr,"reroute.affected %d\nreroute.rerouted %d\nreroute.failed %d\n",fs.affected,fs.rerouted,fs.failed);
+	fprintf(Ptr,"lsps.up %d\n",lsps->Count(LSP_UP));
+	fprintf(Ptr,"links.up %d\n",links);
+	fprintf(Ptr,"utilization.mean %.4f\n",(links>0)?sum/links:0);
+	if(links>0)
+		fprintf(Ptr,"utilization.p50 %.4f\nutilization.p90 %.4f\nutilization.p99 %.4f\nutilization.max %.4f\n",
+				util[(int)(0.5*(links-1))],util[(int)(0.9*(links-1))],util[(int)(0.99*(links-1))],util[links-1]);
+	for(k=0;k<REPLAY_BUCKETS;k++)
+		fprintf(Ptr,"utilization.bucket.%02d_%02d %d\n",k*100/REPLAY_BUCKETS,(k+1)*100/REPLAY_BUCKETS-1,buckets[k]);
+	fprintf(Ptr,"utilization.bucket.100 %d\n",buckets[REPLAY_BUCKETS]);
+	free(util);
+
+	//Times, different at each run: compare them, do not expect them equal
+	fprintf(Ptr,"# Times\n");
+	fprintf(Ptr,"time.total_ms %.3f\n",total/1000.0);
+	fprintf(Ptr,"throughput.events_per_s %.1f\n",(total>0)?events*1e6/total:0);
+	for(t=0;t<REPLAY_TYPES;t++){
+		if(s[t].count==0)
+			continue;
+		qsort(s[t].us,s[t].count,sizeof(int64_t),compareUs);
+		fprintf(Ptr,"latency.%s.p50_us %lld\n",typeNames[t],(long long)quantile(s[t].us,s[t].count,0.5));
+		fprintf(Ptr,"latency.%s.p90_us %lld\n",typeNames[t],(long long)quantile(s[t].us,s[t].count,0.9));
+		fprintf(Ptr,"latency.%s.p99_us %lld\n",typeNames[t],(long long)quantile(s[t].us,s[t].count,0.99));
+		fprintf(Ptr,"latency.%s.max_us %lld\n",typeNames[t],(long long)s[t].us[s[t].count-1]);
+	}
+	if(paced)
+		fprintf(Ptr,"pace.max_late_ms %.3f\n",late/1000.0);
+	return ReplaceFile(Ptr,file);
+}
+
+int main(int argc, char *argv[]){
+
+	struct xmlRoot2 *xmlTopology;
+	struct replayEvent *ev;
+	struct replaySamples samples[REPLAY_TYPES];
+	enum replayResult r;
+	const char *topology = "topology_xml_simul",*report = REPLAY_REPORT,*trace;
+	int64_t start,begin,wait,busy = 0,late = 0,requested = 0,admitted = 0;
+	int count,k,opt;
+	bool paced = false;
+	Calendar *calendar;
+	PathScheduler *requests;
+
+	if(argc<2 || argv[1][0]=='-'){
+		printf("Usage: %s <trace> [-t topology_file] [-m path_mode] [-p] [-o report]\n",argv[0]);
+		return 1;
+	}
+	trace = argv[1];
+	mode = PATH_SHORTEST;
+	optind = 2;
+	while((opt=getopt(argc,argv,"t:m:po:"))!=-1){
+		switch(opt){
+		case 't':
+			topology = optarg;
+			break;
+		case 'm':
+			mode = pathModeByName(optarg);
+			break;
+		case 'p':
+			paced = true;
+			break;
+		case 'o':
+			report = optarg;
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	xmlTopology = (struct xmlRoot2*) calloc(1,sizeof(struct xmlRoot2));
+	ImportTopologyFile(xmlTopology,topology);
+	if((nodes=xmlTopology->nodes)<=0)
+		return 1;
+	net = new Topology(nodes);
+	net->LoadTopology(xmlTopology);
+	if((ev=readTrace(trace,&count))==NULL){
+		printf("No events in %s\n",trace);
+		return 1;
+	}
+	lsps = new LspTable(nodes);
+	calendar = new Calendar(nodes);
+	requests = new PathScheduler(net,calendar,nodes,mode,REQUEST_WORKERS);
+	frr = new FastReroute(net,lsps,calendar,requests,NULL,NULL,NULL,nodes,mode);
+	memset(samples,0,sizeof(samples));
+	for(k=0;k<REPLAY_TYPES;k++)
+		samples[k].us = (int64_t*) malloc(count*sizeof(int64_t));
+
+	begin = StatClock();
+	for(k=0;k<count;k++){
+		//At the recorded pace an event late on its time runs at once
+		if(paced){
+			wait = begin+ev[k].at*1000-StatClock();
+			if(wait>0)
+				usleep(wait);
+			else if(-wait>late)
+				late = -wait;
+		}
+		start = StatClock();
+		switch(ev[k].type){
+		case REPLAY_SETUP:
+			r = setup(&ev[k]);
+			break;
+		case REPLAY_TEARDOWN:
+			r = teardown(&ev[k]);
+			break;
+		case REPLAY_RESIZE:
+			r = resize(&ev[k]);
+			break;
+		default:
+			r = linksDown(&ev[k]);
+			break;
+		}
+		samples[ev[k].type].us[samples[ev[k].type].count] = StatClock()-start;
+		busy+=samples[ev[k].type].us[samples[ev[k].type].count++];
+		samples[ev[k].type].results[r]++;
+		if(ev[k].type==REPLAY_SETUP && r!=REPLAY_INVALID){
+			requested+=ev[k].capacity;
+			if(r==REPLAY_DONE)
+				admitted+=ev[k].capacity;
+		}
+	}
+
+	//Throughput on the time of the engine, without the waits of the pace
+	if(!writeReport(report,trace,topology,paced,samples,requested,admitted,busy,late)){
+		printf("Report not written\n");
+		return 1;
+	}
+	printf("%d events replayed, report in %s\n",count,report);
+	for(k=0;k<REPLAY_TYPES;k++)
+		free(samples[k].us);
+	free(ev);
+	delete frr;
+	delete requests;
+	delete calendar;
+	delete lsps;
+	return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * scheduler.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Front end of the path computations. Requests for the same
+ * 				source, destination and capacity that are queued or being
+ * 				computed share one computation (single-flight). Queued work is
+ * 				ordered by priority, then by the nearest deadline; a request
+ * 				whose clients have all given up is dropped before it is
+ * 				computed. Workers compute a batch of requests on a read-only
+ * 				copy of the matrix, shared until the topology or the calendar
+ * 				change, so the topology is locked only to check or copy it.
+ */
+
+#include "header_project.h"
+
+//Computation shared by the clients that asked for the same path
+struct pathRequest{
+	int src;
+	int dst;
+	int capacity;
+	int priority;								//Highest of the clients
+	int64_t due;								//Nearest deadline (ms, 0 = none), for the order
+	int64_t expire;								//Latest deadline (0 = none), for shedding
+	u_int64_t seq;								//Submission order among equals
+	int slot;
+	int heap;									//Position in the queue, -1 once taken
+	int refs;									//Clients that did not get the result yet
+	enum schedStatus status;
+	int *path;
+	int size;
+};
+
+//Copy of the matrix with the bookings, shared by the batches of one version
+struct matrixCopy{
+	struct topologyLink **m;
+	unsigned version;							//Topology::Version of the copy
+	int bookings;								//Calendar::Bookings of the copy
+	time_t at;									//Residual computed at this second
+	int refs;									//Batches using it, plus one while current
+};
+
+static int64_t nowMs(){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (int64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+//Key of the single-flight index
+static u_int64_t requestKey(int n, int src, int dst, int capacity){
+	return ((u_int64_t)(u_int32_t)capacity<<32)|((u_int64_t)src*n+dst);
+}
+
+/******************* BEGIN PATHSCHEDULER CLASS METHODS *************************/
+
+//Constructor
+PathScheduler::PathScheduler(Topology *t, Calendar *cal, int nodes, enum pathMode m, int workers){
+
+	int i;
+
+	net = t;
+	calendar = cal;
+	n = nodes;
+	mode = m;
+	size = 64;
+	slots = (struct pathRequest**) calloc(size,sizeof(struct pathRequest*));
+	heap = (int*) malloc(size*sizeof(int));
+	freeSlots = (int*) malloc(size*sizeof(int));
+	for(i=0;i<size;i++)
+		freeSlots[i] = size-1-i;
+	nfree = size;
+	queued = 0;
+	seq = 0;
+	inFlight = new HashIndex(size);
+	current = NULL;
+	memset(&stats,0,sizeof(stats));
+	stop = false;
+	pthread_mutex_init(&mutex,NULL);
+	pthread_cond_init(&work,NULL);
+	pthread_cond_init(&done,NULL);
+	nworkers = workers;
+	tids = (pthread_t*) malloc(nworkers*sizeof(pthread_t));
+	for(i=0;i<nworkers;i++)
+		pthread_create(&tids[i],NULL,Worker,this);
+}
+
+//Destructor, the queued requests are computed first
+PathScheduler::~PathScheduler(){
+
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&mutex);
+	for(i=0;i<nworkers;i++)
+		pthread_join(tids[i],NULL);
+	for(i=0;i<size;i++)
+		if(slots[i]!=NULL){
+			delete[] slots[i]->path;
+			free(slots[i]);
+		}
+	if(current!=NULL)
+		Release(current);
+	free(slots);
+	free(heap);
+	free(freeSlots);
+	free(tids);
+	delete inFlight;
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&mutex);
+}
+
+void * PathScheduler::Worker(void *arg){
+
+	((PathScheduler*) arg)->Run();
+	return NULL;
+}
+
+//a before b in the queue
+bool PathScheduler::Before(struct pathRequest *a, struct pathRequest *b){
+
+	if(a->priority!=b->priority)
+		return a->priority>b->priority;
+	if(a->due!=b->due)
+		return b->due==0 || (a->due!=0 && a->due<b->due);
+	return a->seq<b->seq;
+}
+
+void PathScheduler::Place(int pos, int slot){
+
+	heap[pos] = slot;
+	slots[slot]->heap = pos;
+}
+
+void PathScheduler::SiftUp(int pos){
+
+	int slot = heap[pos];
+
+	while(pos>0 && Before(slots[slot],slots[heap[(pos-1)/2]])){
+		Place(pos,heap[(pos-1)/2]);
+		pos = (pos-1)/2;
+	}
+	Place(pos,slot);
+}
+
+//First request of the queue (mutex held, queue not empty)
+struct pathRequest * PathScheduler::Pop(){
+
+	struct pathRequest *r = slots[heap[0]];
+	int pos = 0,child,slot;
+
+	r->heap = -1;
+	slot = heap[--queued];
+	while((child=2*pos+1)<queued){
+		if(child+1<queued && Before(slots[heap[child+1]],slots[heap[child]]))
+			child++;
+		if(!Before(slots[heap[child]],slots[slot]))
+			break;
+		Place(pos,heap[child]);
+		pos = child;
+	}
+	if(queued>0)
+		Place(pos,slot);
+	return r;
+}
+
+/* Ask for a path from src to dst with capacity. A client with a higher
+ * priority is served first, deadline is in milliseconds from now (0: no
+ * deadline). The request is joined to an identical one queued or running. */
+struct pathRequest * PathScheduler::Submit(int src, int dst, int capacity, int priority, int deadline){
+
+	struct pathRequest *r;
+	int64_t due = (deadline>0)?nowMs()+deadline:0;
+	int k,old;
+
+	pthread_mutex_lock(&mutex);
+	stats.submitted++;
+	k = inFlight->Find(requestKey(n,src,dst,capacity));
+	if(k!=-1){
+		r = slots[k];
+		r->refs++;
+		if(r->expire!=0 && (due==0 || due>r->expire))
+			r->expire = due;
+		//A more urgent client moves the shared request ahead
+		if(r->heap!=-1 && (priority>r->priority || (due!=0 && (r->due==0 || due<r->due)))){
+			if(priority>r->priority)
+				r->priority = priority;
+			if(due!=0 && (r->due==0 || due<r->due))
+				r->due = due;
+			SiftUp(r->heap);
+		}
+		stats.merged++;
+		pthread_mutex_unlock(&mutex);
+		return r;
+	}
+
+	if(nfree==0){
+		old = size;
+		size*=2;
+		slots = (struct pathRequest**) realloc(slots,size*sizeof(struct pathRequest*));
+		heap = (int*) realloc(heap,size*sizeof(int));
+		freeSlots = (int*) realloc(freeSlots,size*sizeof(int));
+		memset(&slots[old],0,(size-old)*sizeof(struct pathRequest*));
+		for(k=size-1;k>=old;k--)
+			freeSlots[nfree++] = k;
+	}
+	k = freeSlots[--nfree];
+	r = (struct pathRequest*) calloc(1,sizeof(struct pathRequest));
+	r->src = src;
+	r->dst = dst;
+	r->capacity = capacity;
+	r->priority = priority;
+	r->due = due;
+	r->expire = due;
+	r->seq = seq++;
+	r->slot = k;
+	r->refs = 1;
+	r->status = SCHED_QUEUED;
+	slots[k] = r;
+	inFlight->Insert(requestKey(n,src,dst,capacity),k);
+	Place(queued,k);
+	SiftUp(queued++);
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&mutex);
+	return r;
+}
+
+/* Wait for the request: the path (to be deleted by the caller) or NULL if
+ * there is none or the request expired, as told by status */
+int * PathScheduler::Wait(struct pathRequest *r, int *s, enum schedStatus *status){
+
+	int *path = NULL;
+
+	pthread_mutex_lock(&mutex);
+	while(r->status==SCHED_QUEUED || r->status==SCHED_RUNNING)
+		pthread_cond_wait(&done,&mutex);
+	*status = r->status;
+	if(r->path!=NULL){
+		path = new int[r->size];
+		memcpy(path,r->path,r->size*sizeof(int));
+		*s = r->size;
+	}
+	if(--r->refs==0){
+		slots[r->slot] = NULL;
+		freeSlots[nfree++] = r->slot;
+		delete[] r->path;
+		free(r);
+	}
+	pthread_mutex_unlock(&mutex);
+	return path;
+}
+
+//No client joins the request from now on (mutex held)
+void PathScheduler::Finish(struct pathRequest *r, enum schedStatus status){
+
+	inFlight->Remove(requestKey(n,r->src,r->dst,r->capacity),r->slot);
+	r->status = status;
+}
+
+/* Copy of the matrix for a batch: the current one while neither the topology
+ * nor the calendar changed, a new one otherwise. With bookings the residual
+ * also depends on the time, so it is copied again every second */
+struct matrixCopy * PathScheduler::Acquire(){
+
+	struct matrixCopy *c;
+	time_t now;
+
+	net->Lock();
+	now = time(NULL);
+	pthread_mutex_lock(&mutex);
+	c = current;
+	if(c!=NULL && c->version==net->Version() && c->bookings==calendar->Bookings() &&
+			(c->bookings==0 || c->at==now)){
+		c->refs++;
+		pthread_mutex_unlock(&mutex);
+		net->Unlock();
+		return c;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	//Copied under the topology lock only: another worker waits for it on net->Lock
+	c = (struct matrixCopy*) malloc(sizeof(struct matrixCopy));
+	c->m = calendar->Copy(net->Matrix(),now,CALENDAR_FOREVER);
+	c->version = net->Version();
+	c->bookings = calendar->Bookings();
+	c->at = now;
+	c->refs = 2;
+	pthread_mutex_lock(&mutex);
+	if(current!=NULL)
+		Release(current);
+	current = c;
+	pthread_mutex_unlock(&mutex);
+	net->Unlock();
+	return c;
+}
+
+//The copy is freed by the last batch using it (mutex held)
+void PathScheduler::Release(struct matrixCopy *c){
+
+	if(--c->refs>0)
+		return;
+	calendar->FreeResidual(c->m);
+	free(c);
+}
+
+/* Take up to REQUEST_BATCH requests in order, drop the expired ones and
+ * compute the others on one copy of the matrix */
+void PathScheduler::Run(){
+
+	struct pathRequest *batch[REQUEST_BATCH];
+	struct matrixCopy *c;
+	int count,k,shed;
+	int64_t now,span;
+
+	pthread_mutex_lock(&mutex);
+	while(1){
+		while(queued==0 && !stop)
+			pthread_cond_wait(&work,&mutex);
+		if(queued==0)
+			break;
+		now = nowMs();
+		count = 0;
+		shed = 0;
+		while(queued>0 && count<REQUEST_BATCH){
+			batch[count] = Pop();
+			if(batch[count]->expire!=0 && batch[count]->expire<now){
+				Finish(batch[count],SCHED_EXPIRED);
+				shed++;
+				continue;
+			}
+			batch[count++]->status = SCHED_RUNNING;
+		}
+		stats.shed+=shed;
+		if(shed>0)
+			pthread_cond_broadcast(&done);
+		if(count==0)
+			continue;
+		pthread_mutex_unlock(&mutex);
+
+		span = TraceBegin();
+		c = Acquire();
+		for(k=0;k<count;k++)
+			batch[k]->path = find_path_mode(c->m,n,batch[k]->src,batch[k]->dst,batch[k]->capacity,mode,
+					&batch[k]->size);
+		TraceEnd("scheduler","batch",span,count);
+
+		pthread_mutex_lock(&mutex);
+		Release(c);
+		for(k=0;k<count;k++){
+			Finish(batch[k],(batch[k]->path!=NULL)?SCHED_DONE:SCHED_NO_PATH);
+			stats.computed++;
+		}
+		stats.batches++;
+		pthread_cond_broadcast(&done);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void PathScheduler::Stats(struct schedStats *st){
+
+	pthread_mutex_lock(&mutex);
+	*st = stats;
+	st->queued = queued;
+	pthread_mutex_unlock(&mutex);
+}
+
+/******************* END PATHSCHEDULER CLASS METHODS ***************************/
@@ -0,0 +1,154 @@
+/*
+ * segments.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Segment routing. An explicit path becomes the shortest list of
+ * 				SIDs that the routers forward on it with the IGP metrics and
+ * 				ECMP: a node SID (loopback of a router) covers the longest part
+ * 				of the path that is the only shortest path to that router, an
+ * 				adjacency SID (address of the next hop) forces a link that is
+ * 				not. Distances and number of shortest paths from every router
+ * 				are kept for the current metrics, so a path is encoded in one
+ * 				pass along its hops.
+ */
+
+#include "header_project.h"
+
+/******************* BEGIN SEGMENTROUTING CLASS METHODS ************************/
+
+//Constructor
+SegmentRouting::SegmentRouting(int nodes, int depth){
+
+	n = nodes;
+	msd = depth;
+	built = false;
+	version = 0;
+	dist = (int*) malloc(n*n*sizeof(int));
+	paths = (char*) malloc(n*n*sizeof(char));
+	stats.encoded = 0;
+	stats.sids = 0;
+	stats.hops = 0;
+	stats.tooDeep = 0;
+}
+
+//Destructor
+SegmentRouting::~SegmentRouting(){
+
+	free(dist);
+	free(paths);
+}
+
+//IGP metric of a link: files without it route the IGP on the TE metric
+int linkIgpMetric(struct topologyLink *l){
+
+	if(l->igpMetric>0)
+		return l->igpMetric;
+	return (l->metric>0)?l->metric:1;
+}
+
+/* ECMP DAG of every router: distance on the IGP metrics and number of
+ * shortest paths to each router (only 1 or more than 1 counts) */
+void SegmentRouting::Build(struct topologyLink **net){
+
+	bool done[n];
+	int s,v,x,cnt,d;
+	int *ds;
+	char *ps;
+
+	for(s=0;s<n;s++){
+		ds = &dist[s*n];
+		ps = &paths[s*n];
+		for(v=0;v<n;v++){
+			ds[v] = -1;
+			ps[v] = 0;
+			done[v] = false;
+		}
+		ds[s] = 0;
+		ps[s] = 1;
+		for(cnt=0;cnt<n;cnt++){
+			x = -1;
+			for(v=0;v<n;v++)
+				if(!done[v] && ds[v]!=-1 && (x==-1 || ds[v]<ds[x]))
+					x = v;
+			if(x==-1)
+				break;
+			done[x] = true;
+			for(v=0;v<n;v++){
+				if(net[x][v].capacity==-1 || done[v])
+					continue;
+				d = ds[x]+linkIgpMetric(&net[x][v]);
+				if(ds[v]==-1 || d<ds[v]){
+					ds[v] = d;
+					ps[v] = ps[x];
+				}
+				else if(d==ds[v])
+					ps[v] = 2;
+			}
+		}
+	}
+}
+
+/* SIDs of the path in hops (one per hop at most): addresses of loopbacks for
+ * node SIDs and of next hops for adjacency SIDs. Returns the number of SIDs,
+ * -1 if they are more than the max SID depth. Topology locked. */
+int SegmentRouting::Encode(Topology *net, int *path, int len, char **hops){
+
+	struct topologyLink **m = net->Matrix();
+	int i,j,cost,nsids = 0,a;
+
+	if(!built || version!=net->IgpVersion()){
+		Build(m);
+		version = net->IgpVersion();
+		built = true;
+	}
+	i = 0;
+	while(i<len-1){
+		//Longest part from path[i] that is the only shortest path to its end
+		a = path[i]*n;
+		cost = 0;
+		for(j=i;j<len-1;j++){
+			cost+=linkIgpMetric(&m[path[j]][path[j+1]]);
+			if(dist[a+path[j+1]]!=cost || paths[a+path[j+1]]!=1)
+				break;
+		}
+		if(nsids==msd){
+			stats.tooDeep++;
+			return -1;
+		}
+		if(j==i){
+			hops[nsids++] = m[path[i]][path[i+1]].dstAddr;
+			i++;
+		}
+		else{
+			hops[nsids++] = net->LoopArray()[path[j]].loopAddr;
+			i = j;
+		}
+	}
+	stats.encoded++;
+	stats.sids+=nsids;
+	stats.hops+=len-1;
+	return nsids;
+}
+
+void SegmentRouting::Stats(struct srStats *st){
+	*st = stats;
+}
+
+/******************* END SEGMENTROUTING CLASS METHODS **************************/
+
+/* Explicit path of a tunnel on path: SIDs with segment routing, when the
+ * list fits the max SID depth, next-address of every hop otherwise.
+ * hops has room for len-1 addresses. Topology locked. */
+int TunnelHops(Topology *net, SegmentRouting *sr, int *path, int len, char **hops, bool *segments){
+
+	int i,nsids;
+
+	*segments = false;
+	if(sr!=NULL && (nsids=sr->Encode(net,path,len,hops))!=-1){
+		*segments = true;
+		return nsids;
+	}
+	for(i=0;i<len-1;i++)
+		hops[i] = net->Matrix()[path[i]][path[i+1]].dstAddr;
+	return len-1;
+}
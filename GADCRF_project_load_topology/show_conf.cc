@@ -22,15 +22,47 @@ void showConfigureNet(struct loopback* loopArray, struct topologyLink** net, int
 	}
 }
 
-void showConfigureLSP(int s, char* src, char* dest, char*cap, char*id, int size, struct topologyLink **net){
-	printf("Username:\radmin\rPassword:\r\rR%d# config t\rR%d(config)# interface Tunnel%s\r"
-			"R%d(config-if)# ip unnumbered Loopback0\rR%d(config-if)# tunnel destination %s\r"
-			"R%d(config-if)# tunnel mode mpls traffic-eng\rR%d(config-if)# tunnel mpls traffic-eng autoroute announce\r"
-			"R%d(config-if)# tunnel mpls traffic-eng priority 2 2\rR%d(config-if)# tunnel mpls traffic-eng bandwidth %s\r"
-			"R%d(config-if)# tunnel mpls traffic-eng path-option 1 explicit name path%s\r"
-			"R%d(config-if)# ip explicit-path name path%s enable\r",
-			s,s,id,s,s,dest,s,s,s,s,cap,s,id,s,id);
-	for(int i=0;i<size;i++)
-		printf("R%d(cfg-ip-expl-path)# next-address %s\r",s,net[i][i+1].dstAddr);
-	printf("R%d(cfg-ip-expl-path)# exit\rR%d(config)# exit\rR%d# exit\r\r",s,s,s);
+void showConfigureBatch(int s, struct provOp *ops){
+	printf("Username:\radmin\rPassword:\r\rR%d# config t\r",s);
+	for(struct provOp *op=ops; op!=NULL; op=op->next){
+		StatAdd(STAT_PROV_OPS,1);
+		if(op->type==OP_REMOVE){
+			printf("R%d(config)# no interface Tunnel%d\rR%d(config)# no ip explicit-path name path%d\r",
+					s,op->id,s,op->id);
+			continue;
+		}
+		if(op->type==OP_P2MP_LEAF){
+			if(op->replace)
+				printf("R%d(config)# no ip explicit-path name p2mp%dleaf%d\r",s,op->id,op->branch);
+			printf("R%d(config)# ip explicit-path name p2mp%dleaf%d enable\r",s,op->id,op->branch);
+			for(int i=0;i<op->nhops;i++)
+				printf("R%d(cfg-ip-expl-path)# next-address %s\r",s,op->hops[i]);
+			printf("R%d(cfg-ip-expl-path)# exit\rR%d(config)# mpls traffic-eng destination list name p2mp%d\r"
+					"R%d(cfg-dest-list)# ip %s path-option 1 explicit name p2mp%dleaf%d\rR%d(cfg-dest-list)# exit\r",
+					s,s,op->id,s,op->dest,op->id,op->branch,s);
+			continue;
+		}
+		if(op->type==OP_P2MP){
+			printf("R%d(config)# interface Tunnel-mte%d\rR%d(config-if)# ip unnumbered Loopback0\r"
+					"R%d(config-if)# tunnel mpls traffic-eng destination list name p2mp%d\r"
+					"R%d(config-if)# tunnel mpls traffic-eng priority %d %d\r"
+					"R%d(config-if)# tunnel mpls traffic-eng bandwidth %d\rR%d(config-if)# exit\r",
+					s,op->id,s,s,op->id,s,op->priority,op->priority,s,op->capacity,s);
+			continue;
+		}
+		printf("R%d(config)# interface Tunnel%d\r"
+				"R%d(config-if)# ip unnumbered Loopback0\rR%d(config-if)# tunnel destination %s\r"
+				"R%d(config-if)# tunnel mode mpls traffic-eng\rR%d(config-if)# tunnel mpls traffic-eng autoroute announce\r"
+				"R%d(config-if)# tunnel mpls traffic-eng priority %d %d\rR%d(config-if)# tunnel mpls traffic-eng bandwidth %d\r"
+				"R%d(config-if)# tunnel mpls traffic-eng path-option 1 explicit name path%d%s\rR%d(config-if)# exit\r",
+				s,op->id,s,s,op->dest,s,s,s,op->priority,op->priority,s,op->capacity,s,op->id,
+				op->segments?" segment-routing":"",s);
+		if(op->replace)
+			printf("R%d(config)# no ip explicit-path name path%d\r",s,op->id);
+		printf("R%d(config)# ip explicit-path name path%d enable\r",s,op->id);
+		for(int i=0;i<op->nhops;i++)
+			printf("R%d(cfg-ip-expl-path)# next-address %s\r",s,op->hops[i]);
+		printf("R%d(cfg-ip-expl-path)# exit\r",s);
+	}
+	printf("R%d(config)# end\rR%d# exit\r\r",s,s);
 }
@@ -0,0 +1,56 @@
+/*
+ * thread_slots.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Pool of structs owned by one thread each, taken without
+ * 				locks: a new thread takes a struct left by a thread that ended
+ * 				(compare and swap on its busy flag) or pushes a new one on the
+ * 				list. Structs are never freed, so the list can be walked while
+ * 				threads come and go. Used by the trace rings and the shards of
+ * 				the metrics.
+ */
+
+#include "header_project.h"
+
+/******************* BEGIN THREADSLOTS CLASS METHODS ***************************/
+
+//Constructor, bytes of the structs of the pool (threadSlot first)
+ThreadSlots::ThreadSlots(size_t bytes){
+
+	size = bytes;
+	slots = NULL;
+	pthread_key_create(&owner,Release);
+}
+
+//The struct goes back to the pool when its thread ends, with its content
+void ThreadSlots::Release(void *s){
+	__atomic_store_n(&((struct threadSlot*) s)->busy,0,__ATOMIC_RELEASE);
+}
+
+//Struct of the calling thread: a free one, or a new one added to the list
+struct threadSlot * ThreadSlots::Take(){
+
+	struct threadSlot *s;
+	int free;
+
+	for(s=First();s!=NULL;s=s->next){
+		free = 0;
+		if(__atomic_compare_exchange_n(&s->busy,&free,1,false,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+			break;
+	}
+	if(s==NULL){
+		s = (struct threadSlot*) calloc(1,size);
+		s->busy = 1;
+		s->next = __atomic_load_n(&slots,__ATOMIC_RELAXED);
+		while(!__atomic_compare_exchange_n(&slots,&s->next,s,false,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+	}
+	pthread_setspecific(owner,s);
+	return s;
+}
+
+//All the structs, of running threads or free
+struct threadSlot * ThreadSlots::First(){
+	return __atomic_load_n(&slots,__ATOMIC_ACQUIRE);
+}
+
+/******************* END THREADSLOTS CLASS METHODS *****************************/
@@ -0,0 +1,136 @@
+/*
+ * trace.cc
+ *
+ *      Author: Roberta Fumarola, David Costa, Gaetano Alboreto
+ * Description: Spans of the work of the PCE, dumped in the Chrome trace
+ * 				format (chrome://tracing or Perfetto). Every thread records in
+ * 				its own ring of TRACE_SPANS spans without locks: a span is
+ * 				written and then published by moving the head of the ring, and
+ * 				the dump drops the spans that were overwritten while it copied
+ * 				them. The ring of a thread that ended is taken by the next new
+ * 				thread. Times are microseconds of CLOCK_MONOTONIC; while tracing
+ * 				is off a span costs one test.
+ */
+
+#include "header_project.h"
+#include <sys/syscall.h>
+
+struct traceSpan{
+	const char *cat;
+	const char *name;
+	int64_t start;
+	int64_t dur;
+	int tid;
+	int arg;									//-1: none
+};
+
+struct traceBuffer{
+	struct threadSlot slot;
+	u_int64_t head;								//Spans written, the last TRACE_SPANS are kept
+	struct traceSpan spans[TRACE_SPANS];
+};
+
+static bool traceOn = false;
+static ThreadSlots buffers(sizeof(struct traceBuffer));
+static __thread struct traceBuffer *mine = NULL;
+static __thread int tid = 0;
+
+//Ring of the calling thread, taken from the pool the first time
+static struct traceBuffer * threadBuffer(){
+
+	if(mine==NULL){
+		tid = syscall(SYS_gettid);
+		mine = (struct traceBuffer*) buffers.Take();
+	}
+	return mine;
+}
+
+static int64_t nowUs(){
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+void TraceEnable(bool on){
+	__atomic_store_n(&traceOn,on,__ATOMIC_RELAXED);
+}
+
+bool TraceOn(){
+	return __atomic_load_n(&traceOn,__ATOMIC_RELAXED);
+}
+
+//Start of a span, 0 while tracing is off
+int64_t TraceBegin(){
+	return TraceOn()?nowUs():0;
+}
+
+/* Span from start to now, in category cat. cat and name are kept until the
+ * dump, so they must be string constants. */
+void TraceEnd(const char *cat, const char *name, int64_t start, int arg){
+
+	struct traceBuffer *b;
+	struct traceSpan *s;
+	u_int64_t h;
+
+	if(start==0)
+		return;
+	b = threadBuffer();
+	h = b->head;
+	s = &b->spans[h%TRACE_SPANS];
+	s->cat = cat;
+	s->name = name;
+	s->start = start;
+	s->dur = nowUs()-start;
+	s->tid = tid;
+	s->arg = arg;
+	__atomic_store_n(&b->head,h+1,__ATOMIC_RELEASE);
+}
+
+/* Spans of all the threads in file, as a Chrome trace. Returns the number of
+ * spans written, -1 if the file cannot be written. */
+int TraceDump(const char *file){
+
+	struct traceSpan *copy = (struct traceSpan*) malloc(TRACE_SPANS*sizeof(struct traceSpan));
+	struct threadSlot *slot;
+	struct traceBuffer *b;
+	struct traceSpan *s;
+	char tmp[CHAR_COMMAND];
+	u_int64_t first,last,h,i;
+	int count = 0;
+	FILE *Ptr;
+
+	snprintf(tmp,CHAR_COMMAND,"%s.tmp",file);
+	if((Ptr=fopen(tmp,"w"))==NULL){
+		printf("Error opening %s\n",tmp);
+		free(copy);
+		return -1;
+	}
+	fprintf(Ptr,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for(slot=buffers.First();slot!=NULL;slot=slot->next){
+		b = (struct traceBuffer*) slot;
+		last = __atomic_load_n(&b->head,__ATOMIC_ACQUIRE);
+		first = (last>TRACE_SPANS)?last-TRACE_SPANS:0;
+		for(i=first;i<last;i++)
+			copy[i%TRACE_SPANS] = b->spans[i%TRACE_SPANS];
+		//The slot being written may be the oldest one copied
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		h = __atomic_load_n(&b->head,__ATOMIC_RELAXED);
+		if(h+1>TRACE_SPANS && h+1-TRACE_SPANS>first)
+			first = h+1-TRACE_SPANS;
+		for(i=first;i<last;i++){
+			s = &copy[i%TRACE_SPANS];
+			fprintf(Ptr,"%s\n{\"cat\":\"%s\",\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d",
+					(count>0)?",":"",s->cat,s->name,(long long)s->start,(long long)s->dur,(int)getpid(),s->tid);
+			if(s->arg!=-1)
+				fprintf(Ptr,",\"args\":{\"n\":%d}",s->arg);
+			fprintf(Ptr,"}");
+			count++;
+		}
+	}
+	fprintf(Ptr,"\n]}\n");
+	free(copy);
+	if(!ReplaceFile(Ptr,file))
+		return -1;
+	return count;
+}
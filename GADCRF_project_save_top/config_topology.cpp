@@ -755,6 +755,8 @@ void Topology::InitXmlStruct(){
 			strcpy(l[k].dstAddr,adjMatrix[i][j].dstAddr);
 			strcpy(l[k].srcInterface,adjMatrix[i][j].srcInterface);
 			strcpy(l[k].dstInterface,adjMatrix[i][j].dstInterface);
+			l[k].metric = adjMatrix[i][j].metric;
+			l[k].delay = adjMatrix[i][j].delay;
 		}
 		t=k-c;
 		c++;
@@ -773,6 +775,8 @@ void Topology::SaveTopology(){
 			STRUCTS_STRUCT_FIELD(topologyLink, dstAddr, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, srcInterface, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, dstInterface, &structs_type_string),
+			STRUCTS_STRUCT_FIELD(topologyLink, metric, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, delay, &structs_type_int),
 			STRUCTS_STRUCT_FIELD_END
 	};
 
@@ -871,6 +875,8 @@ void Topology::LoadTopology(struct xmlRoot2* xmlTopology){
 			strcpy(adjMatrix[i][j].dstAddr,l[k].dstAddr);
 			strcpy(adjMatrix[i][j].srcInterface,l[k].srcInterface);
 			strcpy(adjMatrix[i][j].dstInterface,l[k].dstInterface);
+			adjMatrix[i][j].metric = l[k].metric;
+			adjMatrix[i][j].delay = l[k].delay;
 		}
 		t=k-c;
 		c++;
@@ -910,6 +916,8 @@ void ImportTopology(struct xmlRoot2* xmlTopology){
 			STRUCTS_STRUCT_FIELD(topologyLink, dstAddr, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, srcInterface, &structs_type_string),
 			STRUCTS_STRUCT_FIELD(topologyLink, dstInterface, &structs_type_string),
+			STRUCTS_STRUCT_FIELD(topologyLink, metric, &structs_type_int),
+			STRUCTS_STRUCT_FIELD(topologyLink, delay, &structs_type_int),
 			STRUCTS_STRUCT_FIELD_END
 	};
 
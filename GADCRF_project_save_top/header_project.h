@@ -42,6 +42,8 @@ struct topologyLink{
 	char *dstAddr;
 	char *srcInterface;
 	char *dstInterface;
+	int metric;									//TE metric, 0: one hop
+	int delay;									//Microseconds
 };
 
 struct topLink{